@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "CardBackend.hpp"
+
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+#include "PcscBackend.hpp"
+#include "RecordingBackend.hpp"
+#include "ReplayBackend.hpp"
+#include "SimulatorBackend.hpp"
+
+namespace {
+
+std::optional<ChipProfile> profileFromName(const std::string &name) {
+  if (name == "mav4")
+    return ChipProfile::Mav4;
+  if (name == "pardis")
+    return ChipProfile::Pardis;
+  if (name == "omid")
+    return ChipProfile::Omid;
+  return std::nullopt;
+}
+
+// "sim[:<card>][,t0][,ext][,latency=<us>][,readers=<n>]"
+// <card> is a profile name, optionally with "-ext" for the same card behind
+// an ATR that announces extended length, or an image file.
+std::unique_ptr<CardBackend> createSimulator(const std::string &spec) {
+  std::string card = "mav4";
+  std::string options;
+  size_t comma = spec.find(',');
+  if (comma != std::string::npos)
+    options = spec.substr(comma + 1);
+  std::string head = spec.substr(0, comma);
+  if (head.size() > 4)
+    card = head.substr(4);
+
+  VirtualCardOptions cardOptions;
+  size_t readers = 1;
+  std::istringstream parts(options);
+  std::string option;
+  while (std::getline(parts, option, ',')) {
+    std::string key = option.substr(0, option.find('='));
+    std::string value =
+        key.size() < option.size() ? option.substr(key.size() + 1) : "";
+    try {
+      if (option == "t0") {
+        cardOptions.protocol = SCARD_PROTOCOL_T0;
+      } else if (option == "ext") {
+        cardOptions.extendedLength = true;
+      } else if (key == "latency" && !value.empty()) {
+        cardOptions.commandLatency =
+            std::chrono::microseconds(std::stoul(value));
+      } else if (key == "readers" && !value.empty()) {
+        readers = std::stoul(value);
+      } else {
+        throw std::invalid_argument(option);
+      }
+    } catch (const std::logic_error &) {
+      throw std::invalid_argument("Unknown simulator option: " + option);
+    }
+  }
+  if (readers == 0)
+    throw std::invalid_argument("Simulator needs at least one reader");
+
+  bool extendedAtr = card.ends_with("-ext");
+  std::optional<ChipProfile> profile =
+      profileFromName(extendedAtr ? card.substr(0, card.size() - 4) : card);
+  CardImage image;
+  if (profile && extendedAtr) {
+    image = extendedLengthCardImage(*profile);
+    cardOptions.extendedLength = true;
+  } else {
+    image = profile ? sampleCardImage(*profile) : loadCardImage(card);
+  }
+  return std::make_unique<SimulatorBackend>(std::move(image), cardOptions,
+                                            readers);
+}
+
+// "replay:<trace>[,speed=<x>][,lenient]"
+std::unique_ptr<CardBackend> createReplay(const std::string &spec) {
+  size_t comma = spec.find(',');
+  std::string path = spec.substr(7, comma - 7);
+  std::string options;
+  if (comma != std::string::npos)
+    options = spec.substr(comma + 1);
+
+  ReplayOptions replayOptions;
+  std::istringstream parts(options);
+  std::string option;
+  while (std::getline(parts, option, ',')) {
+    try {
+      if (option == "lenient") {
+        replayOptions.lenient = true;
+      } else if (option.starts_with("speed=")) {
+        replayOptions.speed = std::stod(option.substr(6));
+      } else {
+        throw std::invalid_argument(option);
+      }
+    } catch (const std::logic_error &) {
+      throw std::invalid_argument("Unknown replay option: " + option);
+    }
+  }
+  if (path.empty())
+    throw std::invalid_argument("Replay needs a trace file");
+  return std::make_unique<ReplayBackend>(path, replayOptions);
+}
+
+} // namespace
+
+std::optional<CardConnection>
+CardBackend::connectFirst(DWORD timeoutMs,
+                          const std::function<void()> &onWait) {
+  std::vector<std::string> readers = listReaders();
+  if (!readers.empty()) {
+    try {
+      return connect(readers.front());
+    } catch (const std::runtime_error &) {
+      // most likely no card in it yet
+    }
+  }
+  if (timeoutMs == 0)
+    return std::nullopt;
+  if (onWait)
+    onWait();
+
+  std::optional<std::string> reader = waitForCard(timeoutMs);
+  if (!reader)
+    return std::nullopt;
+  return connect(*reader);
+}
+
+std::unique_ptr<CardBackend> createBackend(const std::string &spec) {
+#ifdef _WIN32
+  const char *platformName = "winscard";
+#else
+  const char *platformName = "pcsc-lite";
+#endif
+  if (spec == "pcsc" || spec == platformName)
+    return std::make_unique<PcscBackend>();
+  if (spec == "sim" || spec.starts_with("sim:") || spec.starts_with("sim,"))
+    return createSimulator(spec);
+  if (spec.starts_with("replay:"))
+    return createReplay(spec);
+  throw std::invalid_argument("Unknown card backend: " + spec);
+}
+
+std::unique_ptr<CardBackend> createDefaultBackend() {
+  const char *spec = std::getenv("CARD_BACKEND");
+  std::unique_ptr<CardBackend> backend =
+      createBackend(spec && *spec ? spec : "pcsc");
+
+  const char *trace = std::getenv("CARD_TRACE");
+  if (trace && *trace)
+    backend = std::make_unique<RecordingBackend>(std::move(backend), trace);
+  return backend;
+}
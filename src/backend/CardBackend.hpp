@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "transport/CardLink.hpp"
+#include "transport/Pcsc.hpp"
+
+/** A card connected through a CardBackend. Destroying the link disconnects. */
+struct CardConnection {
+  std::string reader;
+  std::unique_ptr<CardLink> link;
+  DWORD activeProtocol = 0; // T=0 or T=1
+};
+
+/**
+ * Where cards come from: the platform's PC/SC resource manager or an
+ * in-process virtual card. Pick one at runtime with createBackend().
+ *
+ * A backend is used from one thread at a time; give each thread its own,
+ * as with PC/SC contexts.
+ */
+class CardBackend {
+public:
+  virtual ~CardBackend() = default;
+
+  /** "winscard", "pcsc-lite" or "simulator". */
+  virtual const char *name() const = 0;
+
+  /**
+   * Names of the readers, possibly none.
+   *
+   * @throws std::runtime_error if the readers cannot be listed.
+   */
+  virtual std::vector<std::string> listReaders() = 0;
+
+  /**
+   * Connects to the card in `reader`, shared, with T=0 or T=1.
+   *
+   * @throws std::runtime_error if there is no card or it cannot be reached.
+   */
+  virtual CardConnection connect(const std::string &reader) = 0;
+
+  /**
+   * Waits until a card is present in any reader.
+   *
+   * @return its reader, or nothing after `timeoutMs` milliseconds.
+   */
+  virtual std::optional<std::string> waitForCard(DWORD timeoutMs) = 0;
+
+  /**
+   * Connects to the card in the first reader. If that fails and `timeoutMs`
+   * is not 0, calls `onWait`, waits that long for a card in any reader and
+   * connects to it.
+   *
+   * @return nothing if there is no reader or no card turned up.
+   * @throws std::runtime_error if the backend itself fails.
+   */
+  std::optional<CardConnection>
+  connectFirst(DWORD timeoutMs = 0,
+               const std::function<void()> &onWait = nullptr);
+};
+
+/**
+ * The backend described by `spec`:
+ *
+ *   pcsc                 the platform's PC/SC (also "winscard" on Windows,
+ *                        "pcsc-lite" elsewhere)
+ *   sim[:<card>][,t0][,ext][,latency=<us>][,readers=<n>]
+ *                        virtual cards, no resource manager involved;
+ *                        <card> is mav4 (default), pardis, omid or the path
+ *                        of a card image file; a profile name ending in
+ *                        "-ext" (mav4-ext, ...) is that card behind an ATR
+ *                        announcing extended length. "ext" lets the card
+ *                        accept extended APDUs without changing its ATR
+ *   replay:<trace>[,speed=<x>][,lenient]
+ *                        the sessions of an APDU trace, see ReplayBackend
+ *
+ * @throws std::invalid_argument if `spec` names no backend of this build.
+ * @throws std::runtime_error if the backend cannot be started.
+ */
+std::unique_ptr<CardBackend> createBackend(const std::string &spec);
+
+/**
+ * createBackend() with $CARD_BACKEND, or "pcsc" if it is not set. If
+ * $CARD_TRACE names a file, every connection is recorded to it.
+ */
+std::unique_ptr<CardBackend> createDefaultBackend();
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "PcscBackend.hpp"
+
+#include <cstring>
+
+#include "transport/ReaderMonitor.hpp"
+#include "transport/TransportError.hpp"
+
+PcscBackend::PcscBackend() {
+  LONG status =
+      SCardEstablishContext(SCARD_SCOPE_SYSTEM, nullptr, nullptr, &m_context);
+  if (status != SCARD_S_SUCCESS)
+    throwPcscError("Failed to establish context", status);
+}
+
+PcscBackend::~PcscBackend() { SCardReleaseContext(m_context); }
+
+const char *PcscBackend::name() const {
+#ifdef _WIN32
+  return "winscard";
+#else
+  return "pcsc-lite";
+#endif
+}
+
+std::vector<std::string> PcscBackend::listReaders() {
+  std::vector<std::string> readers;
+  LPSTR readersStr = nullptr;
+  DWORD readersLen = SCARD_AUTOALLOCATE;
+  LONG status =
+      SCardListReadersA(m_context, nullptr, (LPSTR)&readersStr, &readersLen);
+  if (status == SCARD_E_NO_READERS_AVAILABLE)
+    return readers;
+  if (status != SCARD_S_SUCCESS)
+    throwPcscError("Failed to list readers", status);
+
+  for (LPSTR current = readersStr; current && *current;
+       current += strlen(current) + 1)
+    readers.push_back(current);
+  SCardFreeMemory(m_context, readersStr);
+  return readers;
+}
+
+CardConnection PcscBackend::connect(const std::string &reader) {
+  SCARDHANDLE cardHandle = 0;
+  DWORD activeProtocol = 0;
+  LONG status = SCardConnectA(m_context, reader.c_str(), SCARD_SHARE_SHARED,
+                              SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1,
+                              &cardHandle, &activeProtocol);
+  if (status != SCARD_S_SUCCESS)
+    throwPcscError("Failed to connect", status);
+
+  CardConnection connection;
+  connection.reader = reader;
+  connection.activeProtocol = activeProtocol;
+  try {
+    connection.link =
+        std::make_unique<PcscLink>(cardHandle, activeProtocol, true);
+  } catch (...) {
+    SCardDisconnect(cardHandle, SCARD_LEAVE_CARD);
+    throw;
+  }
+  return connection;
+}
+
+std::optional<std::string> PcscBackend::waitForCard(DWORD timeoutMs) {
+  ReaderMonitor monitor;
+  return monitor.waitForCard(timeoutMs);
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "CardBackend.hpp"
+
+/**
+ * Readers and cards of the platform's PC/SC resource manager: WinSCard on
+ * Windows, pcsc-lite (pcscd) elsewhere.
+ */
+class PcscBackend : public CardBackend {
+public:
+  /** @throws TransportError if no PC/SC context can be established. */
+  PcscBackend();
+  ~PcscBackend() override;
+
+  PcscBackend(const PcscBackend &) = delete;
+  PcscBackend &operator=(const PcscBackend &) = delete;
+
+  const char *name() const override;
+  std::vector<std::string> listReaders() override;
+  CardConnection connect(const std::string &reader) override;
+  std::optional<std::string> waitForCard(DWORD timeoutMs) override;
+
+  SCARDCONTEXT context() const { return m_context; }
+
+private:
+  SCARDCONTEXT m_context = 0;
+};
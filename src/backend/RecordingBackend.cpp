@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "RecordingBackend.hpp"
+
+#include <stdexcept>
+
+#include "trace/RecordingLink.hpp"
+
+RecordingBackend::RecordingBackend(std::unique_ptr<CardBackend> backend,
+                                   const std::string &tracePath)
+    : m_backend(std::move(backend)), m_writer(openTraceWriter(tracePath)) {
+  if (!m_backend)
+    throw std::invalid_argument("No backend to record");
+}
+
+std::vector<std::string> RecordingBackend::listReaders() {
+  return m_backend->listReaders();
+}
+
+CardConnection RecordingBackend::connect(const std::string &reader) {
+  CardConnection connection = m_backend->connect(reader);
+  connection.link = std::make_unique<RecordingLink>(
+      std::move(connection.link), m_writer, connection.reader,
+      connection.activeProtocol);
+  return connection;
+}
+
+std::optional<std::string> RecordingBackend::waitForCard(DWORD timeoutMs) {
+  return m_backend->waitForCard(timeoutMs);
+}
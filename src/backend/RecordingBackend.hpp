@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+
+#include "CardBackend.hpp"
+#include "trace/ApduTrace.hpp"
+
+/**
+ * Another backend whose connections are recorded to an APDU trace, one
+ * session per connection.
+ */
+class RecordingBackend : public CardBackend {
+public:
+  /** @throws std::runtime_error if the trace cannot be created. */
+  RecordingBackend(std::unique_ptr<CardBackend> backend,
+                   const std::string &tracePath);
+
+  const char *name() const override { return m_backend->name(); }
+  std::vector<std::string> listReaders() override;
+  CardConnection connect(const std::string &reader) override;
+  std::optional<std::string> waitForCard(DWORD timeoutMs) override;
+
+private:
+  std::unique_ptr<CardBackend> m_backend;
+  std::shared_ptr<TraceWriter> m_writer;
+};
@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ReplayBackend.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+#include "trace/ApduTrace.hpp"
+#include "transport/CardLink.hpp"
+#include "transport/Hex.hpp"
+#include "transport/TransportError.hpp"
+
+namespace {
+
+const BYTE SW_NO_DIAGNOSIS[] = {0x6F, 0x00};
+
+std::string toHex(std::span<const BYTE> bytes) {
+  std::string hex;
+  appendHex(hex, bytes, HexCase::Upper);
+  return hex;
+}
+
+std::string describe(const TraceEvent &event) {
+  return event.kind == TraceRecord::Exchange ? toHex(event.command)
+                                             : "reconnect";
+}
+
+} // namespace
+
+struct ReplayBackend::State {
+  State(const std::string &path, ReplayOptions options)
+      : trace(path), options(options) {}
+
+  const ApduTrace trace;
+  const ReplayOptions options;
+
+  mutable std::mutex mutex;
+  std::vector<ReplayDivergence> divergences;
+
+  void diverged(ReplayDivergence divergence) {
+    std::lock_guard<std::mutex> lock(mutex);
+    divergences.push_back(std::move(divergence));
+  }
+};
+
+/** Plays one session back. */
+class ReplayBackend::Link : public CardLink {
+public:
+  Link(std::shared_ptr<State> state, const TraceSession &session)
+      : m_state(std::move(state)), m_session(session) {}
+
+  ~Link() override {
+    for (size_t i = m_next; i < m_session.events.size(); i++)
+      skipped(i);
+  }
+
+  size_t transmit(std::span<const BYTE> command,
+                  std::span<BYTE> response) override {
+    auto start = std::chrono::steady_clock::now();
+    std::optional<size_t> index = match(TraceRecord::Exchange, command, 0);
+    if (!index) {
+      std::copy(std::begin(SW_NO_DIAGNOSIS), std::end(SW_NO_DIAGNOSIS),
+                response.begin());
+      return sizeof(SW_NO_DIAGNOSIS);
+    }
+
+    const TraceEvent &event = m_session.events[*index];
+    pace(start, event);
+    if (event.response.empty())
+      throw TransportError(TransportFault::Failed,
+                           "Transmit failed. Error: recorded");
+    if (event.response.size() > response.size())
+      throwPcscError("Transmit failed", SCARD_E_INSUFFICIENT_BUFFER);
+    std::copy(event.response.begin(), event.response.end(),
+              response.begin());
+    return event.response.size();
+  }
+
+  LONG reconnect(DWORD initialization, DWORD &activeProtocol) override {
+    auto start = std::chrono::steady_clock::now();
+    std::optional<size_t> index =
+        match(TraceRecord::Reconnect, {}, initialization);
+    if (!index) {
+      activeProtocol = m_session.protocol;
+      return SCARD_S_SUCCESS;
+    }
+
+    const TraceEvent &event = m_session.events[*index];
+    pace(start, event);
+    if (event.status == SCARD_S_SUCCESS)
+      activeProtocol = event.protocol;
+    return event.status;
+  }
+
+  size_t readAtr(std::span<BYTE> atr) override {
+    size_t length = std::min(atr.size(), m_session.atr.size());
+    std::copy_n(m_session.atr.begin(), length, atr.begin());
+    return length;
+  }
+
+private:
+  bool matches(const TraceEvent &event, TraceRecord kind,
+               std::span<const BYTE> command, DWORD initialization) const {
+    if (event.kind != kind)
+      return false;
+    if (kind == TraceRecord::Reconnect)
+      return event.initialization == initialization;
+    return std::equal(event.command.begin(), event.command.end(),
+                      command.begin(), command.end());
+  }
+
+  // The recorded event answering this call, if any.
+  std::optional<size_t> match(TraceRecord kind, std::span<const BYTE> command,
+                              DWORD initialization) {
+    const std::vector<TraceEvent> &events = m_session.events;
+    if (m_next < events.size() &&
+        matches(events[m_next], kind, command, initialization))
+      return m_next++;
+
+    if (!m_state->options.lenient) {
+      std::string sent = kind == TraceRecord::Exchange ? toHex(command)
+                                                       : "reconnect";
+      std::string recorded = m_next < events.size()
+                                 ? describe(events[m_next])
+                                 : "end of session";
+      throw std::runtime_error(
+          "Replay diverged at event " + std::to_string(m_next) +
+          " of session " + std::to_string(m_session.id) + ": sent " + sent +
+          ", recorded " + recorded);
+    }
+
+    for (size_t i = m_next + 1; i < events.size(); i++) {
+      if (!matches(events[i], kind, command, initialization))
+        continue;
+      for (; m_next < i; m_next++)
+        skipped(m_next);
+      return m_next++;
+    }
+
+    ReplayDivergence divergence;
+    divergence.kind = ReplayDivergence::Kind::Unexpected;
+    divergence.session = m_session.id;
+    divergence.event = m_next;
+    divergence.command.assign(command.begin(), command.end());
+    m_state->diverged(std::move(divergence));
+    return std::nullopt;
+  }
+
+  void skipped(size_t index) {
+    const TraceEvent &event = m_session.events[index];
+    ReplayDivergence divergence;
+    divergence.kind = ReplayDivergence::Kind::Skipped;
+    divergence.session = m_session.id;
+    divergence.event = index;
+    divergence.command.assign(event.command.begin(), event.command.end());
+    m_state->diverged(std::move(divergence));
+  }
+
+  // Answers no sooner than the card did, scaled by the replay speed.
+  void pace(std::chrono::steady_clock::time_point start,
+            const TraceEvent &event) const {
+    double speed = m_state->options.speed;
+    if (speed <= 0)
+      return;
+    std::chrono::duration<double, std::micro> cardTime(event.durationUs /
+                                                       speed);
+    std::this_thread::sleep_until(
+        start + std::chrono::duration_cast<std::chrono::microseconds>(
+                    cardTime));
+  }
+
+  std::shared_ptr<State> m_state;
+  const TraceSession &m_session;
+  size_t m_next = 0;
+};
+
+ReplayBackend::ReplayBackend(const std::string &tracePath,
+                             ReplayOptions options)
+    : m_state(std::make_shared<State>(tracePath, options)),
+      m_served(m_state->trace.sessions().size()) {}
+
+ReplayBackend::~ReplayBackend() = default;
+
+std::vector<std::string> ReplayBackend::listReaders() {
+  std::vector<std::string> readers;
+  for (const TraceSession &session : m_state->trace.sessions()) {
+    std::string reader(session.reader);
+    if (std::find(readers.begin(), readers.end(), reader) == readers.end())
+      readers.push_back(std::move(reader));
+  }
+  return readers;
+}
+
+CardConnection ReplayBackend::connect(const std::string &reader) {
+  const std::vector<TraceSession> &sessions = m_state->trace.sessions();
+  std::optional<size_t> next;
+  for (size_t i = 0; i < sessions.size(); i++) {
+    if (m_served[i])
+      continue;
+    if (sessions[i].reader == reader) {
+      next = i;
+      break;
+    }
+    if (!next)
+      next = i;
+  }
+  if (!next)
+    throw std::runtime_error("No recorded session left for " + reader);
+
+  m_served[*next] = true;
+  CardConnection connection;
+  connection.reader = reader;
+  connection.link = std::make_unique<Link>(m_state, sessions[*next]);
+  connection.activeProtocol = sessions[*next].protocol;
+  return connection;
+}
+
+std::optional<std::string> ReplayBackend::waitForCard(DWORD) {
+  const std::vector<TraceSession> &sessions = m_state->trace.sessions();
+  for (size_t i = 0; i < sessions.size(); i++) {
+    if (!m_served[i])
+      return std::string(sessions[i].reader);
+  }
+  return std::nullopt;
+}
+
+std::vector<ReplayDivergence> ReplayBackend::divergences() const {
+  std::lock_guard<std::mutex> lock(m_state->mutex);
+  return m_state->divergences;
+}
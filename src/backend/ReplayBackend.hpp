@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CardBackend.hpp"
+#include "transport/Pcsc.hpp"
+
+/** How ReplayBackend plays a trace back. */
+struct ReplayOptions {
+  // Recorded card time is divided by this: 1 keeps the original timing, 10
+  // answers ten times faster, 0 answers at once.
+  double speed = 1.0;
+  // On a divergence, skip ahead to the next recorded command that matches
+  // (answering 6F00 if there is none) instead of throwing.
+  bool lenient = false;
+};
+
+/** A place where the commands sent differ from the recorded ones. */
+struct ReplayDivergence {
+  enum class Kind {
+    Unexpected, // sent, but not recorded at this point
+    Skipped,    // recorded, but never sent
+  };
+  Kind kind = Kind::Unexpected;
+  uint64_t session = 0;
+  size_t event = 0;          // index in the session's events
+  std::vector<BYTE> command; // empty for a reconnect
+};
+
+/**
+ * Serves the sessions of an APDU trace, so that a run recorded against a
+ * real card can be repeated without it: the same answers, after the same
+ * card time unless sped up.
+ *
+ * Each connection plays the next session not served yet, preferably one
+ * recorded on the same reader, and checks that the commands sent match
+ * the recorded ones.
+ */
+class ReplayBackend : public CardBackend {
+public:
+  /** @throws std::runtime_error if the trace cannot be read. */
+  explicit ReplayBackend(const std::string &tracePath,
+                         ReplayOptions options = {});
+  ~ReplayBackend() override;
+
+  const char *name() const override { return "replay"; }
+  /** The readers of the recorded sessions. */
+  std::vector<std::string> listReaders() override;
+  /** @throws std::runtime_error once every session has been served. */
+  CardConnection connect(const std::string &reader) override;
+  std::optional<std::string> waitForCard(DWORD timeoutMs) override;
+
+  /**
+   * Divergences found so far. Those of a lenient replay and, once its
+   * connection is closed, the commands a session never got to.
+   */
+  std::vector<ReplayDivergence> divergences() const;
+
+private:
+  struct State; // shared with the links
+  class Link;
+
+  std::shared_ptr<State> m_state;
+  std::vector<bool> m_served;
+};
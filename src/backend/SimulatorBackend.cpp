@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "SimulatorBackend.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+const char READER_PREFIX[] = "Virtual Card ";
+
+} // namespace
+
+SimulatorBackend::SimulatorBackend(CardImage image, VirtualCardOptions options,
+                                   size_t readerCount)
+    : m_image(std::move(image)), m_options(options),
+      m_readerCount(readerCount) {}
+
+std::vector<std::string> SimulatorBackend::listReaders() {
+  std::vector<std::string> readers;
+  for (size_t i = 0; i < m_readerCount; i++)
+    readers.push_back(READER_PREFIX + std::to_string(i));
+  return readers;
+}
+
+CardConnection SimulatorBackend::connect(const std::string &reader) {
+  std::vector<std::string> readers = listReaders();
+  if (std::find(readers.begin(), readers.end(), reader) == readers.end())
+    throw std::runtime_error("Unknown reader: " + reader);
+
+  CardConnection connection;
+  connection.reader = reader;
+  connection.link = std::make_unique<VirtualCard>(m_image, m_options);
+  connection.activeProtocol = m_options.protocol;
+  return connection;
+}
+
+std::optional<std::string> SimulatorBackend::waitForCard(DWORD) {
+  // Every virtual reader always holds a card.
+  return READER_PREFIX + std::string("0");
+}
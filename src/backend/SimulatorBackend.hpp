@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#include "CardBackend.hpp"
+#include "simulator/CardImage.hpp"
+#include "simulator/VirtualCard.hpp"
+
+/**
+ * Readers each holding a VirtualCard. Commands are served in-process, with
+ * no IPC to a resource manager, so benchmarks measure only our own code
+ * plus the configured latency.
+ *
+ * Every connection gets a freshly reset card.
+ */
+class SimulatorBackend : public CardBackend {
+public:
+  explicit SimulatorBackend(CardImage image, VirtualCardOptions options = {},
+                            size_t readerCount = 1);
+
+  const char *name() const override { return "simulator"; }
+  std::vector<std::string> listReaders() override;
+  CardConnection connect(const std::string &reader) override;
+  std::optional<std::string> waitForCard(DWORD timeoutMs) override;
+
+private:
+  CardImage m_image;
+  VirtualCardOptions m_options;
+  size_t m_readerCount;
+};
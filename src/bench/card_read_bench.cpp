@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <ctime>
+#endif
+
+#include "backend/SimulatorBackend.hpp"
+#include "simulator/CardImage.hpp"
+#include "simulator/VirtualCard.hpp"
+#include "snapshot/CardSnapshot.hpp"
+#include "transport/ApduMetrics.hpp"
+
+/**
+ * Runs each reader flow against a virtual card and reports, per flow, the
+ * APDUs exchanged, the bytes moved, and the wall and CPU time of one run
+ * (the median over the iterations).
+ *
+ * Usage: card_read_bench [--latency <us>] [--byte-latency <us>] [--t0]
+ *                        [--extended] [--iterations <n>] [--flow <name>]
+ *                        [--baseline <file>] [--cpu-tolerance <percent>]
+ *                        [--write-baseline <file>]
+ *
+ * With --baseline, exits with a failure if a flow needs more APDUs or
+ * bytes than the baseline records, or, with --cpu-tolerance, more CPU time
+ * than that much over it. --extended runs against cards whose ATR
+ * announces extended length; by default the ATRs are silent and the card
+ * rejects the one extended READ BINARY that each session probes with.
+ */
+
+struct Flow {
+  const char *name;
+  ChipProfile profile;
+  uint32_t objects;
+};
+
+// The src/read flows, as the snapshot reader runs them
+const Flow FLOWS[] = {
+    {"csn_crn", ChipProfile::Mav4, CARD_OBJECT_CSN_CRN},
+    {"sod1", ChipProfile::Mav4, CARD_OBJECT_SOD1},
+    {"dates", ChipProfile::Mav4, CARD_OBJECT_DATES},
+    {"afis", ChipProfile::Mav4, CARD_OBJECT_AFIS},
+    {"personal_info", ChipProfile::Mav4, CARD_OBJECT_PERSONAL_INFO},
+    {"auth_certificate", ChipProfile::Mav4, CARD_OBJECT_AUTH_CERTIFICATE},
+    {"sign_certificate", ChipProfile::Mav4, CARD_OBJECT_SIGN_CERTIFICATE},
+    {"meta_feid", ChipProfile::Omid, CARD_OBJECT_META_FEID},
+};
+
+struct FlowResult {
+  uint64_t apdus = 0; // exchanges on the wire, GET RESPONSE included
+  uint64_t bytesSent = 0;
+  uint64_t bytesReceived = 0;
+  uint64_t wallUs = 0;
+  uint64_t cpuUs = 0;
+};
+
+/** CPU time of the calling thread, in microseconds. */
+uint64_t threadCpuUs() {
+#ifdef _WIN32
+  FILETIME creation, exit, kernel, user;
+  GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+  uint64_t total =
+      ((uint64_t)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime) +
+      ((uint64_t)user.dwHighDateTime << 32 | user.dwLowDateTime);
+  return total / 10; // 100 ns units
+#else
+  timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+#endif
+}
+
+uint64_t median(std::vector<uint64_t> values) {
+  std::sort(values.begin(), values.end());
+  return values[values.size() / 2];
+}
+
+/** Runs `flow` `iterations` times, each on a freshly connected card. */
+FlowResult runFlow(const Flow &flow, const VirtualCardOptions &options,
+                   int iterations) {
+  SimulatorBackend backend(options.extendedLength
+                               ? extendedLengthCardImage(flow.profile)
+                               : sampleCardImage(flow.profile),
+                           options);
+  FlowResult result;
+  std::vector<uint64_t> wall, cpu;
+
+  for (int i = 0; i < iterations; i++) {
+    ApduMetrics metrics;
+    auto wallStart = std::chrono::steady_clock::now();
+    uint64_t cpuStart = threadCpuUs();
+    CardSnapshot snapshot = readCardSnapshot(backend, flow.objects, nullptr,
+                                             flow.profile, &metrics);
+    cpu.push_back(threadCpuUs() - cpuStart);
+    wall.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now() - wallStart)
+                       .count());
+
+    if (!snapshot.complete()) {
+      std::cerr << flow.name << ": "
+                << (snapshot.errors.empty() ? "not read"
+                                            : snapshot.errors.front())
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    // Every run of a flow sends the same APDUs.
+    result.apdus = metrics.link().count();
+    result.bytesSent = result.bytesReceived = 0;
+    for (const auto &entry : metrics.entries()) {
+      result.bytesSent += entry.bytesSent;
+      result.bytesReceived += entry.bytesReceived;
+    }
+  }
+  result.wallUs = median(wall);
+  result.cpuUs = median(cpu);
+  return result;
+}
+
+/**
+ * Baseline lines: "<flow> <apdus> <bytes sent> <bytes received> <cpu us>",
+ * '#' starts a comment.
+ */
+std::map<std::string, FlowResult> loadBaseline(const std::string &path) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "Cannot read baseline " << path << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  std::map<std::string, FlowResult> baseline;
+  std::string line;
+  while (std::getline(in, line)) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream fields(line);
+    std::string name;
+    FlowResult result;
+    if (fields >> name >> result.apdus >> result.bytesSent >>
+        result.bytesReceived >> result.cpuUs)
+      baseline[name] = result;
+  }
+  return baseline;
+}
+
+void writeBaseline(const std::string &path,
+                   const std::vector<std::pair<const Flow *, FlowResult>> &results) {
+  std::ofstream out(path);
+  out << "# flow apdus bytes_sent bytes_received cpu_us" << std::endl;
+  for (const auto &[flow, result] : results)
+    out << flow->name << ' ' << result.apdus << ' ' << result.bytesSent << ' '
+        << result.bytesReceived << ' ' << result.cpuUs << std::endl;
+}
+
+/** Prints every regression of `result` against `base`; true if any. */
+bool compare(const char *name, const FlowResult &result,
+             const FlowResult &base, double cpuTolerance) {
+  bool regressed = false;
+  auto check = [&](const char *what, uint64_t value, uint64_t limit,
+                   uint64_t recorded) {
+    if (value > limit) {
+      std::cout << "REGRESSION " << name << ": " << what << ' ' << value
+                << " > " << recorded << std::endl;
+      regressed = true;
+    } else if (value < recorded) {
+      std::cout << "improved " << name << ": " << what << ' ' << value
+                << " < " << recorded << std::endl;
+    }
+  };
+  check("apdus", result.apdus, base.apdus, base.apdus);
+  check("bytes sent", result.bytesSent, base.bytesSent, base.bytesSent);
+  check("bytes received", result.bytesReceived, base.bytesReceived,
+        base.bytesReceived);
+  if (cpuTolerance >= 0) {
+    auto limit = (uint64_t)(base.cpuUs * (1 + cpuTolerance / 100));
+    if (result.cpuUs > limit) {
+      std::cout << "REGRESSION " << name << ": cpu us " << result.cpuUs
+                << " > " << base.cpuUs << " + " << cpuTolerance << "%"
+                << std::endl;
+      regressed = true;
+    }
+  }
+  return regressed;
+}
+
+int main(int argc, char *argv[]) {
+  VirtualCardOptions options;
+  int iterations = 20;
+  std::string only, baselinePath, outputPath;
+  double cpuTolerance = -1;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--latency" && hasValue) {
+      options.commandLatency = std::chrono::microseconds(atol(argv[++i]));
+    } else if (arg == "--byte-latency" && hasValue) {
+      options.byteLatency = std::chrono::microseconds(atol(argv[++i]));
+    } else if (arg == "--t0") {
+      options.protocol = SCARD_PROTOCOL_T0;
+    } else if (arg == "--extended") {
+      options.extendedLength = true;
+    } else if (arg == "--iterations" && hasValue) {
+      iterations = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--flow" && hasValue) {
+      only = argv[++i];
+    } else if (arg == "--baseline" && hasValue) {
+      baselinePath = argv[++i];
+    } else if (arg == "--cpu-tolerance" && hasValue) {
+      cpuTolerance = atof(argv[++i]);
+    } else if (arg == "--write-baseline" && hasValue) {
+      outputPath = argv[++i];
+    } else {
+      std::cerr << "Unknown option: " << arg << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::vector<std::pair<const Flow *, FlowResult>> results;
+  std::cout << std::left << std::setw(18) << "flow" << std::right
+            << std::setw(7) << "apdus" << std::setw(10) << "sent"
+            << std::setw(10) << "received" << std::setw(12) << "wall us"
+            << std::setw(10) << "cpu us" << std::endl;
+  for (const Flow &flow : FLOWS) {
+    if (!only.empty() && only != flow.name)
+      continue;
+    FlowResult result = runFlow(flow, options, iterations);
+    std::cout << std::left << std::setw(18) << flow.name << std::right
+              << std::setw(7) << result.apdus << std::setw(10)
+              << result.bytesSent << std::setw(10) << result.bytesReceived
+              << std::setw(12) << result.wallUs << std::setw(10)
+              << result.cpuUs << std::endl;
+    results.emplace_back(&flow, result);
+  }
+  if (results.empty()) {
+    std::cerr << "Unknown flow: " << only << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (!outputPath.empty())
+    writeBaseline(outputPath, results);
+
+  bool regressed = false;
+  if (!baselinePath.empty()) {
+    std::map<std::string, FlowResult> baseline = loadBaseline(baselinePath);
+    for (const auto &[flow, result] : results) {
+      auto found = baseline.find(flow->name);
+      if (found == baseline.end()) {
+        std::cout << "no baseline for " << flow->name << std::endl;
+        continue;
+      }
+      regressed |= compare(flow->name, result, found->second, cpuTolerance);
+    }
+  }
+  return regressed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "BrokerClient.hpp"
+
+#include <stdexcept>
+
+#include "broker/SharedSegment.hpp"
+
+BrokerClient::BrokerClient(const std::string &socketPath)
+    : m_socket(LocalSocket::connect(socketPath)) {}
+
+std::vector<BYTE> BrokerClient::call(const std::vector<BYTE> &request) {
+  m_socket.sendFrame(request);
+  std::vector<BYTE> response;
+  if (!m_socket.receiveFrame(response) || response.empty())
+    throw std::runtime_error("Card broker closed the connection");
+  if (response[0] != 0) {
+    MessageReader reader(std::span<const BYTE>(response).subspan(1));
+    throw std::runtime_error(reader.string());
+  }
+  response.erase(response.begin());
+  return response;
+}
+
+std::vector<std::string> BrokerClient::listReaders() {
+  MessageWriter request;
+  request.u8(static_cast<uint8_t>(BrokerRequest::ListReaders));
+  std::vector<BYTE> body = call(request.message());
+
+  MessageReader reader(body);
+  std::vector<std::string> readers(reader.u16());
+  for (std::string &name : readers)
+    name = reader.string();
+  return readers;
+}
+
+CardSnapshot BrokerClient::readSnapshot(const std::string &reader,
+                                        uint32_t objects,
+                                        ChipProfile profile) {
+  MessageWriter request;
+  request.u8(static_cast<uint8_t>(BrokerRequest::Snapshot));
+  request.u8(static_cast<uint8_t>(profile));
+  request.u32(objects);
+  request.string(reader);
+  std::vector<BYTE> body = call(request.message());
+
+  MessageReader response(body);
+  auto delivery = static_cast<BrokerDelivery>(response.u8());
+  if (delivery == BrokerDelivery::Inline) {
+    std::vector<BYTE> bytes = response.bytes();
+    MessageReader snapshot(bytes);
+    return decodeSnapshot(snapshot);
+  }
+
+  std::string name = response.string();
+  uint32_t size = response.u32();
+  CardSnapshot snapshot;
+  {
+    SharedSegment segment = SharedSegment::open(name, size);
+    MessageReader shared(segment.bytes());
+    snapshot = decodeSnapshot(shared);
+  }
+  // The broker holds the segment until told it has been copied.
+  MessageWriter release;
+  release.u8(static_cast<uint8_t>(BrokerRequest::Release));
+  m_socket.sendFrame(release.message());
+  return snapshot;
+}
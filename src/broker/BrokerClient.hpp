@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "broker/BrokerProtocol.hpp"
+#include "broker/LocalSocket.hpp"
+#include "snapshot/CardSnapshot.hpp"
+
+/**
+ * Reads cards through a running card broker instead of connecting to the
+ * readers directly. Calls on one client must not overlap; use one client
+ * per thread.
+ */
+class BrokerClient {
+public:
+  /** @throws std::runtime_error if no broker listens on `socketPath`. */
+  explicit BrokerClient(const std::string &socketPath = defaultBrokerSocket());
+
+  /** The readers the broker owns. */
+  std::vector<std::string> listReaders();
+
+  /**
+   * Same as readCardSnapshot() on the card in `reader`, the broker's first
+   * reader when empty.
+   *
+   * @throws std::runtime_error with the broker's message if the card cannot
+   *         be reached.
+   */
+  CardSnapshot readSnapshot(const std::string &reader = std::string(),
+                            uint32_t objects = CARD_OBJECT_ALL,
+                            ChipProfile profile = ChipProfile::Mav4);
+
+private:
+  // Sends `request` and returns the response body past its status.
+  std::vector<BYTE> call(const std::vector<BYTE> &request);
+
+  LocalSocket m_socket;
+};
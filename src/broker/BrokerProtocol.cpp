@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "BrokerProtocol.hpp"
+
+#include <array>
+#include <cstdlib>
+#include <filesystem>
+#include <stdexcept>
+
+namespace {
+
+// The buffers of a snapshot, in wire order.
+template <typename Snapshot> auto snapshotBuffers(Snapshot &snapshot) {
+  return std::array{&snapshot.atr,     &snapshot.cplc,
+                    &snapshot.csn,     &snapshot.crn,
+                    &snapshot.version, &snapshot.dates,
+                    &snapshot.afis,    &snapshot.sod1,
+                    &snapshot.personalInfo, &snapshot.metaFeid,
+                    &snapshot.authCertificate, &snapshot.signCertificate};
+}
+
+} // namespace
+
+std::string defaultBrokerSocket() {
+  if (const char *path = std::getenv("CARD_BROKER_SOCKET"); path && *path)
+    return path;
+  std::error_code error;
+  std::filesystem::path directory = std::filesystem::temp_directory_path(error);
+  if (error)
+    directory = ".";
+  return (directory / "inido-card-broker.sock").string();
+}
+
+void MessageWriter::u16(uint16_t value) {
+  m_bytes.push_back(static_cast<BYTE>(value));
+  m_bytes.push_back(static_cast<BYTE>(value >> 8));
+}
+
+void MessageWriter::u32(uint32_t value) {
+  for (int shift = 0; shift < 32; shift += 8)
+    m_bytes.push_back(static_cast<BYTE>(value >> shift));
+}
+
+void MessageWriter::string(const std::string &value) {
+  if (value.size() > UINT16_MAX)
+    throw std::invalid_argument("String too long for a broker message");
+  u16(static_cast<uint16_t>(value.size()));
+  m_bytes.insert(m_bytes.end(), value.begin(), value.end());
+}
+
+void MessageWriter::bytes(std::span<const BYTE> value) {
+  u32(static_cast<uint32_t>(value.size()));
+  m_bytes.insert(m_bytes.end(), value.begin(), value.end());
+}
+
+std::span<const BYTE> MessageReader::take(size_t size) {
+  if (m_rest.size() < size)
+    throw std::runtime_error("Truncated broker message");
+  std::span<const BYTE> field = m_rest.first(size);
+  m_rest = m_rest.subspan(size);
+  return field;
+}
+
+uint8_t MessageReader::u8() { return take(1)[0]; }
+
+uint16_t MessageReader::u16() {
+  std::span<const BYTE> field = take(2);
+  return static_cast<uint16_t>(field[0] | field[1] << 8);
+}
+
+uint32_t MessageReader::u32() {
+  std::span<const BYTE> field = take(4);
+  return static_cast<uint32_t>(field[0]) |
+         static_cast<uint32_t>(field[1]) << 8 |
+         static_cast<uint32_t>(field[2]) << 16 |
+         static_cast<uint32_t>(field[3]) << 24;
+}
+
+std::string MessageReader::string() {
+  std::span<const BYTE> field = take(u16());
+  return std::string(field.begin(), field.end());
+}
+
+std::vector<BYTE> MessageReader::bytes() {
+  std::span<const BYTE> field = take(u32());
+  return std::vector<BYTE>(field.begin(), field.end());
+}
+
+void encodeSnapshot(MessageWriter &writer, const CardSnapshot &snapshot) {
+  writer.u32(snapshot.requested);
+  writer.u32(snapshot.read);
+  for (const std::vector<BYTE> *buffer : snapshotBuffers(snapshot))
+    writer.bytes(*buffer);
+  writer.u16(static_cast<uint16_t>(snapshot.errors.size()));
+  for (const std::string &error : snapshot.errors)
+    writer.string(error);
+}
+
+CardSnapshot decodeSnapshot(MessageReader &reader) {
+  CardSnapshot snapshot;
+  snapshot.requested = reader.u32();
+  snapshot.read = reader.u32();
+  for (std::vector<BYTE> *buffer : snapshotBuffers(snapshot))
+    *buffer = reader.bytes();
+  snapshot.errors.resize(reader.u16());
+  for (std::string &error : snapshot.errors)
+    error = reader.string();
+  return snapshot;
+}
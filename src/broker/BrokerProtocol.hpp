@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "snapshot/CardSnapshot.hpp"
+#include "transport/Pcsc.hpp"
+
+/**
+ * Messages between the card broker and its clients. Each is one LocalSocket
+ * frame; integers are little-endian, strings and byte strings carry a
+ * length prefix (u16 for strings, u32 for bytes).
+ *
+ *   request  := u8 type, body
+ *     ListReaders: (empty)
+ *     Snapshot:    u8 profile, u32 objects, string reader ("" = first)
+ *     Release:     (empty), sent after a Shared snapshot has been copied
+ *   response := u8 status (0 ok, 1 error), body
+ *     error:       string message
+ *     ListReaders: u16 count, count × string
+ *     Snapshot:    u8 delivery, then
+ *                  Inline: bytes snapshot
+ *                  Shared: string segment, u32 size
+ *
+ * A snapshot body is u32 requested, u32 read, the twelve buffers of
+ * CardSnapshot in declaration order as bytes, u16 count, count × string.
+ */
+enum class BrokerRequest : uint8_t {
+  ListReaders = 1,
+  Snapshot = 2,
+  Release = 3,
+};
+
+enum class BrokerDelivery : uint8_t { Inline = 0, Shared = 1 };
+
+// Snapshots larger than this go through a SharedSegment.
+inline constexpr size_t BROKER_INLINE_LIMIT = 4096;
+
+/** $CARD_BROKER_SOCKET, or a fixed path in the temporary directory. */
+std::string defaultBrokerSocket();
+
+/** Appends little-endian fields to a message. */
+class MessageWriter {
+public:
+  void u8(uint8_t value) { m_bytes.push_back(value); }
+  void u16(uint16_t value);
+  void u32(uint32_t value);
+  void string(const std::string &value);
+  void bytes(std::span<const BYTE> value);
+
+  std::vector<BYTE> &message() { return m_bytes; }
+
+private:
+  std::vector<BYTE> m_bytes;
+};
+
+/**
+ * Reads the fields of a message in order.
+ *
+ * Every accessor throws std::runtime_error when the message ends early.
+ */
+class MessageReader {
+public:
+  explicit MessageReader(std::span<const BYTE> message) : m_rest(message) {}
+
+  uint8_t u8();
+  uint16_t u16();
+  uint32_t u32();
+  std::string string();
+  std::vector<BYTE> bytes();
+
+  bool atEnd() const { return m_rest.empty(); }
+
+private:
+  std::span<const BYTE> take(size_t size);
+
+  std::span<const BYTE> m_rest;
+};
+
+void encodeSnapshot(MessageWriter &writer, const CardSnapshot &snapshot);
+CardSnapshot decodeSnapshot(MessageReader &reader);
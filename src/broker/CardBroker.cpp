@@ -0,0 +1,308 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "CardBroker.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "broker/BrokerProtocol.hpp"
+#include "broker/SharedSegment.hpp"
+
+namespace {
+
+/**
+ * Copies the part of a shared read that one client asked for, as if it had
+ * been read for that client alone.
+ */
+CardSnapshot restrictSnapshot(const CardSnapshot &full, uint32_t objects) {
+  CardSnapshot snapshot;
+  snapshot.requested = objects;
+  snapshot.read = full.read & objects;
+  snapshot.atr = full.atr;
+
+  auto copy = [&](CardObject object, std::vector<BYTE> CardSnapshot::*buffer) {
+    if (objects & object)
+      snapshot.*buffer = full.*buffer;
+  };
+  copy(CARD_OBJECT_CSN_CRN, &CardSnapshot::cplc);
+  copy(CARD_OBJECT_CSN_CRN, &CardSnapshot::csn);
+  copy(CARD_OBJECT_CSN_CRN, &CardSnapshot::crn);
+  copy(CARD_OBJECT_VERSION, &CardSnapshot::version);
+  copy(CARD_OBJECT_DATES, &CardSnapshot::dates);
+  copy(CARD_OBJECT_AFIS, &CardSnapshot::afis);
+  copy(CARD_OBJECT_SOD1, &CardSnapshot::sod1);
+  copy(CARD_OBJECT_PERSONAL_INFO, &CardSnapshot::personalInfo);
+  copy(CARD_OBJECT_META_FEID, &CardSnapshot::metaFeid);
+  copy(CARD_OBJECT_AUTH_CERTIFICATE, &CardSnapshot::authCertificate);
+  copy(CARD_OBJECT_SIGN_CERTIFICATE, &CardSnapshot::signCertificate);
+
+  // Errors start with the name of their object.
+  for (const std::string &error : full.errors) {
+    for (uint32_t bit = 1; bit & CARD_OBJECT_ALL; bit <<= 1) {
+      std::string name = cardObjectName(static_cast<CardObject>(bit));
+      if ((objects & bit) && error.compare(0, name.size() + 1,
+                                           name + ":") == 0) {
+        snapshot.errors.push_back(error);
+        break;
+      }
+    }
+  }
+  return snapshot;
+}
+
+void sendError(LocalSocket &socket, const std::string &message) {
+  MessageWriter writer;
+  writer.u8(1);
+  writer.string(message);
+  socket.sendFrame(writer.message());
+}
+
+} // namespace
+
+CardBroker::CardBroker(ReaderScheduler::BackendFactory makeBackend,
+                       ResetPolicy resetPolicy)
+    : m_resetPolicy(resetPolicy) {
+  std::vector<std::string> readers = makeBackend()->listReaders();
+  if (readers.empty())
+    throw std::runtime_error("No readers found.");
+
+  m_jobs.resize(readers.size());
+  m_scheduler = std::make_unique<ReaderScheduler>(
+      std::move(readers),
+      [this](const std::string &reader, const char *what) {
+        failFront(reader, what);
+      },
+      std::move(makeBackend));
+}
+
+CardBroker::~CardBroker() {
+  stop();
+  reapClients(true);
+  m_scheduler.reset(); // finishes queued reads while m_jobs still exists
+}
+
+std::vector<std::string> CardBroker::readers() const {
+  std::vector<std::string> names;
+  for (size_t i = 0; i < m_scheduler->readerCount(); i++)
+    names.push_back(m_scheduler->readerName(i));
+  return names;
+}
+
+CardSnapshot CardBroker::read(const std::string &reader, uint32_t objects,
+                              ChipProfile profile) {
+  size_t index = 0;
+  if (!reader.empty()) {
+    while (index < m_scheduler->readerCount() &&
+           m_scheduler->readerName(index) != reader)
+      index++;
+    if (index == m_scheduler->readerCount())
+      throw std::invalid_argument("Unknown reader: " + reader);
+  }
+
+  objects &= CARD_OBJECT_ALL;
+  return restrictSnapshot(enqueue(index, objects, profile).get(), objects);
+}
+
+std::shared_future<CardSnapshot>
+CardBroker::enqueue(size_t reader, uint32_t objects, ChipProfile profile) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::deque<std::shared_ptr<Job>> &jobs = m_jobs[reader];
+
+  // A queued job can still take more objects; a running one only serves
+  // requests it already covers.
+  for (auto it = jobs.rbegin(); it != jobs.rend(); ++it) {
+    Job &job = **it;
+    if (job.profile != profile)
+      continue;
+    if (!job.started) {
+      job.objects |= objects;
+      return job.result;
+    }
+    if ((job.objects & objects) == objects)
+      return job.result;
+  }
+
+  auto job = std::make_shared<Job>();
+  job->profile = profile;
+  job->objects = objects;
+  jobs.push_back(job);
+  m_scheduler->submitSession(
+      reader, [this, reader](CardTransport &transport) {
+        runJob(reader, transport);
+      });
+  return job->result;
+}
+
+void CardBroker::runJob(size_t reader, CardTransport &transport) {
+  std::shared_ptr<Job> job;
+  uint32_t objects;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    job = m_jobs[reader].front();
+    job->started = true;
+    objects = job->objects;
+  }
+
+  try {
+    CardSnapshot snapshot = readCardSnapshot(
+        transport, objects, job->profile, RetryPolicy(), m_resetPolicy);
+    job->promise.set_value(std::move(snapshot));
+  } catch (...) {
+    job->promise.set_exception(std::current_exception());
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_jobs[reader].pop_front();
+}
+
+void CardBroker::failFront(const std::string &readerName, const char *what) {
+  // Sessions run in order, so a session that failed before runJob() took
+  // over (no backend, no connection) belongs to the front job.
+  std::shared_ptr<Job> job;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t i = 0; i < m_scheduler->readerCount(); i++) {
+      if (m_scheduler->readerName(i) == readerName && !m_jobs[i].empty() &&
+          !m_jobs[i].front()->started) {
+        job = m_jobs[i].front();
+        m_jobs[i].pop_front();
+        break;
+      }
+    }
+  }
+  if (job)
+    job->promise.set_exception(
+        std::make_exception_ptr(std::runtime_error(what)));
+}
+
+void CardBroker::serve(LocalSocket &listener) {
+  {
+    std::lock_guard<std::mutex> lock(m_clientsMutex);
+    if (m_stopping)
+      return;
+    m_listener = &listener;
+  }
+
+  for (;;) {
+    LocalSocket socket = listener.accept();
+    std::lock_guard<std::mutex> lock(m_clientsMutex);
+    if (!socket.valid() || m_stopping)
+      break;
+
+    reapClients(false);
+    Client &client = m_clients.emplace_back();
+    client.socket = std::move(socket);
+    client.thread = std::thread(&CardBroker::serveClient, this,
+                                std::ref(client));
+  }
+
+  std::lock_guard<std::mutex> lock(m_clientsMutex);
+  m_listener = nullptr;
+}
+
+void CardBroker::stop() {
+  std::lock_guard<std::mutex> lock(m_clientsMutex);
+  m_stopping = true;
+  if (m_listener)
+    m_listener->shutdown();
+  for (Client &client : m_clients)
+    client.socket.shutdown();
+}
+
+void CardBroker::reapClients(bool all) {
+  if (all) {
+    std::list<Client> clients;
+    {
+      std::lock_guard<std::mutex> lock(m_clientsMutex);
+      clients.swap(m_clients);
+    }
+    for (Client &client : clients)
+      client.thread.join();
+    return;
+  }
+
+  // Called with m_clientsMutex held
+  for (auto it = m_clients.begin(); it != m_clients.end();) {
+    if (it->done) {
+      it->thread.join();
+      it = m_clients.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void CardBroker::serveClient(Client &client) {
+  LocalSocket &socket = client.socket;
+  std::vector<BYTE> frame;
+  // A snapshot handed over in shared memory, kept until the client has
+  // copied it out
+  std::unique_ptr<SharedSegment> lent;
+
+  try {
+    while (socket.receiveFrame(frame)) {
+      lent.reset();
+      MessageReader request(frame);
+      auto type = static_cast<BrokerRequest>(request.u8());
+      if (type == BrokerRequest::Release)
+        continue;
+
+      try {
+        MessageWriter response;
+        if (type == BrokerRequest::ListReaders) {
+          std::vector<std::string> names = readers();
+          response.u8(0);
+          response.u16(static_cast<uint16_t>(names.size()));
+          for (const std::string &name : names)
+            response.string(name);
+        } else if (type == BrokerRequest::Snapshot) {
+          auto profile = static_cast<ChipProfile>(request.u8());
+          uint32_t objects = request.u32();
+          std::string reader = request.string();
+          if (profile > ChipProfile::Omid)
+            throw std::invalid_argument("Unknown chip profile");
+
+          MessageWriter body;
+          encodeSnapshot(body, read(reader, objects, profile));
+          response.u8(0);
+          if (body.message().size() <= BROKER_INLINE_LIMIT) {
+            response.u8(static_cast<uint8_t>(BrokerDelivery::Inline));
+            response.bytes(body.message());
+          } else {
+            lent = std::make_unique<SharedSegment>(
+                SharedSegment::create(body.message().size()));
+            std::copy(body.message().begin(), body.message().end(),
+                      lent->bytes().begin());
+            response.u8(static_cast<uint8_t>(BrokerDelivery::Shared));
+            response.string(lent->name());
+            response.u32(static_cast<uint32_t>(body.message().size()));
+          }
+        } else {
+          throw std::invalid_argument("Unknown broker request");
+        }
+        socket.sendFrame(response.message());
+      } catch (const std::exception &e) {
+        lent.reset();
+        sendError(socket, e.what());
+      }
+    }
+  } catch (const std::exception &) {
+    // The client went away mid-frame; nothing left to answer.
+  }
+  client.done = true;
+}
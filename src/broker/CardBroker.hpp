@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "broker/LocalSocket.hpp"
+#include "scheduler/ReaderScheduler.hpp"
+#include "snapshot/CardSnapshot.hpp"
+
+/**
+ * Owns every reader on the machine and reads cards for local clients, so
+ * that several processes can use the same reader without fighting over
+ * exclusive connections. See BrokerProtocol.hpp for the wire format and
+ * BrokerClient for the other end.
+ *
+ * Requests for a reader queue up in order. A request joins a queued read of
+ * the same profile, adding its objects to it, or a running one that already
+ * covers its objects, so two processes asking for the CSN of the same card
+ * cost one APDU sequence. Each client only gets back the objects it asked
+ * for.
+ *
+ * The readers are those attached when the broker starts.
+ */
+class CardBroker {
+public:
+  /**
+   * Starts one scheduler worker per reader `makeBackend` lists. Reads that
+   * include the MAV4 personal info reset the card as `resetPolicy` says;
+   * see resetForSnapshot().
+   *
+   * @throws std::runtime_error if there are no readers.
+   */
+  explicit CardBroker(ReaderScheduler::BackendFactory makeBackend =
+                          createDefaultBackend,
+                      ResetPolicy resetPolicy = ResetPolicy::WhenUnknown);
+  ~CardBroker();
+
+  CardBroker(const CardBroker &) = delete;
+  CardBroker &operator=(const CardBroker &) = delete;
+
+  std::vector<std::string> readers() const;
+
+  /**
+   * Reads `objects` from the card in `reader` (the first reader when empty),
+   * sharing the read with matching requests of other clients.
+   *
+   * @throws std::invalid_argument for an unknown reader.
+   * @throws std::runtime_error if the card cannot be reached.
+   */
+  CardSnapshot read(const std::string &reader, uint32_t objects,
+                    ChipProfile profile);
+
+  /** Answers clients on `listener` until stop() is called. */
+  void serve(LocalSocket &listener);
+
+  /** Makes serve() return, dropping the clients' connections. */
+  void stop();
+
+private:
+  struct Job {
+    ChipProfile profile;
+    uint32_t objects;
+    bool started = false;
+    std::promise<CardSnapshot> promise;
+    std::shared_future<CardSnapshot> result = promise.get_future().share();
+  };
+
+  struct Client {
+    LocalSocket socket;
+    std::thread thread;
+    std::atomic<bool> done{false};
+  };
+
+  std::shared_future<CardSnapshot> enqueue(size_t reader, uint32_t objects,
+                                           ChipProfile profile);
+  void runJob(size_t reader, CardTransport &transport);
+  void failFront(const std::string &readerName, const char *what);
+  void serveClient(Client &client);
+  void reapClients(bool all);
+
+  std::unique_ptr<ReaderScheduler> m_scheduler;
+  ResetPolicy m_resetPolicy;
+
+  std::mutex m_mutex;
+  std::vector<std::deque<std::shared_ptr<Job>>> m_jobs; // per reader, FIFO
+
+  std::mutex m_clientsMutex;
+  std::list<Client> m_clients;
+  LocalSocket *m_listener = nullptr;
+  bool m_stopping = false;
+};
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "LocalSocket.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#include <winsock2.h>
+
+#include <afunix.h>
+
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef _WIN32
+using SocketLength = int;
+
+void closeHandle(LocalSocket::Handle handle) {
+  closesocket(static_cast<SOCKET>(handle));
+}
+
+void removeFile(const std::string &path) { DeleteFileA(path.c_str()); }
+
+// Winsock wants WSAStartup once per process before any socket call.
+void startWinsock() {
+  static const bool started = [] {
+    WSADATA data;
+    return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+  }();
+  if (!started)
+    throw std::runtime_error("Failed to start Winsock");
+}
+#else
+using SocketLength = socklen_t;
+
+void closeHandle(LocalSocket::Handle handle) { ::close(handle); }
+
+void removeFile(const std::string &path) { unlink(path.c_str()); }
+
+void startWinsock() {}
+#endif
+
+sockaddr_un addressOf(const std::string &path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path))
+    throw std::invalid_argument("Socket path too long: " + path);
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return address;
+}
+
+LocalSocket::Handle openSocket() {
+  startWinsock();
+  auto handle =
+      static_cast<LocalSocket::Handle>(::socket(AF_UNIX, SOCK_STREAM, 0));
+  if (handle == LocalSocket::INVALID)
+    throw std::runtime_error("Failed to create socket");
+  return handle;
+}
+
+} // namespace
+
+LocalSocket::~LocalSocket() { close(); }
+
+LocalSocket::LocalSocket(LocalSocket &&other) noexcept
+    : m_handle(std::exchange(other.m_handle, INVALID)),
+      m_unlinkPath(std::move(other.m_unlinkPath)) {
+  other.m_unlinkPath.clear();
+}
+
+LocalSocket &LocalSocket::operator=(LocalSocket &&other) noexcept {
+  if (this != &other) {
+    close();
+    m_handle = std::exchange(other.m_handle, INVALID);
+    m_unlinkPath = std::move(other.m_unlinkPath);
+    other.m_unlinkPath.clear();
+  }
+  return *this;
+}
+
+void LocalSocket::close() {
+  if (m_handle != INVALID)
+    closeHandle(m_handle);
+  m_handle = INVALID;
+  if (!m_unlinkPath.empty())
+    removeFile(m_unlinkPath);
+  m_unlinkPath.clear();
+}
+
+LocalSocket LocalSocket::listen(const std::string &path) {
+  sockaddr_un address = addressOf(path);
+  LocalSocket socket(openSocket());
+
+  // A socket file outlives its process; a broker that died left one.
+  removeFile(path);
+  if (::bind(socket.m_handle, reinterpret_cast<sockaddr *>(&address),
+             sizeof(address)) != 0 ||
+      ::listen(socket.m_handle, SOMAXCONN) != 0)
+    throw std::runtime_error("Failed to listen on " + path);
+  socket.m_unlinkPath = path;
+  return socket;
+}
+
+LocalSocket LocalSocket::connect(const std::string &path) {
+  sockaddr_un address = addressOf(path);
+  LocalSocket socket(openSocket());
+  if (::connect(socket.m_handle, reinterpret_cast<sockaddr *>(&address),
+                sizeof(address)) != 0)
+    throw std::runtime_error("No card broker on " + path);
+  return socket;
+}
+
+LocalSocket LocalSocket::accept() {
+  for (;;) {
+    auto client = static_cast<Handle>(::accept(m_handle, nullptr, nullptr));
+    if (client != INVALID)
+      return LocalSocket(client);
+#ifndef _WIN32
+    if (errno == EINTR)
+      continue;
+    if (errno == EINVAL || errno == EBADF)
+      return LocalSocket(); // shut down
+#else
+    if (WSAGetLastError() == WSAEINTR)
+      return LocalSocket();
+#endif
+    throw std::runtime_error("Failed to accept a broker client");
+  }
+}
+
+void LocalSocket::shutdown() {
+  if (m_handle == INVALID)
+    return;
+#ifdef _WIN32
+  // Closing is what unblocks accept() on Winsock.
+  ::shutdown(static_cast<SOCKET>(m_handle), SD_BOTH);
+  closeHandle(std::exchange(m_handle, INVALID));
+#else
+  ::shutdown(m_handle, SHUT_RDWR);
+#endif
+}
+
+void LocalSocket::sendAll(const BYTE *data, size_t size) {
+  while (size > 0) {
+#ifdef _WIN32
+    int sent = ::send(static_cast<SOCKET>(m_handle),
+                      reinterpret_cast<const char *>(data),
+                      static_cast<int>(size), 0);
+#else
+    ssize_t sent = ::send(m_handle, data, size, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR)
+      continue;
+#endif
+    if (sent <= 0)
+      throw std::runtime_error("Broker connection lost");
+    data += sent;
+    size -= static_cast<size_t>(sent);
+  }
+}
+
+bool LocalSocket::receiveAll(BYTE *data, size_t size) {
+  while (size > 0) {
+#ifdef _WIN32
+    int received = ::recv(static_cast<SOCKET>(m_handle),
+                          reinterpret_cast<char *>(data),
+                          static_cast<int>(size), 0);
+#else
+    ssize_t received = ::recv(m_handle, data, size, 0);
+    if (received < 0 && errno == EINTR)
+      continue;
+#endif
+    if (received <= 0)
+      return false;
+    data += received;
+    size -= static_cast<size_t>(received);
+  }
+  return true;
+}
+
+void LocalSocket::sendFrame(std::span<const BYTE> frame) {
+  if (frame.size() > MAX_FRAME)
+    throw std::invalid_argument("Broker frame too large");
+  // Little-endian length, then the frame
+  uint32_t length = static_cast<uint32_t>(frame.size());
+  const BYTE header[4] = {static_cast<BYTE>(length),
+                          static_cast<BYTE>(length >> 8),
+                          static_cast<BYTE>(length >> 16),
+                          static_cast<BYTE>(length >> 24)};
+  sendAll(header, sizeof(header));
+  sendAll(frame.data(), frame.size());
+}
+
+bool LocalSocket::receiveFrame(std::vector<BYTE> &frame) {
+  BYTE header[4];
+  if (!receiveAll(header, sizeof(header)))
+    return false;
+  size_t length = header[0] | header[1] << 8 | header[2] << 16 |
+                  static_cast<size_t>(header[3]) << 24;
+  if (length > MAX_FRAME)
+    throw std::runtime_error("Broker frame too large");
+  frame.resize(length);
+  if (!receiveAll(frame.data(), length))
+    throw std::runtime_error("Broker connection lost mid-frame");
+  return true;
+}
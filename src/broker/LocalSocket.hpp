@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "transport/Pcsc.hpp"
+
+/**
+ * A Unix-domain stream socket carrying length-prefixed frames, for talking
+ * to the card broker on the same machine. Windows 10 and later have
+ * AF_UNIX too, through Winsock.
+ */
+class LocalSocket {
+public:
+#ifdef _WIN32
+  using Handle = uintptr_t; // SOCKET, without pulling in Winsock here
+  static constexpr Handle INVALID = ~Handle(0);
+#else
+  using Handle = int;
+  static constexpr Handle INVALID = -1;
+#endif
+
+  // Largest frame accepted; larger payloads go through shared memory.
+  static constexpr size_t MAX_FRAME = 1 << 20;
+
+  LocalSocket() = default;
+  ~LocalSocket();
+  LocalSocket(LocalSocket &&other) noexcept;
+  LocalSocket &operator=(LocalSocket &&other) noexcept;
+
+  LocalSocket(const LocalSocket &) = delete;
+  LocalSocket &operator=(const LocalSocket &) = delete;
+
+  /**
+   * Listens on `path`, replacing a stale socket file left there.
+   *
+   * @throws std::runtime_error if the socket cannot be bound.
+   */
+  static LocalSocket listen(const std::string &path);
+
+  /** @throws std::runtime_error if nothing listens on `path`. */
+  static LocalSocket connect(const std::string &path);
+
+  /**
+   * Waits for the next client.
+   *
+   * @return an invalid socket once shutdown() was called.
+   * @throws std::runtime_error if accepting fails otherwise.
+   */
+  LocalSocket accept();
+
+  /** @throws std::runtime_error if the peer is gone. */
+  void sendFrame(std::span<const BYTE> frame);
+
+  /**
+   * Receives the next frame into `frame`.
+   *
+   * @return false if the peer closed the connection.
+   * @throws std::runtime_error on a broken or oversized frame.
+   */
+  bool receiveFrame(std::vector<BYTE> &frame);
+
+  /** Unblocks accept() and receiveFrame() on other threads. */
+  void shutdown();
+
+  bool valid() const { return m_handle != INVALID; }
+
+private:
+  explicit LocalSocket(Handle handle) : m_handle(handle) {}
+
+  void close();
+  void sendAll(const BYTE *data, size_t size);
+  bool receiveAll(BYTE *data, size_t size);
+
+  Handle m_handle = INVALID;
+  std::string m_unlinkPath; // socket file of a listener
+};
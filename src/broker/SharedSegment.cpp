@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "SharedSegment.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <stdexcept>
+#include <utility>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+[[noreturn]] void throwSegmentFailed(const std::string &name) {
+  throw std::runtime_error("Failed to map shared segment " + name);
+}
+
+// Unique per process and call, so clients never open a stale segment.
+std::string freshName() {
+  static std::atomic<unsigned> counter{0};
+  char name[64];
+#ifdef _WIN32
+  snprintf(name, sizeof(name), "Local\\inido-broker-%lu-%u",
+           static_cast<unsigned long>(GetCurrentProcessId()), counter++);
+#else
+  snprintf(name, sizeof(name), "/inido-broker-%ld-%u",
+           static_cast<long>(getpid()), counter++);
+#endif
+  return name;
+}
+
+} // namespace
+
+SharedSegment::SharedSegment(SharedSegment &&other) noexcept
+    : m_name(std::move(other.m_name)),
+      m_data(std::exchange(other.m_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0)),
+      m_owner(std::exchange(other.m_owner, false))
+#ifdef _WIN32
+      ,
+      m_mapping(std::exchange(other.m_mapping, nullptr))
+#endif
+{
+}
+
+SharedSegment &SharedSegment::operator=(SharedSegment &&other) noexcept {
+  if (this != &other) {
+    release();
+    m_name = std::move(other.m_name);
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+    m_owner = std::exchange(other.m_owner, false);
+#ifdef _WIN32
+    m_mapping = std::exchange(other.m_mapping, nullptr);
+#endif
+  }
+  return *this;
+}
+
+SharedSegment::~SharedSegment() { release(); }
+
+#ifdef _WIN32
+
+SharedSegment SharedSegment::create(size_t size) {
+  SharedSegment segment;
+  segment.m_name = freshName();
+  segment.m_owner = true;
+  segment.m_mapping = CreateFileMappingA(
+      INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+      static_cast<DWORD>(static_cast<uint64_t>(size) >> 32),
+      static_cast<DWORD>(size), segment.m_name.c_str());
+  if (!segment.m_mapping)
+    throwSegmentFailed(segment.m_name);
+  segment.m_data = static_cast<BYTE *>(
+      MapViewOfFile(segment.m_mapping, FILE_MAP_WRITE, 0, 0, size));
+  if (!segment.m_data)
+    throwSegmentFailed(segment.m_name);
+  segment.m_size = size;
+  return segment;
+}
+
+SharedSegment SharedSegment::open(const std::string &name, size_t size) {
+  SharedSegment segment;
+  segment.m_name = name;
+  segment.m_mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+  if (!segment.m_mapping)
+    throwSegmentFailed(name);
+  segment.m_data = static_cast<BYTE *>(
+      MapViewOfFile(segment.m_mapping, FILE_MAP_READ, 0, 0, size));
+  if (!segment.m_data)
+    throwSegmentFailed(name);
+  segment.m_size = size;
+  return segment;
+}
+
+void SharedSegment::release() {
+  if (m_data)
+    UnmapViewOfFile(m_data);
+  if (m_mapping)
+    CloseHandle(m_mapping);
+  m_data = nullptr;
+  m_mapping = nullptr;
+}
+
+#else
+
+SharedSegment SharedSegment::create(size_t size) {
+  SharedSegment segment;
+  segment.m_name = freshName();
+  int fd = shm_open(segment.m_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0)
+    throwSegmentFailed(segment.m_name);
+  segment.m_owner = true;
+  if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    close(fd);
+    throwSegmentFailed(segment.m_name);
+  }
+  void *data = size ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                           fd, 0)
+                    : nullptr;
+  close(fd);
+  if (data == MAP_FAILED)
+    throwSegmentFailed(segment.m_name);
+  segment.m_data = static_cast<BYTE *>(data);
+  segment.m_size = size;
+  return segment;
+}
+
+SharedSegment SharedSegment::open(const std::string &name, size_t size) {
+  SharedSegment segment;
+  segment.m_name = name;
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    throwSegmentFailed(name);
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < size) {
+    close(fd);
+    throwSegmentFailed(name);
+  }
+  void *data = size ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0)
+                    : nullptr;
+  close(fd);
+  if (data == MAP_FAILED)
+    throwSegmentFailed(name);
+  segment.m_data = static_cast<BYTE *>(data);
+  segment.m_size = size;
+  return segment;
+}
+
+void SharedSegment::release() {
+  if (m_data)
+    munmap(m_data, m_size);
+  if (m_owner)
+    shm_unlink(m_name.c_str());
+  m_data = nullptr;
+  m_owner = false;
+}
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+#include "transport/Pcsc.hpp"
+
+/**
+ * A named block of shared memory, through which the card broker hands large
+ * results (certificates, SOD, images) to its clients without pushing them
+ * through the socket.
+ *
+ * The creator owns the name: on POSIX the segment is unlinked when the
+ * creator's object is destroyed, on Windows when the last handle closes.
+ * Either way a client must open it before the creator lets go.
+ */
+class SharedSegment {
+public:
+  /**
+   * Creates a segment of `size` bytes under a fresh name.
+   *
+   * @throws std::runtime_error if it cannot be created.
+   */
+  static SharedSegment create(size_t size);
+
+  /**
+   * Maps the segment `name` read-only.
+   *
+   * @throws std::runtime_error if there is no such segment of `size` bytes.
+   */
+  static SharedSegment open(const std::string &name, size_t size);
+
+  SharedSegment(SharedSegment &&other) noexcept;
+  SharedSegment &operator=(SharedSegment &&other) noexcept;
+  ~SharedSegment();
+
+  SharedSegment(const SharedSegment &) = delete;
+  SharedSegment &operator=(const SharedSegment &) = delete;
+
+  const std::string &name() const { return m_name; }
+  std::span<BYTE> bytes() { return {m_data, m_size}; }
+  std::span<const BYTE> bytes() const { return {m_data, m_size}; }
+
+private:
+  SharedSegment() = default;
+  void release();
+
+  std::string m_name;
+  BYTE *m_data = nullptr;
+  size_t m_size = 0;
+  bool m_owner = false;
+#ifdef _WIN32
+  HANDLE m_mapping = nullptr;
+#endif
+};
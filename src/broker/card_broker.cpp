@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "backend/CardBackend.hpp"
+#include "broker/BrokerProtocol.hpp"
+#include "broker/CardBroker.hpp"
+#include "broker/LocalSocket.hpp"
+
+/**
+ * Owns the card readers and serves reads to local processes, which then use
+ * BrokerClient (or "read_card_snapshot --broker") instead of connecting to
+ * the readers themselves.
+ *
+ * Usage: card_broker [--socket <path>] [--backend <spec>]
+ *
+ * The socket defaults to $CARD_BROKER_SOCKET or inido-card-broker.sock in
+ * the temporary directory. See createBackend() for <spec>. Runs until
+ * interrupted.
+ */
+
+namespace {
+
+LocalSocket *g_listener = nullptr;
+
+extern "C" void onSignal(int) {
+  if (g_listener)
+    g_listener->shutdown();
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::string socketPath = defaultBrokerSocket();
+  std::string backendSpec;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--socket" && i + 1 < argc) {
+      socketPath = argv[++i];
+    } else if (arg == "--backend" && i + 1 < argc) {
+      backendSpec = argv[++i];
+    } else {
+      std::cerr << "Unknown option: " << arg << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  try {
+    CardBroker broker([&backendSpec] {
+      return backendSpec.empty() ? createDefaultBackend()
+                                 : createBackend(backendSpec);
+    });
+    LocalSocket listener = LocalSocket::listen(socketPath);
+
+    g_listener = &listener;
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    std::cerr << "Serving " << broker.readers().size() << " reader(s) on "
+              << socketPath << std::endl;
+    broker.serve(listener);
+    g_listener = nullptr;
+  } catch (const std::exception &e) {
+    std::cerr << "Exception: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
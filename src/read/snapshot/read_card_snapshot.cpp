@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "backend/CardBackend.hpp"
+#include "backend/RecordingBackend.hpp"
+#include "broker/BrokerClient.hpp"
+#include "scheduler/ReaderScheduler.hpp"
+#include "snapshot/CardSnapshot.hpp"
+#include "transport/Hex.hpp"
+#include "x509/ChainValidator.hpp"
+
+/**
+ * Reads every object from the card in the first reader over a single
+ * connection and prints them, instead of running each src/read tool in turn.
+ * With --all-readers, every attached reader is read at the same time.
+ *
+ * Usage: read_card_snapshot [--all-readers] [--backend <spec>]
+ *                           [--trace <file>] [--timing]
+ *                           [--anchors <dir>] [--broker]
+ *                           [mav4|pardis|omid]
+ *
+ * See createBackend() for <spec>; the default is $CARD_BACKEND or PC/SC.
+ * --trace records every APDU to <file>, for "--backend replay:<file>".
+ * --timing prints APDU latencies per phase, INS and file after each card.
+ * --anchors validates the auth and sign certificates against the CA
+ * certificates in <dir>, e.g. assets/iran_root_certificates.
+ * --broker reads through a running card_broker instead, on
+ * $CARD_BROKER_SOCKET or its default socket.
+ */
+
+void printHex(std::ostream &out, const char *label,
+              std::span<const BYTE> data) {
+  out << label << " (" << std::dec << data.size()
+      << " bytes): " << bytesToHexString(data) << std::endl;
+}
+
+void printChain(std::ostream &out, const char *label,
+                const ChainValidator &validator,
+                std::span<const BYTE> certificate) {
+  if (certificate.empty())
+    return;
+  ChainResult result = validator.validate(certificate);
+  out << label << " chain: " << chainStatusName(result.status);
+  for (const TrustAnchor *ca = result.issuer; ca; ca = ca->issuer) {
+    std::span<const BYTE> name = ca->view.commonName();
+    out << " <- " << std::string(name.begin(), name.end());
+  }
+  out << std::endl;
+}
+
+void printSnapshot(std::ostream &out, std::ostream &err,
+                   const CardSnapshot &snapshot,
+                   const ChainValidator *validator) {
+  printHex(out, "ATR", snapshot.atr);
+  printHex(out, "CSN", snapshot.csn);
+  printHex(out, "CRN", snapshot.crn);
+  printHex(out, "Version", snapshot.version);
+  printHex(out, "Dates", snapshot.dates);
+  printHex(out, "AFIS", snapshot.afis);
+  printHex(out, "SOD1", snapshot.sod1);
+  printHex(out, "Personal info", snapshot.personalInfo);
+  printHex(out, "Meta FEID", snapshot.metaFeid);
+  printHex(out, "Auth certificate", snapshot.authCertificate);
+  printHex(out, "Sign certificate", snapshot.signCertificate);
+  if (validator) {
+    printChain(out, "Auth certificate", *validator, snapshot.authCertificate);
+    printChain(out, "Sign certificate", *validator, snapshot.signCertificate);
+  }
+
+  for (const auto &error : snapshot.errors)
+    err << "Not read: " << error << std::endl;
+}
+
+void printLatency(std::ostream &out, const std::string &label,
+                  const LatencyHistogram &histogram) {
+  out << std::dec << std::setfill(' ') << "  " << std::left << std::setw(24)
+      << label << std::right
+      << std::setw(6) << histogram.count() << std::setw(10)
+      << histogram.percentile(50) / 1000 << std::setw(10)
+      << histogram.percentile(99) / 1000 << std::setw(10)
+      << histogram.max() / 1000 << std::setw(12) << histogram.total() / 1000
+      << std::endl;
+}
+
+/**
+ * Where the session's time went: the link (card, reader and PC/SC), the
+ * transport around it and our own code between APDUs.
+ */
+void printTiming(std::ostream &out, const ApduMetrics &metrics) {
+  out << "Timing (us)" << std::string(17, ' ') << " count       p50       p99"
+      << "       max       total" << std::endl;
+  printLatency(out, "link", metrics.link());
+  for (size_t i = 0; i < APDU_PHASE_COUNT; i++) {
+    auto phase = static_cast<ApduPhase>(i);
+    LatencyHistogram histogram = metrics.link(phase);
+    if (histogram.count() != 0)
+      printLatency(out, std::string("  ") + apduPhaseName(phase), histogram);
+  }
+  for (const auto &entry : metrics.entries()) {
+    std::ostringstream label;
+    label << "    INS " << std::hex << std::uppercase << std::setfill('0')
+          << std::setw(2) << (int)entry.key.ins << " file " << std::setw(4)
+          << entry.key.file;
+    printLatency(out, label.str(), entry.link);
+  }
+  printLatency(out, "transport", metrics.transport());
+  printLatency(out, "host", metrics.host());
+  printLatency(out, "reconnect", metrics.reconnects());
+}
+
+/**
+ * Reads every reader in parallel, one scheduler worker each. Formatting a
+ * snapshot is queued as a task, so a worker whose reader is done helps the
+ * others.
+ */
+int readAllReaders(const ReaderScheduler::BackendFactory &makeBackend,
+                   ChipProfile profile, bool timing,
+                   const ChainValidator *validator) {
+  std::vector<std::string> readers;
+  try {
+    readers = makeBackend()->listReaders();
+  } catch (const std::exception &e) {
+    std::cerr << "Exception: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (readers.empty()) {
+    std::cerr << "No readers found." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::mutex outputMutex;
+  std::atomic<size_t> cardsRead{0};
+  ReaderScheduler scheduler(
+      readers, [&](const std::string &reader, const char *what) {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cerr << reader << ": " << what << std::endl;
+      },
+      makeBackend);
+
+  for (size_t i = 0; i < scheduler.readerCount(); i++) {
+    scheduler.submitSession(i, [&, i](CardTransport &transport) {
+      auto metrics = std::make_shared<ApduMetrics>();
+      if (timing)
+        transport.setMetrics(metrics.get());
+      // Resets for the personal info as the single-reader path does, inside
+      // the scheduler's transaction.
+      auto snapshot = std::make_shared<CardSnapshot>(
+          readCardSnapshot(transport, CARD_OBJECT_ALL, profile, RetryPolicy(),
+                           ResetPolicy::WhenUnknown));
+      transport.setMetrics(nullptr);
+      if (snapshot->read != 0)
+        cardsRead++;
+
+      scheduler.submit([&, i, snapshot, metrics] {
+        std::ostringstream out, err;
+        out << "== " << scheduler.readerName(i) << std::endl;
+        printSnapshot(out, err, *snapshot, validator);
+        if (timing)
+          printTiming(out, *metrics);
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cout << out.str();
+        std::cerr << err.str();
+      });
+    });
+  }
+  scheduler.wait();
+
+  return cardsRead > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[]) {
+  ChipProfile profile = ChipProfile::Mav4;
+  bool allReaders = false;
+  std::string backendSpec;
+  std::string tracePath;
+  bool timing = false;
+  bool useBroker = false;
+  std::string anchorDirectory;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--all-readers") {
+      allReaders = true;
+    } else if (arg == "--backend" && i + 1 < argc) {
+      backendSpec = argv[++i];
+    } else if (arg == "--broker") {
+      useBroker = true;
+    } else if (arg == "--timing") {
+      timing = true;
+    } else if (arg == "--trace" && i + 1 < argc) {
+      tracePath = argv[++i];
+    } else if (arg == "--anchors" && i + 1 < argc) {
+      anchorDirectory = argv[++i];
+    } else if (arg == "pardis") {
+      profile = ChipProfile::Pardis;
+    } else if (arg == "omid") {
+      profile = ChipProfile::Omid;
+    } else if (arg != "mav4") {
+      std::cerr << "Unknown chip profile: " << arg << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  ReaderScheduler::BackendFactory makeBackend = [&backendSpec, &tracePath] {
+    std::unique_ptr<CardBackend> backend = backendSpec.empty()
+                                               ? createDefaultBackend()
+                                               : createBackend(backendSpec);
+    if (!tracePath.empty())
+      backend = std::make_unique<RecordingBackend>(std::move(backend),
+                                                   tracePath);
+    return backend;
+  };
+
+  // Loaded once, so every card of an --all-readers run shares its cache
+  std::unique_ptr<ChainValidator> validator;
+  if (!anchorDirectory.empty()) {
+    try {
+      validator = std::make_unique<ChainValidator>(anchorDirectory);
+    } catch (const std::exception &e) {
+      std::cerr << "Exception: " << e.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (allReaders)
+    return readAllReaders(makeBackend, profile, timing, validator.get());
+
+  CardSnapshot snapshot;
+  ApduMetrics metrics;
+  if (useBroker) {
+    try {
+      snapshot = BrokerClient()
+                     .readSnapshot(std::string(), CARD_OBJECT_ALL, profile);
+    } catch (const std::exception &e) {
+      std::cerr << "Exception: " << e.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+    printSnapshot(std::cout, std::cerr, snapshot, validator.get());
+    return snapshot.read != 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  try {
+    snapshot = readCardSnapshot(*makeBackend(), CARD_OBJECT_ALL, nullptr,
+                                profile, timing ? &metrics : nullptr);
+  } catch (const std::exception &e) {
+    std::cerr << "Exception: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  printSnapshot(std::cout, std::cerr, snapshot, validator.get());
+  if (timing)
+    printTiming(std::cout, metrics);
+  return snapshot.read != 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
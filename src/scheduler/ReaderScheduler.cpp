@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ReaderScheduler.hpp"
+
+#include <stdexcept>
+
+namespace {
+
+// The scheduler and worker the current thread belongs to, if any
+thread_local const ReaderScheduler *t_scheduler = nullptr;
+thread_local size_t t_worker = 0;
+
+// Reported for anything thrown that is not a std::exception
+const char UNKNOWN_EXCEPTION[] = "Unknown exception";
+
+} // namespace
+
+ReaderScheduler::ReaderScheduler(std::vector<std::string> readers,
+                                 ErrorHandler onError,
+                                 BackendFactory makeBackend)
+    : m_onError(std::move(onError)), m_makeBackend(std::move(makeBackend)) {
+  if (readers.empty())
+    throw std::invalid_argument("No readers to schedule");
+
+  for (std::string &reader : readers) {
+    m_workers.push_back(std::make_unique<Worker>());
+    m_workers.back()->reader = std::move(reader);
+  }
+  // Start the threads only once m_workers no longer changes.
+  for (size_t i = 0; i < m_workers.size(); i++)
+    m_workers[i]->thread = std::thread(&ReaderScheduler::run, this, i);
+}
+
+ReaderScheduler::~ReaderScheduler() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_wake.notify_all();
+  for (auto &worker : m_workers)
+    worker->thread.join();
+}
+
+void ReaderScheduler::submitSession(size_t reader, Session session) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_workers.at(reader)->sessions.push_back(std::move(session));
+    m_pending++;
+  }
+  m_wake.notify_all();
+}
+
+void ReaderScheduler::submit(Task task) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t index = t_scheduler == this
+                       ? t_worker
+                       : m_nextWorker++ % m_workers.size();
+    m_workers[index]->tasks.push_back(std::move(task));
+    m_queuedTasks++;
+    m_pending++;
+  }
+  m_wake.notify_all();
+}
+
+void ReaderScheduler::wait() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_idle.wait(lock, [&] { return m_pending == 0; });
+}
+
+void ReaderScheduler::run(size_t index) {
+  t_scheduler = this;
+  t_worker = index;
+  Worker &worker = *m_workers[index];
+
+  std::unique_ptr<CardBackend> backend;
+  std::string backendError;
+  try {
+    backend = m_makeBackend();
+  } catch (const std::exception &e) {
+    backendError = e.what();
+  } catch (...) {
+    backendError = UNKNOWN_EXCEPTION;
+  }
+
+  for (;;) {
+    Session session;
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wake.wait(lock, [&] {
+        return m_stopping || !worker.sessions.empty() || m_queuedTasks > 0;
+      });
+      // Sessions first: the reader is the scarce resource.
+      if (!worker.sessions.empty()) {
+        session = std::move(worker.sessions.front());
+        worker.sessions.pop_front();
+      } else if (!takeTask(index, task)) {
+        break; // stopping and nothing left
+      }
+    }
+
+    if (session) {
+      if (backend)
+        runSession(worker, *backend, session);
+      else
+        report(worker, backendError.c_str());
+    } else {
+      try {
+        task();
+      } catch (const std::exception &e) {
+        report(worker, e.what());
+      } catch (...) {
+        report(worker, UNKNOWN_EXCEPTION);
+      }
+    }
+    finished();
+  }
+}
+
+bool ReaderScheduler::takeTask(size_t index, Task &task) {
+  if (m_queuedTasks == 0)
+    return false;
+
+  std::deque<Task> &own = m_workers[index]->tasks;
+  if (!own.empty()) {
+    task = std::move(own.back());
+    own.pop_back();
+  } else {
+    for (size_t i = 1; i < m_workers.size(); i++) {
+      std::deque<Task> &victim =
+          m_workers[(index + i) % m_workers.size()]->tasks;
+      if (!victim.empty()) {
+        task = std::move(victim.front());
+        victim.pop_front();
+        break;
+      }
+    }
+  }
+  m_queuedTasks--;
+  return true;
+}
+
+void ReaderScheduler::runSession(Worker &worker, CardBackend &backend,
+                                 Session &session) {
+  try {
+    CardConnection connection = backend.connect(worker.reader);
+    CardTransport transport(std::move(connection.link),
+                            connection.activeProtocol);
+
+    CardTransaction transaction(transport);
+    session(transport);
+  } catch (const std::exception &e) {
+    report(worker, e.what());
+  } catch (...) {
+    report(worker, UNKNOWN_EXCEPTION);
+  }
+}
+
+void ReaderScheduler::report(const Worker &worker, const char *what) {
+  if (m_onError)
+    m_onError(worker.reader, what);
+}
+
+void ReaderScheduler::finished() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (--m_pending == 0)
+    m_idle.notify_all();
+}
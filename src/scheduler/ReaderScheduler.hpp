@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "backend/CardBackend.hpp"
+#include "transport/CardTransport.hpp"
+#include "transport/Pcsc.hpp"
+
+/**
+ * Runs card sessions on several readers at once, one worker thread per
+ * reader, plus the CPU work that follows them.
+ *
+ * A session needs the card in its own reader, so it only ever runs on that
+ * reader's worker, inside its own connection and PC/SC transaction. Tasks
+ * (verification, formatting, ...) have no such tie: a task submitted from a
+ * worker goes on that worker's queue, and a worker with no session waiting
+ * takes its own newest task or steals the oldest one of another worker.
+ *
+ * Each worker creates its own CardBackend, as PC/SC contexts are not meant
+ * to be shared between threads. Jobs take milliseconds to seconds, so all
+ * queues share a single lock.
+ */
+class ReaderScheduler {
+public:
+  using Session = std::function<void(CardTransport &transport)>;
+  using Task = std::function<void()>;
+  // Called on the worker of a failed session or task, so possibly from
+  // several threads at once
+  using ErrorHandler =
+      std::function<void(const std::string &reader, const char *what)>;
+  // Called once on every worker
+  using BackendFactory = std::function<std::unique_ptr<CardBackend>()>;
+
+  /**
+   * Starts one worker per name in `readers`, each connecting through a
+   * backend made by `makeBackend`.
+   *
+   * @throws std::invalid_argument if `readers` is empty.
+   */
+  explicit ReaderScheduler(std::vector<std::string> readers,
+                           ErrorHandler onError = nullptr,
+                           BackendFactory makeBackend = createDefaultBackend);
+
+  /** Finishes every queued session and task, then stops the workers. */
+  ~ReaderScheduler();
+
+  ReaderScheduler(const ReaderScheduler &) = delete;
+  ReaderScheduler &operator=(const ReaderScheduler &) = delete;
+
+  size_t readerCount() const { return m_workers.size(); }
+  const std::string &readerName(size_t reader) const {
+    return m_workers.at(reader)->reader;
+  }
+
+  /** Queues a session for the card in reader number `reader`. */
+  void submitSession(size_t reader, Session session);
+
+  /**
+   * Queues a task on the calling worker, or spreads tasks round-robin when
+   * called from another thread.
+   */
+  void submit(Task task);
+
+  /** Blocks until every session and task submitted so far has finished. */
+  void wait();
+
+private:
+  struct Worker {
+    std::string reader;
+    std::deque<Session> sessions;
+    std::deque<Task> tasks;
+    std::thread thread;
+  };
+
+  void run(size_t index);
+  void runSession(Worker &worker, CardBackend &backend, Session &session);
+  // Takes the next task for `index`: its newest, else another's oldest.
+  bool takeTask(size_t index, Task &task);
+  void report(const Worker &worker, const char *what);
+  void finished();
+
+  std::vector<std::unique_ptr<Worker>> m_workers;
+  ErrorHandler m_onError;
+  BackendFactory m_makeBackend;
+
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_idle;
+  size_t m_queuedTasks = 0;
+  size_t m_pending = 0; // queued or running
+  size_t m_nextWorker = 0;
+  bool m_stopping = false;
+};
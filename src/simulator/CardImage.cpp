@@ -0,0 +1,328 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "CardImage.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "transport/Hex.hpp"
+
+namespace {
+
+// ISO 7816-4 allows AIDs of up to 16 bytes
+constexpr size_t MAX_AID = 16;
+
+// Card manager, as selected by the MAV4 tools and by the OMID ones
+const BYTE CARD_MANAGER_AID[] = {0xA0, 0x00, 0x00, 0x00,
+                                 0x18, 0x43, 0x4D, 0x00};
+const BYTE OMID_CARD_MANAGER_AID[] = {0xA0, 0x00, 0x00, 0x00,
+                                      0x00, 0x18, 0x43, 0x4D};
+const BYTE ID_AID[] = {0xA0, 0x00, 0x00, 0x00, 0x18, 0x30, 0x03, 0x01};
+const BYTE IAS_AID[] = {0xA0, 0x00, 0x00, 0x00, 0x18, 0x0C,
+                        0x00, 0x00, 0x01, 0x63, 0x42, 0x00};
+const BYTE PARDIS_ISD_AID[] = {0xA0, 0x00, 0x00, 0x00,
+                               0x03, 0x00, 0x00, 0x00};
+const char PARDIS_AID[] = "PARDIS,MATIRAN ";
+const char OMID_AID[] = "MATIRAN ID CARD ";
+const BYTE OMID_FEID_AID[] = {0x39, 0x8D, 0xE5, 0xBA, 0xB4, 0x1E, 0xC6, 0x76,
+                              0xCA, 0xBD, 0xB5, 0x26, 0xE5, 0x85, 0x71};
+
+const BYTE MAV4_ATR[] = {0x3B, 0x7F, 0x96, 0x00, 0x00, 0x80, 0x31,
+                         0x80, 0x65, 0xB0, 0x85, 0x03, 0x00, 0xEF,
+                         0x12, 0x0F, 0xFF, 0x82, 0x90, 0x00};
+const BYTE PARDIS_ATR[] = {0x3B, 0x8A, 0x80, 0x01, 0x50, 0x41, 0x52, 0x44,
+                           0x49, 0x53, 0x20, 0x49, 0x44, 0x20, 0x23};
+const BYTE OMID_ATR[] = {0x3B, 0x88, 0x80, 0x01, 0x4F, 0x4D, 0x49,
+                         0x44, 0x20, 0x49, 0x44, 0x20, 0x2E};
+// T=0 and T=1; card capabilities 73 80 01 40: selection by DF name, 1-byte
+// data units, extended Lc/Le
+const BYTE EXTENDED_LENGTH_ATR[] = {0x3B, 0x8A, 0x80, 0x01, 0x80,
+                                   0x31, 0x80, 0x73, 0x80, 0x01,
+                                   0x40, 0x82, 0x90, 0x00, 0x9A};
+
+std::span<const BYTE> bytesOf(const char *text) {
+  return {reinterpret_cast<const BYTE *>(text), std::strlen(text)};
+}
+
+// Deterministic filler, different for every `seed`
+std::vector<BYTE> pattern(size_t size, BYTE seed) {
+  std::vector<BYTE> data(size);
+  uint32_t state = 0x9E3779B9u * (seed + 1u);
+  for (BYTE &b : data) {
+    state = state * 1103515245u + 12345u;
+    b = static_cast<BYTE>(state >> 16);
+  }
+  return data;
+}
+
+// `size` bytes of the form 30 82 LL LL ..., as a DER certificate starts
+std::vector<BYTE> certificate(size_t size, BYTE seed) {
+  std::vector<BYTE> data = pattern(size, seed);
+  data[0] = 0x30;
+  data[1] = 0x82;
+  data[2] = static_cast<BYTE>((size - 4) >> 8);
+  data[3] = static_cast<BYTE>(size - 4);
+  return data;
+}
+
+// `tag` `length` followed by `length` bytes of filler
+std::vector<BYTE> tagged(BYTE tag, size_t length, BYTE seed) {
+  std::vector<BYTE> data = pattern(length + 2, seed);
+  data[0] = tag;
+  data[1] = static_cast<BYTE>(length);
+  return data;
+}
+
+std::vector<BYTE> concat(std::vector<BYTE> first,
+                         const std::vector<BYTE> &second) {
+  first.insert(first.end(), second.begin(), second.end());
+  return first;
+}
+
+// CPLC as GET DATA 9F7F returns it: the tag, its length and the data
+std::vector<BYTE> cplc(BYTE seed) {
+  std::vector<BYTE> data = pattern(0x2D, seed);
+  data[0] = 0x9F;
+  data[1] = 0x7F;
+  data[2] = 0x2A;
+  return data;
+}
+
+void addCardManager(CardImage &image, std::span<const BYTE> aid, BYTE seed) {
+  VirtualApplication &cm = image.addApplication(aid);
+  cm.addResponse({0x80, 0xCA, 0x9F, 0x7F}, cplc(seed));
+  cm.addResponse({0x80, 0xCA, 0x01, 0x01}, tagged(0x01, 0x13, seed + 1));
+  cm.addResponse({0x00, 0x84, 0x00, 0x00}, pattern(0x10, seed + 2));
+  cm.addResponse({0x00, 0x88, 0x01, 0x00}, pattern(0x20, seed + 3));
+}
+
+CardImage mav4Image() {
+  CardImage image;
+  image.atr.assign(std::begin(MAV4_ATR), std::end(MAV4_ATR));
+  addCardManager(image, CARD_MANAGER_AID, 0x10);
+
+  const uint16_t df0200[] = {0x0200};
+  const uint16_t df0300[] = {0x0300};
+  const uint16_t df0600[] = {0x0600};
+  VirtualApplication &id = image.addApplication(ID_AID);
+  id.dataUnit = 4;
+  id.addEf(df0200, 0x0201, pattern(0x1E8, 0x20));
+  id.addEf(df0200, 0x0205, certificate(0x6A0, 0x21));
+  id.addEf(df0300, 0x0302, concat(tagged(0xA1, 0x0E, 0x22),
+                                  {0xAD, 0x01, 0x01}));
+  id.addEf(df0300, 0x0303, concat(tagged(0xB2, 0x12, 0x23),
+                                  tagged(0xB3, 0x12, 0x24)));
+  id.addEf(df0600, 0x0601, pattern(0x08, 0x25));
+
+  const uint16_t df5000[] = {0x5000};
+  const uint16_t df5100[] = {0x5100};
+  VirtualApplication &ias = image.addApplication(IAS_AID);
+  ias.addEf(df5000, 0x5040, certificate(0x4A6, 0x30));
+  ias.addEf(df5100, 0x5040, certificate(0x4C2, 0x31));
+  return image;
+}
+
+CardImage pardisImage() {
+  CardImage image;
+  image.atr.assign(std::begin(PARDIS_ATR), std::end(PARDIS_ATR));
+
+  VirtualApplication &isd = image.addApplication(PARDIS_ISD_AID);
+  isd.addResponse({0x80, 0xCA, 0x9F, 0x7F}, cplc(0x40));
+  isd.addResponse({0x90, 0x38, 0x00, 0x00}, pattern(0x0C, 0x41));
+
+  const uint16_t df5100[] = {0x5100};
+  VirtualApplication &pardis = image.addApplication(bytesOf(PARDIS_AID));
+  pardis.addEf(df5100, 0x5040, certificate(0x482, 0x42));
+  pardis.addEf(df5100, 0x0303, pattern(0x20, 0x43));
+  return image;
+}
+
+CardImage omidImage() {
+  CardImage image;
+  image.atr.assign(std::begin(OMID_ATR), std::end(OMID_ATR));
+  addCardManager(image, OMID_CARD_MANAGER_AID, 0x50);
+  image.addApplication(bytesOf(OMID_AID));
+
+  const uint16_t df1100[] = {0x1100};
+  VirtualApplication &feid = image.addApplication(OMID_FEID_AID);
+  feid.addEf(df1100, 0x1103, pattern(0x38, 0x51));
+  return image;
+}
+
+// hexStringToBytes() would drop an odd trailing digit; an image must not.
+std::vector<BYTE> parseHex(const std::string &text) {
+  if (text.size() % 2 != 0)
+    throw std::invalid_argument("odd number of hex digits");
+  return hexStringToBytes(text);
+}
+
+// "3F00/0200/0201" -> FIDs, the MF excluded
+std::vector<uint16_t> parsePath(const std::string &text) {
+  std::vector<uint16_t> fids;
+  std::stringstream parts(text);
+  std::string part;
+  while (std::getline(parts, part, '/')) {
+    std::vector<BYTE> fid = parseHex(part);
+    if (fid.size() != 2)
+      throw std::invalid_argument("FID must be 4 hex digits: " + part);
+    fids.push_back(static_cast<uint16_t>((fid[0] << 8) | fid[1]));
+  }
+  if (!fids.empty() && fids.front() == FID_MF)
+    fids.erase(fids.begin());
+  return fids;
+}
+
+void parseStatement(CardImage &image, const std::string &keyword,
+                    std::istringstream &args) {
+  std::string first, second;
+  args >> first >> second;
+
+  if (keyword == "atr") {
+    image.atr = parseHex(first);
+    return;
+  }
+  if (keyword == "app") {
+    std::vector<BYTE> aid = parseHex(first);
+    if (aid.empty() || aid.size() > MAX_AID)
+      throw std::invalid_argument("AID must be 1 to 16 bytes");
+    image.addApplication(aid);
+    return;
+  }
+
+  if (keyword != "df" && keyword != "ef" && keyword != "response" &&
+      keyword != "unit")
+    throw std::invalid_argument("unknown statement " + keyword);
+  if (image.applications.empty())
+    throw std::invalid_argument(keyword + " before the first app");
+  VirtualApplication &app = image.applications.back();
+
+  if (keyword == "unit") {
+    size_t unit = std::stoul(first);
+    if (unit == 0 || unit > 128 || (unit & (unit - 1)) != 0)
+      throw std::invalid_argument("unit must be a power of two up to 128");
+    app.dataUnit = unit;
+  } else if (keyword == "df") {
+    app.addDf(parsePath(first));
+  } else if (keyword == "ef") {
+    std::vector<uint16_t> path = parsePath(first);
+    if (path.empty())
+      throw std::invalid_argument("ef needs a FID");
+    uint16_t fid = path.back();
+    path.pop_back();
+    app.addEf(path, fid, parseHex(second));
+  } else {
+    std::vector<BYTE> header = parseHex(first);
+    if (header.size() != 4)
+      throw std::invalid_argument("response header must be CLA INS P1 P2");
+    app.addResponse({header[0], header[1], header[2], header[3]},
+                    parseHex(second));
+  }
+}
+
+} // namespace
+
+VirtualFile *VirtualFile::child(uint16_t childFid) {
+  auto it = std::find_if(
+      children.begin(), children.end(),
+      [&](const VirtualFile &file) { return file.fid == childFid; });
+  return it == children.end() ? nullptr : &*it;
+}
+
+VirtualFile &VirtualApplication::addDf(std::span<const uint16_t> path) {
+  VirtualFile *df = &mf;
+  for (uint16_t fid : path) {
+    VirtualFile *next = df->child(fid);
+    if (!next) {
+      df->children.push_back({fid, true, {}, {}});
+      next = &df->children.back();
+    } else if (!next->isDf) {
+      throw std::invalid_argument("File is an EF, not a DF");
+    }
+    df = next;
+  }
+  return *df;
+}
+
+void VirtualApplication::addEf(std::span<const uint16_t> dfPath, uint16_t fid,
+                               std::vector<BYTE> content) {
+  VirtualFile &df = addDf(dfPath);
+  if (VirtualFile *existing = df.child(fid)) {
+    if (existing->isDf)
+      throw std::invalid_argument("File is a DF, not an EF");
+    existing->content = std::move(content);
+    return;
+  }
+  df.children.push_back({fid, false, std::move(content), {}});
+}
+
+void VirtualApplication::addResponse(std::array<BYTE, 4> header,
+                                     std::vector<BYTE> data) {
+  responses.push_back({header, std::move(data)});
+}
+
+VirtualApplication &CardImage::addApplication(std::span<const BYTE> aid) {
+  VirtualApplication &app = applications.emplace_back();
+  app.aid.assign(aid.begin(), aid.end());
+  return app;
+}
+
+CardImage loadCardImage(const std::string &path) {
+  std::ifstream file(path);
+  if (!file)
+    throw std::runtime_error("Failed to open card image " + path);
+
+  CardImage image;
+  std::string line;
+  for (size_t number = 1; std::getline(file, line); number++) {
+    std::istringstream args(line);
+    std::string keyword;
+    if (!(args >> keyword) || keyword[0] == '#')
+      continue;
+    try {
+      parseStatement(image, keyword, args);
+    } catch (const std::exception &e) {
+      throw std::runtime_error(path + ":" + std::to_string(number) + ": " +
+                               e.what());
+    }
+  }
+  if (image.applications.empty())
+    throw std::runtime_error(path + ": no application");
+  return image;
+}
+
+CardImage sampleCardImage(ChipProfile profile) {
+  switch (profile) {
+  case ChipProfile::Mav4:
+    return mav4Image();
+  case ChipProfile::Pardis:
+    return pardisImage();
+  case ChipProfile::Omid:
+    return omidImage();
+  }
+  throw std::invalid_argument("Unknown chip profile");
+}
+
+CardImage extendedLengthCardImage(ChipProfile profile) {
+  CardImage image = sampleCardImage(profile);
+  image.atr.assign(std::begin(EXTENDED_LENGTH_ATR),
+                   std::end(EXTENDED_LENGTH_ATR));
+  return image;
+}
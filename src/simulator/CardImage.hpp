@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "snapshot/CardSnapshot.hpp"
+#include "transport/Pcsc.hpp"
+#include "transport/SelectionCursor.hpp"
+
+/** A DF or EF of a virtual card. */
+struct VirtualFile {
+  uint16_t fid = 0;
+  bool isDf = false;
+  std::vector<BYTE> content;         // EF only
+  std::vector<VirtualFile> children; // DF only
+
+  VirtualFile *child(uint16_t childFid);
+};
+
+/** Fixed answer to every command with a given CLA INS P1 P2. */
+struct FixedResponse {
+  std::array<BYTE, 4> header;
+  std::vector<BYTE> data;
+};
+
+/** An applet with its own file tree under an MF. */
+struct VirtualApplication {
+  std::vector<BYTE> aid;
+  VirtualFile mf{FID_MF, true, {}, {}};
+  std::vector<FixedResponse> responses; // GET DATA and the like
+  // Bytes per READ BINARY offset step, 4 in the MAV4 ID applet. Like the
+  // chips, the FCPs do not announce it.
+  size_t dataUnit = 1;
+
+  /** Creates the DFs along `path`, which starts below the MF. */
+  VirtualFile &addDf(std::span<const uint16_t> path);
+  /** Adds EF `fid` to the DF at `dfPath`, creating the DFs as needed. */
+  void addEf(std::span<const uint16_t> dfPath, uint16_t fid,
+             std::vector<BYTE> content);
+  void addResponse(std::array<BYTE, 4> header, std::vector<BYTE> data);
+};
+
+/**
+ * Everything a virtual card serves. The first application is the one
+ * selected after a reset, as the issuer security domain is on a real card.
+ */
+struct CardImage {
+  std::vector<BYTE> atr;
+  std::vector<VirtualApplication> applications;
+
+  VirtualApplication &addApplication(std::span<const BYTE> aid);
+};
+
+/**
+ * Loads a card image from a text file with one statement per line:
+ *
+ *   atr <hex>
+ *   app <aid hex>                    following lines apply to this applet
+ *   unit <bytes>                     READ BINARY data unit, default 1
+ *   df <fid>/<fid>...                DF path below the MF
+ *   ef <fid>/<fid>.../<fid> <hex>    EF and its content
+ *   response <cla ins p1 p2> <hex>   fixed answer, e.g. 80CA9F7F for CPLC
+ *
+ * Blank lines and lines starting with # are ignored.
+ *
+ * @throws std::runtime_error naming the line of the first error.
+ */
+CardImage loadCardImage(const std::string &path);
+
+/**
+ * A synthetic card with the file layout of `profile`, as the src/read tools
+ * expect it, filled with deterministic contents.
+ */
+CardImage sampleCardImage(ChipProfile profile);
+
+/**
+ * sampleCardImage() behind a T=1 ATR whose card capabilities announce
+ * extended Lc/Le, for a VirtualCard with VirtualCardOptions::extendedLength.
+ * None of the chips in the field says so in its ATR.
+ */
+CardImage extendedLengthCardImage(ChipProfile profile);
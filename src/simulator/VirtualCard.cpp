@@ -0,0 +1,449 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "VirtualCard.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+constexpr BYTE INS_SELECT = 0xA4;
+constexpr BYTE INS_READ_BINARY = 0xB0;
+constexpr BYTE INS_GET_RESPONSE = 0xC0;
+constexpr BYTE INS_MANAGE_CHANNEL = 0x70;
+
+constexpr StatusWord SW_END_OF_FILE{0x62, 0x82};
+constexpr StatusWord SW_WRONG_LENGTH{0x67, 0x00};
+constexpr StatusWord SW_CHANNEL_NOT_SUPPORTED{0x68, 0x81};
+constexpr StatusWord SW_NO_CURRENT_EF{0x69, 0x86};
+constexpr StatusWord SW_CONDITIONS_NOT_SATISFIED{0x69, 0x85};
+constexpr StatusWord SW_FUNCTION_NOT_SUPPORTED{0x6A, 0x81};
+constexpr StatusWord SW_INCORRECT_P1P2{0x6A, 0x86};
+constexpr StatusWord SW_DATA_NOT_FOUND{0x6A, 0x88};
+constexpr StatusWord SW_INS_NOT_SUPPORTED{0x6D, 0x00};
+
+constexpr size_t SHORT_NE_MAX = 256;
+
+StatusWord moreData(size_t available) {
+  return {0x61, static_cast<BYTE>(std::min(available, SHORT_NE_MAX))};
+}
+
+StatusWord wrongLength(size_t available) {
+  return {0x6C, static_cast<BYTE>(std::min(available, SHORT_NE_MAX))};
+}
+
+// AIDs compare without trailing zero padding, and a prefix selects the
+// applet it starts, as SELECT by partial name does.
+bool aidMatches(std::span<const BYTE> requested, std::span<const BYTE> aid) {
+  while (!requested.empty() && requested.back() == 0x00)
+    requested = requested.first(requested.size() - 1);
+  while (!aid.empty() && aid.back() == 0x00)
+    aid = aid.first(aid.size() - 1);
+  if (requested.empty() || requested.size() > aid.size())
+    return false;
+  return std::equal(requested.begin(), requested.end(), aid.begin());
+}
+
+void appendFid(std::vector<BYTE> &out, uint16_t fid) {
+  out.insert(out.end(), {0x83, 0x02, static_cast<BYTE>(fid >> 8),
+                         static_cast<BYTE>(fid)});
+}
+
+// 62 L [80 02 size] [82 01 descriptor] [83 02 fid]
+void buildFcp(std::vector<BYTE> &out, const VirtualFile &file) {
+  out.assign({0x62, 0x00});
+  if (!file.isDf) {
+    size_t size = file.content.size();
+    out.insert(out.end(), {0x80, 0x02, static_cast<BYTE>(size >> 8),
+                           static_cast<BYTE>(size), 0x82, 0x01, 0x01});
+  } else {
+    out.insert(out.end(), {0x82, 0x01, 0x38});
+  }
+  appendFid(out, file.fid);
+  out[1] = static_cast<BYTE>(out.size() - 2);
+}
+
+// 6F L [84 L aid]
+void buildFci(std::vector<BYTE> &out, std::span<const BYTE> aid) {
+  out.assign({0x6F, static_cast<BYTE>(aid.size() + 2), 0x84,
+              static_cast<BYTE>(aid.size())});
+  out.insert(out.end(), aid.begin(), aid.end());
+}
+
+size_t bigEndian(BYTE high, BYTE low) { return (high << 8) | low; }
+
+} // namespace
+
+VirtualCard::VirtualCard(CardImage image, VirtualCardOptions options)
+    : m_image(std::move(image)), m_options(options) {
+  if (m_options.protocol != SCARD_PROTOCOL_T0 &&
+      m_options.protocol != SCARD_PROTOCOL_T1)
+    throw std::invalid_argument("Virtual card protocol must be T=0 or T=1");
+  if (m_options.channels == 0 || m_options.channels > MAX_LOGICAL_CHANNELS)
+    throw std::invalid_argument("Virtual card channel count out of range");
+  if (m_image.applications.empty())
+    throw std::invalid_argument("Card image has no application");
+  reset();
+}
+
+void VirtualCard::reset() {
+  for (Channel &channel : m_channels)
+    channel = Channel();
+  m_channels[0].open = true;
+  selectApplication(m_channels[0], m_image.applications.front());
+}
+
+LONG VirtualCard::reconnect(DWORD initialization, DWORD &activeProtocol) {
+  if (initialization != SCARD_LEAVE_CARD)
+    reset();
+  activeProtocol = m_options.protocol;
+  return SCARD_S_SUCCESS;
+}
+
+size_t VirtualCard::readAtr(std::span<BYTE> atr) {
+  size_t length = std::min(atr.size(), m_image.atr.size());
+  std::memcpy(atr.data(), m_image.atr.data(), length);
+  return length;
+}
+
+size_t VirtualCard::transmit(std::span<const BYTE> command,
+                             std::span<BYTE> response) {
+  m_commandCount++;
+
+  std::optional<Command> parsed = parse(command);
+  Answer answer{{}, SW_WRONG_LENGTH};
+  if (parsed && !(parsed->extended && !m_options.extendedLength))
+    answer = process(*parsed, classChannel(command[0]));
+
+  size_t length = answer.data.size() + 2;
+  if (response.size() < length)
+    throw std::runtime_error("Response buffer too small for virtual card");
+  std::memcpy(response.data(), answer.data.data(), answer.data.size());
+  response[length - 2] = answer.sw.sw1;
+  response[length - 1] = answer.sw.sw2;
+
+  auto latency = m_options.commandLatency +
+                 m_options.byteLatency * (command.size() + length);
+  if (latency.count() > 0)
+    std::this_thread::sleep_for(latency);
+  return length;
+}
+
+std::optional<VirtualCard::Command>
+VirtualCard::parse(std::span<const BYTE> apdu) {
+  if (apdu.size() < 4)
+    return std::nullopt;
+  Command command;
+  command.cla = apdu[0];
+  command.ins = apdu[1];
+  command.p1 = apdu[2];
+  command.p2 = apdu[3];
+
+  // [Lc data] [Le], short or extended
+  std::span<const BYTE> body = apdu.subspan(4);
+  auto setLe = [&](size_t le, size_t whenZero) {
+    command.hasLe = true;
+    command.maxLe = le == 0;
+    command.ne = le ? le : whenZero;
+  };
+
+  if (body.empty())
+    return command;
+  if (body.size() == 1) {
+    setLe(body[0], SHORT_NE_MAX);
+    return command;
+  }
+  if (body[0] != 0x00) {
+    size_t lc = body[0];
+    if (body.size() != 1 + lc && body.size() != 2 + lc)
+      return std::nullopt;
+    command.data = body.subspan(1, lc);
+    if (body.size() == 2 + lc)
+      setLe(body.back(), SHORT_NE_MAX);
+    return command;
+  }
+
+  command.extended = true;
+  if (body.size() == 3) {
+    setLe(bigEndian(body[1], body[2]), 0x10000);
+    return command;
+  }
+  size_t lc = body.size() > 3 ? bigEndian(body[1], body[2]) : 0;
+  if (lc == 0 || (body.size() != 3 + lc && body.size() != 5 + lc))
+    return std::nullopt;
+  command.data = body.subspan(3, lc);
+  if (body.size() == 5 + lc)
+    setLe(bigEndian(body[body.size() - 2], body.back()), 0x10000);
+  return command;
+}
+
+VirtualCard::Answer VirtualCard::process(const Command &command,
+                                         BYTE channelNumber) {
+  if (channelNumber >= m_options.channels ||
+      !m_channels[channelNumber].open)
+    return {{}, SW_CHANNEL_NOT_SUPPORTED};
+  Channel &channel = m_channels[channelNumber];
+
+  if (command.ins == INS_GET_RESPONSE)
+    return getResponse(command, channel);
+  channel.pending.clear();
+
+  switch (command.ins) {
+  case INS_SELECT:
+    return select(command, channel);
+  case INS_READ_BINARY:
+    return readBinary(command, channel);
+  case INS_MANAGE_CHANNEL:
+    return manageChannel(command, channel);
+  default:
+    return fixedResponse(command, channel);
+  }
+}
+
+VirtualCard::Answer VirtualCard::respond(const Command &command,
+                                         Channel &channel,
+                                         std::span<const BYTE> data,
+                                         bool exact) {
+  bool t0 = m_options.protocol == SCARD_PROTOCOL_T0;
+  if (data.empty())
+    return {{}, SW_SUCCESS};
+
+  // Case 1 or 3: T=0 offers the data for GET RESPONSE, T=1 drops it.
+  if (!command.hasLe) {
+    if (!t0)
+      return {{}, SW_SUCCESS};
+    channel.pending.assign(data.begin(), data.end());
+    return {{}, moreData(data.size())};
+  }
+
+  bool strict = m_options.strictLe && !command.extended;
+  if (data.size() <= command.ne && command.maxLe) {
+    // T=0 chips announce a short answer to Le=00 with 61xx.
+    if (t0 && exact && !command.extended && data.size() < SHORT_NE_MAX) {
+      channel.pending.assign(data.begin(), data.end());
+      return {{}, moreData(data.size())};
+    }
+    return {data, SW_SUCCESS};
+  }
+  if (data.size() == command.ne)
+    return {data, SW_SUCCESS};
+  if (data.size() > command.ne) {
+    if (exact && strict)
+      return {{}, wrongLength(data.size())};
+    return {data.first(command.ne), SW_SUCCESS};
+  }
+  if (strict)
+    return {{}, wrongLength(data.size())};
+  return {data, SW_END_OF_FILE};
+}
+
+VirtualCard::Answer VirtualCard::select(const Command &command,
+                                        Channel &channel) {
+  bool returnData = (command.p2 & 0x0C) != 0x0C;
+
+  if (command.p1 == 0x04) {
+    VirtualApplication *application = findApplication(command.data);
+    if (!application)
+      return {{}, SW_FILE_NOT_FOUND};
+    selectApplication(channel, *application);
+    if (!returnData)
+      return {{}, SW_SUCCESS};
+    buildFci(m_scratch, application->aid);
+    return respond(command, channel, m_scratch, true);
+  }
+
+  if (!channel.application)
+    return {{}, SW_FILE_NOT_FOUND};
+  if (command.p1 > 0x03)
+    return {{}, SW_INCORRECT_P1P2};
+  if (command.p1 != 0x03 && !(command.p1 == 0x00 && command.data.empty()) &&
+      command.data.size() != 2)
+    return {{}, SW_WRONG_LENGTH};
+
+  uint16_t fid = command.data.size() == 2
+                     ? static_cast<uint16_t>(
+                           bigEndian(command.data[0], command.data[1]))
+                     : FID_MF;
+  VirtualFile *current = channel.dfs.back();
+  VirtualFile *selected = nullptr;
+
+  switch (command.p1) {
+  case 0x00:
+    if (fid == FID_MF) {
+      channel.dfs.resize(1);
+      selected = channel.dfs.front();
+    } else if ((selected = current->child(fid))) {
+      // immediate child of the current DF
+    } else if (current->fid == fid) {
+      selected = current;
+    } else if (channel.dfs.size() > 1) {
+      // a sibling, i.e. a child of the parent DF
+      selected = channel.dfs[channel.dfs.size() - 2]->child(fid);
+      if (selected)
+        channel.dfs.pop_back();
+    }
+    break;
+  case 0x01:
+    selected = current->child(fid);
+    if (selected && !selected->isDf)
+      selected = nullptr;
+    break;
+  case 0x02:
+    selected = current->child(fid);
+    if (selected && selected->isDf)
+      selected = nullptr;
+    break;
+  case 0x03:
+    if (channel.dfs.size() > 1)
+      channel.dfs.pop_back();
+    selected = channel.dfs.back();
+    break;
+  }
+  if (!selected)
+    return {{}, SW_FILE_NOT_FOUND};
+
+  if (!selected->isDf) {
+    channel.ef = selected;
+  } else {
+    channel.ef = nullptr;
+    if (selected != channel.dfs.back())
+      channel.dfs.push_back(selected);
+  }
+
+  if (!returnData)
+    return {{}, SW_SUCCESS};
+  buildFcp(m_scratch, *selected);
+  return respond(command, channel, m_scratch, true);
+}
+
+VirtualCard::Answer VirtualCard::readBinary(const Command &command,
+                                            Channel &channel) {
+  // in data units of the application
+  size_t units;
+  if (command.p1 & 0x80) {
+    // short EF identifier in P1, offset in P2
+    BYTE sfi = command.p1 & 0x1F;
+    if (!channel.application)
+      return {{}, SW_FILE_NOT_FOUND};
+    auto &files = channel.dfs.back()->children;
+    auto it = std::find_if(files.begin(), files.end(), [&](const auto &f) {
+      return !f.isDf && (f.fid & 0x1F) == sfi;
+    });
+    if (it == files.end())
+      return {{}, SW_FILE_NOT_FOUND};
+    channel.ef = &*it;
+    units = command.p2;
+  } else {
+    units = bigEndian(command.p1 & 0x7F, command.p2);
+  }
+
+  if (!channel.ef)
+    return {{}, SW_NO_CURRENT_EF};
+  size_t offset = units * channel.application->dataUnit;
+  std::span<const BYTE> content = channel.ef->content;
+  if (offset >= content.size())
+    return {{}, SW_WRONG_PARAMETERS};
+
+  std::span<const BYTE> rest = content.subspan(offset);
+  if (!command.extended && rest.size() > SHORT_NE_MAX)
+    rest = rest.first(SHORT_NE_MAX);
+  return respond(command, channel, rest, false);
+}
+
+VirtualCard::Answer VirtualCard::getResponse(const Command &command,
+                                             Channel &channel) {
+  if (channel.pending.empty())
+    return {{}, SW_CONDITIONS_NOT_SATISFIED};
+
+  size_t count = std::min(command.hasLe ? command.ne : SHORT_NE_MAX,
+                          channel.pending.size());
+  m_scratch.assign(channel.pending.begin(), channel.pending.begin() + count);
+  channel.pending.erase(channel.pending.begin(),
+                        channel.pending.begin() + count);
+  if (!channel.pending.empty())
+    return {m_scratch, moreData(channel.pending.size())};
+  return {m_scratch, SW_SUCCESS};
+}
+
+VirtualCard::Answer VirtualCard::manageChannel(const Command &command,
+                                               Channel &channel) {
+  if (command.p1 == 0x00) {
+    BYTE number = command.p2;
+    if (number == 0) {
+      for (BYTE i = 1; i < m_options.channels && !number; i++)
+        if (!m_channels[i].open)
+          number = i;
+      if (number == 0)
+        return {{}, SW_FUNCTION_NOT_SUPPORTED};
+    } else if (number >= m_options.channels || m_channels[number].open) {
+      return {{}, SW_INCORRECT_P1P2};
+    }
+
+    Channel &opened = m_channels[number];
+    opened = Channel();
+    opened.open = true;
+    selectApplication(opened, m_image.applications.front());
+    m_scratch.assign(1, number);
+    return {command.p2 ? std::span<const BYTE>() : m_scratch, SW_SUCCESS};
+  }
+
+  if (command.p1 == 0x80) {
+    BYTE number = command.p2 ? command.p2
+                             : static_cast<BYTE>(&channel - &m_channels[0]);
+    if (number == 0 || number >= m_options.channels)
+      return {{}, SW_INCORRECT_P1P2};
+    if (!m_channels[number].open)
+      return {{}, SW_CHANNEL_NOT_SUPPORTED};
+    m_channels[number] = Channel();
+    return {{}, SW_SUCCESS};
+  }
+  return {{}, SW_INCORRECT_P1P2};
+}
+
+VirtualCard::Answer VirtualCard::fixedResponse(const Command &command,
+                                               Channel &channel) {
+  if (!channel.application)
+    return {{}, SW_INS_NOT_SUPPORTED};
+
+  std::array<BYTE, 4> header = {withChannel(command.cla, 0), command.ins,
+                                command.p1, command.p2};
+  bool knownInstruction = false;
+  for (const FixedResponse &fixed : channel.application->responses) {
+    if (fixed.header == header)
+      return respond(command, channel, fixed.data, true);
+    knownInstruction |= fixed.header[0] == header[0] &&
+                        fixed.header[1] == header[1];
+  }
+  return {{}, knownInstruction ? SW_DATA_NOT_FOUND : SW_INS_NOT_SUPPORTED};
+}
+
+VirtualApplication *VirtualCard::findApplication(std::span<const BYTE> aid) {
+  for (VirtualApplication &application : m_image.applications)
+    if (aidMatches(aid, application.aid))
+      return &application;
+  return nullptr;
+}
+
+void VirtualCard::selectApplication(Channel &channel,
+                                    VirtualApplication &application) {
+  channel.application = &application;
+  channel.dfs.assign(1, &application.mf);
+  channel.ef = nullptr;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "CardImage.hpp"
+#include "transport/Apdu.hpp"
+#include "transport/CardLink.hpp"
+#include "transport/Pcsc.hpp"
+
+/** How a VirtualCard behaves on the wire. */
+struct VirtualCardOptions {
+  // SCARD_PROTOCOL_T0 or SCARD_PROTOCOL_T1
+  DWORD protocol = SCARD_PROTOCOL_T1;
+  // Accept extended-length APDUs; otherwise they are answered 6700.
+  // CardTransport sends them on T=1 unless the image's ATR rules them out.
+  bool extendedLength = false;
+  // Answer 6Cxx to a short Le that does not match, as the MAV4 chips do,
+  // rather than returning what there is with 6282.
+  bool strictLe = true;
+  // Logical channels including the basic one (1 to 20)
+  BYTE channels = 4;
+  // Time spent per command, plus per byte moved in either direction
+  std::chrono::microseconds commandLatency{0};
+  std::chrono::microseconds byteLatency{0};
+};
+
+/**
+ * An in-process card serving a CardImage, for running the readers without a
+ * reader or a card.
+ *
+ * It implements SELECT (P1 00 to 04), READ BINARY, GET RESPONSE and MANAGE
+ * CHANNEL, plus the image's fixed responses. Status words follow what the
+ * chips do: 6A82 for unknown files and applets, 6B00 past the end of an EF,
+ * 6Cxx for a wrong Le and, on T=0, 61xx for case-4 answers.
+ *
+ * Not thread-safe: like a card handle, it serves one transport at a time.
+ */
+class VirtualCard : public CardLink {
+public:
+  explicit VirtualCard(CardImage image, VirtualCardOptions options = {});
+
+  size_t transmit(std::span<const BYTE> command,
+                  std::span<BYTE> response) override;
+  LONG reconnect(DWORD initialization, DWORD &activeProtocol) override;
+  size_t readAtr(std::span<BYTE> atr) override;
+
+  /** Selects the first application on the basic channel, closes the rest. */
+  void reset();
+
+  const CardImage &image() const { return m_image; }
+  const VirtualCardOptions &options() const { return m_options; }
+  DWORD protocol() const { return m_options.protocol; }
+
+  /** Commands received since construction. */
+  uint64_t commandCount() const { return m_commandCount; }
+
+private:
+  struct Channel {
+    bool open = false;
+    VirtualApplication *application = nullptr;
+    std::vector<VirtualFile *> dfs; // MF first, current DF last
+    VirtualFile *ef = nullptr;
+    std::vector<BYTE> pending; // left for GET RESPONSE
+  };
+
+  // The parsed command: Nc bytes of data and Ne expected, 0 if absent
+  struct Command {
+    BYTE cla = 0, ins = 0, p1 = 0, p2 = 0;
+    std::span<const BYTE> data;
+    size_t ne = 0;
+    bool hasLe = false;
+    bool maxLe = false; // Le was 00 (or 0000): as much as there is
+    bool extended = false;
+  };
+
+  // Data and SW of one answer; `data` may be longer than what is sent.
+  struct Answer {
+    std::span<const BYTE> data;
+    StatusWord sw;
+  };
+
+  static std::optional<Command> parse(std::span<const BYTE> apdu);
+  Answer process(const Command &command, BYTE channelNumber);
+  Answer select(const Command &command, Channel &channel);
+  Answer readBinary(const Command &command, Channel &channel);
+  Answer getResponse(const Command &command, Channel &channel);
+  Answer manageChannel(const Command &command, Channel &channel);
+  Answer fixedResponse(const Command &command, Channel &channel);
+
+  // Applies the Le rules to a command's full answer.
+  Answer respond(const Command &command, Channel &channel,
+                 std::span<const BYTE> data, bool exact);
+
+  VirtualApplication *findApplication(std::span<const BYTE> aid);
+  void selectApplication(Channel &channel, VirtualApplication &application);
+
+  CardImage m_image;
+  VirtualCardOptions m_options;
+  std::array<Channel, MAX_LOGICAL_CHANNELS> m_channels;
+  std::vector<BYTE> m_scratch; // data of the answer being sent
+  uint64_t m_commandCount = 0;
+};
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "CardSnapshot.hpp"
+
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "ReadPlanner.hpp"
+#include "backend/CardBackend.hpp"
+#include "transport/TransportError.hpp"
+
+const char *cardObjectName(CardObject object) {
+  switch (object) {
+  case CARD_OBJECT_CSN_CRN:
+    return "CSN/CRN";
+  case CARD_OBJECT_VERSION:
+    return "version";
+  case CARD_OBJECT_DATES:
+    return "dates";
+  case CARD_OBJECT_AFIS:
+    return "AFIS";
+  case CARD_OBJECT_SOD1:
+    return "SOD1";
+  case CARD_OBJECT_PERSONAL_INFO:
+    return "personal info";
+  case CARD_OBJECT_META_FEID:
+    return "meta FEID";
+  case CARD_OBJECT_AUTH_CERTIFICATE:
+    return "auth certificate";
+  case CARD_OBJECT_SIGN_CERTIFICATE:
+    return "sign certificate";
+  default:
+    return "unknown object";
+  }
+}
+
+std::string resetForSnapshot(CardTransport &transport, uint32_t objects,
+                             ChipProfile profile, ResetPolicy policy) {
+  if (profile != ChipProfile::Mav4 || !(objects & CARD_OBJECT_PERSONAL_INFO) ||
+      !transport.needsReset(policy))
+    return {};
+
+  // A reset ends the transaction; take it up again afterwards.
+  bool held = transport.inTransaction();
+  if (held)
+    transport.endTransaction();
+  LONG status = transport.resetIfNeeded(policy);
+  std::string error;
+  if (status != SCARD_S_SUCCESS) {
+    char message[64];
+    snprintf(message, sizeof(message),
+             "personal info: card reset failed, 0x%08lx",
+             static_cast<unsigned long>(status));
+    error = message;
+  }
+  if (held) {
+    status = transport.beginTransaction();
+    if (status != SCARD_S_SUCCESS)
+      throwPcscError("Failed to begin transaction", status);
+  }
+  return error;
+}
+
+CardSnapshot readCardSnapshot(CardTransport &transport, uint32_t objects,
+                              ChipProfile profile, const RetryPolicy &retry,
+                              ResetPolicy resetPolicy) {
+  std::string resetError =
+      resetForSnapshot(transport, objects, profile, resetPolicy);
+
+  CardSnapshot snapshot;
+  snapshot.requested = objects & CARD_OBJECT_ALL;
+  if (!resetError.empty())
+    snapshot.errors.push_back(resetError);
+  auto atr = transport.atr();
+  snapshot.atr.assign(atr.begin(), atr.end());
+
+  ReadPlan plan = planRead(profile, snapshot.requested);
+  for (uint32_t bit = 1; bit & CARD_OBJECT_ALL; bit <<= 1) {
+    if (plan.unsupported & bit)
+      snapshot.errors.push_back(
+          std::string(cardObjectName(static_cast<CardObject>(bit))) +
+          ": not on this chip profile");
+  }
+
+  ExtendedResponseBuffer rx;
+  executePlan(transport, plan, snapshot, rx, retry);
+  return snapshot;
+}
+
+CardSnapshot readCardSnapshot(CardBackend &backend, uint32_t objects,
+                              const char *readerName, ChipProfile profile,
+                              ApduMetrics *metrics,
+                              const RetryPolicy &retry,
+                              ResetPolicy resetPolicy) {
+  std::string reader;
+  if (readerName) {
+    reader = readerName;
+  } else {
+    std::vector<std::string> readers = backend.listReaders();
+    if (readers.empty())
+      throw std::runtime_error("No readers found.");
+    reader = readers.front();
+  }
+
+  CardConnection connection = backend.connect(reader);
+  CardTransport transport(std::move(connection.link),
+                          connection.activeProtocol);
+  transport.setMetrics(metrics);
+
+  CardTransaction transaction(transport);
+  return readCardSnapshot(transport, objects, profile, retry, resetPolicy);
+}
+
+CardSnapshot readCardSnapshot(uint32_t objects, const char *readerName,
+                              ChipProfile profile) {
+  std::unique_ptr<CardBackend> backend = createDefaultBackend();
+  return readCardSnapshot(*backend, objects, readerName, profile);
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "transport/CardTransport.hpp"
+#include "transport/Pcsc.hpp"
+#include "transport/RetryPolicy.hpp"
+
+class CardBackend;
+
+/**
+ * Objects a snapshot can read. Combine them with | to request a subset.
+ */
+enum CardObject : uint32_t {
+  CARD_OBJECT_CSN_CRN = 1u << 0,          // CPLC / tag 0101 (card manager)
+  CARD_OBJECT_VERSION = 1u << 1,          // EF 0601
+  CARD_OBJECT_DATES = 1u << 2,            // EF 0303
+  CARD_OBJECT_AFIS = 1u << 3,             // EF 0302
+  CARD_OBJECT_SOD1 = 1u << 4,             // EF 0205
+  CARD_OBJECT_PERSONAL_INFO = 1u << 5,    // EF 0201
+  CARD_OBJECT_META_FEID = 1u << 6,        // OMID meta FEID (EF 1103)
+  CARD_OBJECT_AUTH_CERTIFICATE = 1u << 7, // IAS EF 5000/5040
+  CARD_OBJECT_SIGN_CERTIFICATE = 1u << 8, // IAS EF 5100/5040
+  CARD_OBJECT_ALL = (1u << 9) - 1,
+};
+
+/** Name of a single object, as used in `CardSnapshot::errors`. */
+const char *cardObjectName(CardObject object);
+
+/** Card families whose file systems the snapshot knows. */
+enum class ChipProfile {
+  Mav4,   // card manager, ID applet A000000018300301, IAS
+  Pardis, // issuer security domain, PARDIS,MATIRAN applet
+  Omid,   // MATIRAN ID CARD applets
+};
+
+/**
+ * Everything read from one card in one session. Buffers hold the raw EF
+ * contents; the per-tool decoders in src/read apply to them unchanged.
+ */
+struct CardSnapshot {
+  uint32_t requested = 0; // CardObject mask passed in
+  uint32_t read = 0;      // objects read successfully
+
+  std::vector<BYTE> atr;
+
+  std::vector<BYTE> cplc;
+  std::vector<BYTE> csn; // MAV4: CPLC offset 0x08, 0x13 bytes
+  std::vector<BYTE> crn; // MAV4: tag 0101 offset 0x10, 3 bytes
+  std::vector<BYTE> version;
+  std::vector<BYTE> dates;
+  std::vector<BYTE> afis;
+  std::vector<BYTE> sod1;
+  std::vector<BYTE> personalInfo;
+  std::vector<BYTE> metaFeid;
+  std::vector<BYTE> authCertificate;
+  std::vector<BYTE> signCertificate;
+
+  // One "<object>: <reason>" line per requested object that failed
+  std::vector<std::string> errors;
+
+  bool has(CardObject object) const { return (read & object) != 0; }
+  bool complete() const { return read == requested; }
+};
+
+/**
+ * Connects to `readerName` (the first reader when null) through `backend`,
+ * holds one transaction and reads `objects` in a single pass planned by
+ * planRead(), so that every application and DF is selected once. A failing
+ * object, or one the profile does not have, is recorded in `errors` and does
+ * not stop the others. With `metrics`, every APDU of the session is timed
+ * into it. A glitch on the link is ridden out with reconnects as `retry`
+ * allows, resuming the object that was being read.
+ *
+ * The MAV4 personal info is read from a reset card: the card is reset once,
+ * before anything else, if `resetPolicy` calls for it; see
+ * resetForSnapshot().
+ *
+ * @throws std::runtime_error if no connection or transaction can be
+ *         established.
+ */
+CardSnapshot readCardSnapshot(CardBackend &backend,
+                              uint32_t objects = CARD_OBJECT_ALL,
+                              const char *readerName = nullptr,
+                              ChipProfile profile = ChipProfile::Mav4,
+                              ApduMetrics *metrics = nullptr,
+                              const RetryPolicy &retry = RetryPolicy(),
+                              ResetPolicy resetPolicy =
+                                  ResetPolicy::WhenUnknown);
+
+/** Same as above through createDefaultBackend(). */
+CardSnapshot readCardSnapshot(uint32_t objects = CARD_OBJECT_ALL,
+                              const char *readerName = nullptr,
+                              ChipProfile profile = ChipProfile::Mav4);
+
+/**
+ * Same as above on an existing connection. The caller owns the transaction,
+ * which resetForSnapshot() ends and begins again if it resets the card.
+ */
+CardSnapshot readCardSnapshot(CardTransport &transport, uint32_t objects,
+                              ChipProfile profile = ChipProfile::Mav4,
+                              const RetryPolicy &retry = RetryPolicy(),
+                              ResetPolicy resetPolicy =
+                                  ResetPolicy::WhenUnknown);
+
+/**
+ * Resets the card if `objects` include the MAV4 personal info, which
+ * Read_PersonalInfo1 reads from a freshly reset card, and `policy` calls
+ * for it. A transaction held on `transport` is ended for the reset, which
+ * would end it anyway, and begun again. Every snapshot read goes through
+ * this, whichever way it reaches the card.
+ *
+ * @return "personal info: card reset failed, ..." for
+ *         CardSnapshot::errors, or an empty string.
+ * @throws std::runtime_error if the transaction cannot be begun again.
+ */
+std::string resetForSnapshot(CardTransport &transport, uint32_t objects,
+                             ChipProfile profile, ResetPolicy policy);
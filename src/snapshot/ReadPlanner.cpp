@@ -0,0 +1,388 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ReadPlanner.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#include "transport/EfReader.hpp"
+#include "transport/RetryPolicy.hpp"
+#include "transport/SelectionCursor.hpp"
+
+namespace {
+
+// MAV4
+const BYTE CARD_MANAGER_AID[] = {0xA0, 0x00, 0x00, 0x00,
+                                 0x18, 0x43, 0x4D, 0x00};
+// A000000018300301, zero-padded to 16 bytes as the MAV4 tools send it
+const BYTE ID_AID[] = {0xA0, 0x00, 0x00, 0x00, 0x18, 0x30, 0x03, 0x01,
+                       0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+const BYTE IAS_AID[] = {0xA0, 0x00, 0x00, 0x00, 0x18, 0x0C,
+                        0x00, 0x00, 0x01, 0x63, 0x42, 0x00};
+
+const BYTE GET_CPLC[] = {0x80, 0xCA, 0x9F, 0x7F, 0x2D};
+const BYTE GET_TAG0101[] = {0x80, 0xCA, 0x01, 0x01, 0x15};
+
+const uint16_t ID_DF_0200[] = {FID_MF, 0x0200};
+const uint16_t ID_DF_0300[] = {FID_MF, 0x0300};
+const uint16_t ID_DF_0600[] = {FID_MF, 0x0600};
+const uint16_t IAS_DF_5000[] = {FID_MF, 0x5000};
+const uint16_t IAS_DF_5100[] = {FID_MF, 0x5100};
+
+// Pardis
+const BYTE PARDIS_ISD_AID[] = {0xA0, 0x00, 0x00, 0x00,
+                               0x03, 0x00, 0x00, 0x00};
+// "PARDIS,MATIRAN "
+const BYTE PARDIS_AID[] = {0x50, 0x41, 0x52, 0x44, 0x49, 0x53, 0x2C, 0x4D,
+                           0x41, 0x54, 0x49, 0x52, 0x41, 0x4E, 0x20};
+const BYTE PARDIS_GET_CPLC[] = {0x80, 0xCA, 0x9F, 0x7F, 0x00};
+const BYTE PARDIS_GET_CSN[] = {0x90, 0x38, 0x00, 0x00, 0x0C};
+
+const uint16_t PARDIS_DF_5100[] = {FID_MF, 0x5100};
+
+// OMID meta FEID sequence, as in omid_read_meta_feid
+const BYTE SELECT_OMID_AID[] = {0x00, 0xA4, 0x04, 0x00, 0x10, 0x4D, 0x41,
+                                0x54, 0x49, 0x52, 0x41, 0x4E, 0x20, 0x49,
+                                0x44, 0x20, 0x43, 0x41, 0x52, 0x44, 0x20,
+                                0x00};
+const BYTE SELECT_OMID_FEID_AID[] = {0x00, 0xA4, 0x04, 0x00, 0x0F, 0x39,
+                                     0x8D, 0xE5, 0xBA, 0xB4, 0x1E, 0xC6,
+                                     0x76, 0xCA, 0xBD, 0xB5, 0x26, 0xE5,
+                                     0x85, 0x71, 0x00};
+const BYTE SELECT_OMID_PARENT[] = {0x00, 0xA4, 0x03, 0x00, 0x00};
+const BYTE SELECT_OMID_DF_1100[] = {0x00, 0xA4, 0x00, 0x00,
+                                    0x02, 0x11, 0x00, 0x00};
+const BYTE SELECT_OMID_EF_1103[] = {0x00, 0xA4, 0x00, 0x00,
+                                    0x02, 0x11, 0x03, 0x00};
+const BYTE READ_META_FEID[] = {0x00, 0xB0, 0x00, 0x00, 0x38};
+
+struct DataCommand {
+  std::span<const BYTE> apdu;
+  std::vector<BYTE> CardSnapshot::*target; // null: a SELECT to pass through
+  size_t offset = 0;
+  size_t length = SIZE_MAX;
+};
+
+struct ObjectSource {
+  CardObject object;
+  FilePath path; // the EF, or the application the commands are sent to
+  std::vector<BYTE> CardSnapshot::*target; // EF contents
+  size_t shortChunk;                       // Le the single-object tool used
+  std::span<const DataCommand> commands;
+};
+
+struct Profile {
+  std::span<const ObjectSource> objects;
+  void (*derive)(CardSnapshot &snapshot); // fills CSN/CRN from what was read
+};
+
+std::vector<BYTE> slice(std::span<const BYTE> data, size_t offset,
+                        size_t length) {
+  if (offset >= data.size())
+    return {};
+  length = std::min(length, data.size() - offset);
+  auto first = data.begin() + offset;
+  return std::vector<BYTE>(first, first + length);
+}
+
+const DataCommand MAV4_CSN_CRN[] = {
+    {GET_CPLC, &CardSnapshot::cplc},
+    {GET_TAG0101, &CardSnapshot::crn, 0x10, 0x03},
+};
+
+const ObjectSource MAV4_OBJECTS[] = {
+    {CARD_OBJECT_CSN_CRN, {CARD_MANAGER_AID, {}, std::nullopt}, nullptr, 0,
+     MAV4_CSN_CRN},
+    {CARD_OBJECT_SOD1, {ID_AID, ID_DF_0200, 0x0205}, &CardSnapshot::sod1,
+     0xEC, {}},
+    {CARD_OBJECT_PERSONAL_INFO, {ID_AID, ID_DF_0200, 0x0201},
+     &CardSnapshot::personalInfo, 0xF4, {}},
+    {CARD_OBJECT_DATES, {ID_AID, ID_DF_0300, 0x0303}, &CardSnapshot::dates,
+     0xF8, {}},
+    {CARD_OBJECT_AFIS, {ID_AID, ID_DF_0300, 0x0302}, &CardSnapshot::afis,
+     0xF8, {}},
+    {CARD_OBJECT_VERSION, {ID_AID, ID_DF_0600, 0x0601},
+     &CardSnapshot::version, 0xF8, {}},
+    {CARD_OBJECT_AUTH_CERTIFICATE, {IAS_AID, IAS_DF_5000, 0x5040, 0x00},
+     &CardSnapshot::authCertificate, 0xFE, {}},
+    {CARD_OBJECT_SIGN_CERTIFICATE, {IAS_AID, IAS_DF_5100, 0x5040, 0x00},
+     &CardSnapshot::signCertificate, SHORT_READ_CHUNK, {}},
+};
+
+void deriveMav4(CardSnapshot &snapshot) {
+  snapshot.csn = slice(snapshot.cplc, 0x08, 0x13);
+}
+
+// The card answers GET CPLC with 61xx; the transport chains GET RESPONSE.
+const DataCommand PARDIS_CSN_CRN[] = {
+    {PARDIS_GET_CPLC, &CardSnapshot::cplc},
+    {PARDIS_GET_CSN, &CardSnapshot::csn},
+};
+
+const ObjectSource PARDIS_OBJECTS[] = {
+    {CARD_OBJECT_CSN_CRN, {PARDIS_ISD_AID, {}, std::nullopt}, nullptr, 0,
+     PARDIS_CSN_CRN},
+    {CARD_OBJECT_SIGN_CERTIFICATE,
+     {PARDIS_AID, PARDIS_DF_5100, 0x5040, 0x00, 0x00},
+     &CardSnapshot::signCertificate, 0xF8, {}},
+};
+
+void derivePardis(CardSnapshot &snapshot) {
+  snapshot.crn = slice(snapshot.cplc, 24, 2);
+  std::vector<BYTE> rest = slice(snapshot.cplc, 37, 8);
+  snapshot.crn.insert(snapshot.crn.end(), rest.begin(), rest.end());
+}
+
+// The sequence climbs out of the FEID applet with P1=03, which the
+// selection cursor cannot follow, so it is kept as sent by the tool.
+const DataCommand OMID_META_FEID[] = {
+    {SELECT_OMID_AID, nullptr},     {SELECT_OMID_FEID_AID, nullptr},
+    {SELECT_OMID_PARENT, nullptr},  {SELECT_OMID_DF_1100, nullptr},
+    {SELECT_OMID_EF_1103, nullptr}, {READ_META_FEID, &CardSnapshot::metaFeid},
+};
+
+const ObjectSource OMID_OBJECTS[] = {
+    {CARD_OBJECT_META_FEID, {{}, {}, std::nullopt}, nullptr, 0,
+     OMID_META_FEID},
+};
+
+const Profile &profileOf(ChipProfile profile) {
+  static const Profile MAV4{MAV4_OBJECTS, deriveMav4};
+  static const Profile PARDIS{PARDIS_OBJECTS, derivePardis};
+  static const Profile OMID{OMID_OBJECTS, nullptr};
+  switch (profile) {
+  case ChipProfile::Mav4:
+    return MAV4;
+  case ChipProfile::Pardis:
+    return PARDIS;
+  case ChipProfile::Omid:
+    return OMID;
+  }
+  throw std::invalid_argument("Unknown chip profile");
+}
+
+void recordError(CardSnapshot &snapshot, CardObject object,
+                 const char *reason) {
+  snapshot.errors.push_back(std::string(cardObjectName(object)) + ": " +
+                            reason);
+}
+
+void recordStatus(CardSnapshot &snapshot, CardObject object, StatusWord sw) {
+  char reason[16];
+  snprintf(reason, sizeof(reason), "SW %04X", sw.value());
+  recordError(snapshot, object, reason);
+}
+
+// Sends the steps of one object. Returns false at the first one that fails.
+// With `resume`, an EF keeps the bytes a previous attempt read.
+bool sendSteps(CardTransport &transport, std::span<const PlanStep> steps,
+               CardSnapshot &snapshot, std::span<BYTE> rx, bool resume) {
+  CardObject object = steps.front().object;
+  for (const PlanStep &step : steps) {
+    if (step.kind == PlanStepKind::ReadEf) {
+      std::vector<BYTE> &target = snapshot.*step.target;
+      StatusWord sw =
+          resume ? resumeEf(transport, step.apdu, target, rx, step.shortChunk)
+                 : readEf(transport, step.apdu, target, rx, step.shortChunk);
+      if (!readCompleted(sw) || target.empty()) {
+        recordStatus(snapshot, object, sw);
+        return false;
+      }
+      continue;
+    }
+
+    ApduResponse response = transport.transmit(step.apdu, rx);
+    if (!response.sw.isSuccess()) {
+      recordStatus(snapshot, object, response.sw);
+      return false;
+    }
+    if (step.kind == PlanStepKind::Command)
+      snapshot.*step.target = slice(response.data, step.offset, step.length);
+  }
+  return true;
+}
+
+// sendSteps() that reconnects after a transport failure as `retry` allows.
+// The reconnect loses the selection, so the object is then planned again
+// from its application down, and an EF read resumes where it stopped.
+bool runSteps(CardTransport &transport, std::span<const PlanStep> steps,
+              CardSnapshot &snapshot, std::span<BYTE> rx, ChipProfile profile,
+              const RetryPolicy &retry) {
+  CardObject object = steps.front().object;
+  ReadPlan replanned;
+  for (unsigned attempt = 1;; attempt++) {
+    try {
+      return sendSteps(transport, steps, snapshot, rx, attempt > 1);
+    } catch (const TransportError &e) {
+      if (!recoverTransport(transport, retry, e, attempt)) {
+        recordError(snapshot, object, e.what());
+        return false;
+      }
+      replanned = planRead(profile, object);
+      steps = replanned.steps;
+    } catch (const std::exception &e) {
+      recordError(snapshot, object, e.what());
+      return false;
+    }
+  }
+}
+
+void runPlan(CardTransport &transport, const ReadPlan &plan,
+             CardSnapshot &snapshot, std::span<BYTE> rx,
+             const RetryPolicy &retry) {
+  std::span<const PlanStep> steps = plan.steps;
+  while (!steps.empty()) {
+    CardObject object = steps.front().object;
+    size_t count = 1;
+    while (count < steps.size() && steps[count].object == object)
+      count++;
+
+    uint32_t generation = transport.generation();
+    bool ok = runSteps(transport, steps.first(count), snapshot, rx,
+                       plan.profile, retry);
+    steps = steps.subspan(count);
+    if (ok)
+      snapshot.read |= object;
+    // Let other processes in if the transaction has been held long enough.
+    bool yielded = !steps.empty() && transport.yieldTransaction();
+    if (ok && !yielded && generation == transport.generation())
+      continue;
+
+    // The selection is unknown now, after a failure, a reconnect or another
+    // process's turn; plan what is left from scratch.
+    uint32_t rest = 0;
+    for (const PlanStep &step : steps)
+      rest |= step.object;
+    if (rest)
+      runPlan(transport, planRead(plan.profile, rest), snapshot, rx, retry);
+    return;
+  }
+}
+
+bool isSelect(const PlanStep &step) {
+  return step.apdu.size() >= 4 && step.apdu[1] == 0xA4;
+}
+
+} // namespace
+
+std::optional<ChipProfile> chipProfileFromType(uint16_t chipType) {
+  switch (chipType) {
+  case 0x0004:
+    return ChipProfile::Mav4;
+  case 0x0101:
+    return ChipProfile::Pardis;
+  case 0x0102:
+    return ChipProfile::Omid;
+  default:
+    return std::nullopt;
+  }
+}
+
+size_t ReadPlan::selectCount() const {
+  return std::count_if(steps.begin(), steps.end(), isSelect);
+}
+
+size_t ReadPlan::applicationCount() const {
+  return std::count_if(steps.begin(), steps.end(), [](const PlanStep &step) {
+    return isSelect(step) && step.apdu[2] == 0x04;
+  });
+}
+
+ReadPlan planRead(ChipProfile profile, uint32_t objects) {
+  ReadPlan plan;
+  plan.profile = profile;
+  objects &= CARD_OBJECT_ALL;
+
+  std::span<const ObjectSource> sources = profileOf(profile).objects;
+  std::vector<const ObjectSource *> order;
+  for (const ObjectSource &source : sources) {
+    if (objects & source.object) {
+      order.push_back(&source);
+      plan.objects |= source.object;
+    }
+  }
+  plan.unsupported = objects & ~plan.objects;
+
+  // Applications in the order the profile lists them; raw sequences, which
+  // leave the selection unknown, go last.
+  auto applicationRank = [&](const ObjectSource *source) {
+    size_t rank = 0;
+    if (source->path.aid.empty())
+      return sources.size();
+    while (!std::ranges::equal(sources[rank].path.aid, source->path.aid))
+      rank++;
+    return rank;
+  };
+  // Inside an application, DFs in FID order so that each is entered once,
+  // after the commands that need no DF at all.
+  std::stable_sort(order.begin(), order.end(),
+                   [&](const ObjectSource *a, const ObjectSource *b) {
+                     size_t rankA = applicationRank(a);
+                     size_t rankB = applicationRank(b);
+                     if (rankA != rankB)
+                       return rankA < rankB;
+                     if (!std::ranges::equal(a->path.dfs, b->path.dfs))
+                       return std::ranges::lexicographical_compare(
+                           a->path.dfs, b->path.dfs);
+                     return a->path.ef.value_or(0) < b->path.ef.value_or(0);
+                   });
+
+  // Replay the order on a cursor that starts with nothing selected, keeping
+  // only the SELECTs it cannot elide.
+  SelectionCursor cursor;
+  std::vector<std::vector<BYTE>> selects;
+  for (const ObjectSource *source : order) {
+    bool readsEf = source->path.ef.has_value();
+    selects.clear();
+    cursor.plan(source->path, readsEf, selects);
+    for (size_t i = 0; i < selects.size(); i++) {
+      PlanStep step{PlanStepKind::Select, source->object,
+                    std::move(selects[i])};
+      if (readsEf && i + 1 == selects.size()) {
+        step.kind = PlanStepKind::ReadEf;
+        step.target = source->target;
+        step.shortChunk = source->shortChunk;
+      }
+      plan.steps.push_back(std::move(step));
+    }
+
+    for (const DataCommand &command : source->commands) {
+      cursor.observe(command.apdu, SW_SUCCESS);
+      plan.steps.push_back(
+          {command.target ? PlanStepKind::Command : PlanStepKind::Select,
+           source->object,
+           {command.apdu.begin(), command.apdu.end()},
+           command.target,
+           command.offset,
+           command.length});
+    }
+  }
+  return plan;
+}
+
+void executePlan(CardTransport &transport, const ReadPlan &plan,
+                 CardSnapshot &snapshot, std::span<BYTE> rx,
+                 const RetryPolicy &retry) {
+  runPlan(transport, plan, snapshot, rx, retry);
+
+  auto derive = profileOf(plan.profile).derive;
+  if (derive && snapshot.has(CARD_OBJECT_CSN_CRN))
+    derive(snapshot);
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "CardSnapshot.hpp"
+#include "transport/CardTransport.hpp"
+#include "transport/Pcsc.hpp"
+#include "transport/ReadBinary.hpp"
+#include "transport/RetryPolicy.hpp"
+
+/**
+ * Maps a chip type from the card info (docs/Report.md) to a profile:
+ * 0004 MAV4, 0101 Pardis, 0102 OMID. MAV2/MAV3 have no profile yet.
+ */
+std::optional<ChipProfile> chipProfileFromType(uint16_t chipType);
+
+enum class PlanStepKind {
+  Select,  // must succeed before the object's next step
+  Command, // data command; its response data goes to `target`
+  ReadEf,  // final SELECT of an EF, which is then read into `target`
+};
+
+/** One APDU of a read plan, sent on behalf of `object`. */
+struct PlanStep {
+  PlanStepKind kind;
+  CardObject object;
+  std::vector<BYTE> apdu;
+  std::vector<BYTE> CardSnapshot::*target = nullptr;
+  // Command: the part of the response data kept in `target`
+  size_t offset = 0;
+  size_t length = SIZE_MAX;
+  size_t shortChunk = SHORT_READ_CHUNK; // ReadEf: Le of short reads
+};
+
+/**
+ * The APDUs that read a set of objects from one chip profile, in the order
+ * they are sent. READ BINARYs are not listed since their number depends on
+ * the EF sizes the card reports.
+ *
+ * A plan assumes nothing is selected when it starts, so one plan can be
+ * executed on every card of a batch.
+ */
+struct ReadPlan {
+  ChipProfile profile = ChipProfile::Mav4;
+  uint32_t objects = 0;     // requested objects the plan reads
+  uint32_t unsupported = 0; // requested objects the profile does not have
+  std::vector<PlanStep> steps;
+
+  /** SELECTs sent when every step succeeds. */
+  size_t selectCount() const;
+  /** Of those, SELECTs of an application by AID. */
+  size_t applicationCount() const;
+};
+
+/**
+ * Orders `objects` so that each application is selected once and each DF
+ * once inside it, with data commands before any DF is entered, and works
+ * out the SELECTs that remain with the transport's selection cursor rules.
+ */
+ReadPlan planRead(ChipProfile profile, uint32_t objects);
+
+/**
+ * Sends `plan` and stores what it reads in `snapshot`. An object whose step
+ * fails is recorded in `snapshot.errors`; as the selection is then unknown,
+ * the objects after it are planned again from scratch.
+ *
+ * A transport failure `retry` allows for is followed by a reconnect, and the
+ * object is read again from its application down; an EF that was being read
+ * continues from the last offset that came back. Between objects the
+ * transaction is yielded once held past the transport's hold time.
+ */
+void executePlan(CardTransport &transport, const ReadPlan &plan,
+                 CardSnapshot &snapshot, std::span<BYTE> rx,
+                 const RetryPolicy &retry = RetryPolicy());
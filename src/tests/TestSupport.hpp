@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * Helpers shared by the test programs: failure counting, file reading and
+ * the location of the fixtures next to the tests.
+ */
+
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "transport/Pcsc.hpp"
+
+/** Number of failed check()s; main() returns failure if it is not zero. */
+inline int failures = 0;
+
+inline void check(bool condition, const std::string &what) {
+  if (condition)
+    return;
+  failures++;
+  std::cerr << "FAIL " << what << std::endl;
+}
+
+inline std::vector<BYTE> readFile(const std::filesystem::path &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    throw std::runtime_error("Cannot read " + path.string());
+  return {std::istreambuf_iterator<char>(file),
+          std::istreambuf_iterator<char>()};
+}
+
+/**
+ * `relative` to the directory holding the test sources, as the compiler
+ * found it: from a build that compiles with relative paths this only works
+ * in the build's own working directory.
+ */
+inline std::filesystem::path testPath(const std::filesystem::path &relative) {
+  std::filesystem::path here = std::filesystem::absolute(__FILE__);
+  return (here.parent_path() / relative).lexically_normal();
+}
+
+/** @throws std::runtime_error naming `dir` if it is not a directory. */
+inline void requireDirectory(const std::filesystem::path &dir) {
+  if (!std::filesystem::is_directory(dir))
+    throw std::runtime_error("No fixture directory " + dir.string() +
+                             "; run from where the test was built or pass "
+                             "the directory as an argument");
+}
@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * Checks CertificateView on the card certificate in tests/x509 (fields,
+ * Name attributes and extensions), its rejection of truncated and
+ * corrupted DER, and derTimeToUnix() on UTCTime around the 1950/2049
+ * window and on GeneralizedTime.
+ *
+ * Usage: certificate_view_test [<fixture dir>]
+ *
+ * The default is tests/x509 of the source tree, located by testPath().
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "TestSupport.hpp"
+#include "x509/CertificateView.hpp"
+#include "x509/Digest.hpp"
+
+namespace {
+
+const BYTE OID_SUBJECT_KEY_ID[] = {0x55, 0x1D, 0x0E};
+const BYTE OID_KEY_USAGE[] = {0x55, 0x1D, 0x0F};
+const BYTE OID_SUBJECT_ALT_NAME[] = {0x55, 0x1D, 0x11};
+const BYTE OID_BASIC_CONSTRAINTS[] = {0x55, 0x1D, 0x13};
+const BYTE OID_SHA256_WITH_RSA[] = {0x2A, 0x86, 0x48, 0x86, 0xF7,
+                                    0x0D, 0x01, 0x01, 0x0B};
+const BYTE OID_RSA_ENCRYPTION[] = {0x2A, 0x86, 0x48, 0x86, 0xF7,
+                                   0x0D, 0x01, 0x01, 0x01};
+
+constexpr BYTE TAG_UTC_TIME = 0x17;
+constexpr BYTE TAG_GENERALIZED_TIME = 0x18;
+
+bool equals(std::span<const BYTE> bytes, std::string_view text) {
+  return std::ranges::equal(bytes, text, [](BYTE b, char c) {
+    return b == static_cast<BYTE>(c);
+  });
+}
+
+template <size_t N> bool equals(std::span<const BYTE> a, const BYTE (&b)[N]) {
+  return std::ranges::equal(a, b);
+}
+
+// A whole DER time object
+std::vector<BYTE> timeObject(BYTE tag, std::string_view text) {
+  std::vector<BYTE> der{tag, static_cast<BYTE>(text.size())};
+  der.insert(der.end(), text.begin(), text.end());
+  return der;
+}
+
+void checkTime(BYTE tag, std::string_view text,
+               std::optional<int64_t> expected) {
+  std::optional<int64_t> seconds = derTimeToUnix(timeObject(tag, text));
+  check(seconds == expected,
+        std::string(text) + ": " +
+            (seconds ? std::to_string(*seconds) : "rejected") + ", expected " +
+            (expected ? std::to_string(*expected) : "rejected"));
+}
+
+void testDerTime() {
+  // UTCTime years 50-99 are 19xx, 00-49 20xx (RFC 5280 4.1.2.5.1)
+  checkTime(TAG_UTC_TIME, "491231235959Z", 2524607999);
+  checkTime(TAG_UTC_TIME, "500101000000Z", -631152000);
+  checkTime(TAG_UTC_TIME, "700101000000Z", 0);
+  checkTime(TAG_UTC_TIME, "250101000000Z", 1735689600);
+  checkTime(TAG_UTC_TIME, "991231235959Z", 946684799);
+
+  // GeneralizedTime carries the century; used from 2050 on
+  checkTime(TAG_GENERALIZED_TIME, "20500101000000Z", 2524608000);
+  checkTime(TAG_GENERALIZED_TIME, "19491231235959Z", -631152001);
+  checkTime(TAG_GENERALIZED_TIME, "20240229120000Z", 1709208000);
+  checkTime(TAG_GENERALIZED_TIME, "20250101000000Z", 1735689600);
+
+  checkTime(TAG_UTC_TIME, "20250101000000Z", std::nullopt); // 4-digit year
+  checkTime(TAG_GENERALIZED_TIME, "250101000000Z", std::nullopt);
+  checkTime(TAG_UTC_TIME, "251301000000Z", std::nullopt); // month 13
+  checkTime(TAG_UTC_TIME, "250100000000Z", std::nullopt); // day 0
+  checkTime(TAG_UTC_TIME, "250101240000Z", std::nullopt); // hour 24
+  checkTime(TAG_UTC_TIME, "2501010000001", std::nullopt); // no Z
+  checkTime(TAG_UTC_TIME, "25010100000aZ", std::nullopt);
+  checkTime(TAG_GENERALIZED_TIME, "20250101000000.5Z", std::nullopt);
+  checkTime(0x04, "250101000000Z", std::nullopt); // OCTET STRING
+
+  std::vector<BYTE> cut = timeObject(TAG_UTC_TIME, "250101000000Z");
+  cut.pop_back();
+  check(!derTimeToUnix(cut), "time shorter than its length");
+  check(!derTimeToUnix({}), "empty time");
+}
+
+void testFields(const std::vector<BYTE> &card) {
+  CertificateView view(card);
+  check(view.valid(), "card certificate parses");
+  check(view.der().size() == card.size(), "der() covers the certificate");
+  check(view.tbs().data() == card.data() + 4 && view.tbs().front() == 0x30,
+        "tbs() follows the outer header");
+  check(equals(view.serialNumber(), {0x10, 0x02}), "serial number");
+
+  check(equals(view.commonName(), "Ali Testi"), "CN");
+  check(equals(view.surname(), "Testi"), "SN");
+  check(equals(view.givenName(), "Ali"), "G");
+  check(equals(view.subjectAttribute(OID_SERIAL_NUMBER), "0012345678"),
+        "serialNumber attribute");
+  check(equals(view.issuerAttribute(OID_COMMON_NAME),
+               "Test Governmental Intermediate CA-G3"),
+        "issuer CN");
+  check(view.issuerAttribute(OID_SURNAME).empty(), "issuer has no SN");
+
+  check(derTimeToUnix(view.notBefore()) == 1735689600, "notBefore");
+  check(derTimeToUnix(view.notAfter()) == 1861920000, "notAfter");
+
+  check(equals(view.publicKeyAlgorithm(), OID_RSA_ENCRYPTION),
+        "key algorithm");
+  check(!view.publicKey().empty() && view.publicKey().front() == 0x30,
+        "RSAPublicKey inside the BIT STRING");
+  check(equals(view.signatureAlgorithm(), OID_SHA256_WITH_RSA),
+        "signature algorithm");
+  check(view.signature().size() == 256, "2048-bit signature");
+  check(view.signature().data() + view.signature().size() ==
+            card.data() + card.size(),
+        "signature ends the certificate");
+
+  // Anything after the certificate is not part of it
+  std::vector<BYTE> padded = card;
+  padded.insert(padded.end(), {0x90, 0x00});
+  CertificateView trailing(padded);
+  check(trailing.valid() && trailing.der().size() == card.size(),
+        "trailing bytes left out");
+}
+
+void testExtensions(const std::vector<BYTE> &card) {
+  CertificateView view(card);
+  bool critical = false;
+
+  std::span<const BYTE> constraints =
+      view.extension(OID_BASIC_CONSTRAINTS, &critical);
+  check(equals(constraints, {0x30, 0x00}) && critical,
+        "basicConstraints, cA false by default, critical");
+
+  critical = false;
+  check(equals(view.extension(OID_KEY_USAGE, &critical),
+               {0x03, 0x02, 0x06, 0xC0}) &&
+            critical,
+        "keyUsage digitalSignature and nonRepudiation, critical");
+
+  // Method 1 of RFC 5280 4.2.1.2: SHA-1 of the subjectPublicKey bits
+  critical = true;
+  std::span<const BYTE> keyId = view.extension(OID_SUBJECT_KEY_ID, &critical);
+  Sha1Digest digest = sha1(view.publicKey());
+  check(keyId.size() == 22 && keyId[0] == 0x04 && keyId[1] == 20 &&
+            std::ranges::equal(keyId.subspan(2), digest),
+        "subjectKeyIdentifier");
+  check(!critical, "subjectKeyIdentifier not critical");
+
+  critical = true;
+  check(view.extension(OID_SUBJECT_ALT_NAME, &critical).empty(),
+        "absent extension");
+  check(critical, "absent extension leaves the flag alone");
+  check(view.extension(OID_KEY_USAGE).size() == 4, "flag pointer optional");
+}
+
+void testTruncated(const std::vector<BYTE> &card) {
+  for (size_t length = 0; length < card.size(); length++) {
+    std::vector<BYTE> cut(card.begin(), card.begin() + length);
+    CertificateView view(cut);
+    if (view.valid() || !view.der().empty() || !view.subject().empty() ||
+        !view.extension(OID_KEY_USAGE).empty()) {
+      check(false, "accepted " + std::to_string(length) + " of " +
+                       std::to_string(card.size()) + " bytes");
+      break;
+    }
+  }
+
+  // The outer length claims a byte more than there is
+  std::vector<BYTE> longer = card;
+  longer[3]++;
+  check(!CertificateView(longer).valid(), "outer length past the end");
+
+  // The TBSCertificate runs into the signature algorithm
+  std::vector<BYTE> overlapping = card;
+  overlapping[7]++;
+  check(!CertificateView(overlapping).valid(), "TBS length too long");
+
+  std::vector<BYTE> notSequence = card;
+  notSequence[0] = 0x31;
+  check(!CertificateView(notSequence).valid(), "outer SET");
+  check(!CertificateView().valid(), "empty view");
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::filesystem::path fixtures = argc > 1 ? argv[1] : testPath("x509");
+
+  try {
+    requireDirectory(fixtures);
+    std::vector<BYTE> card = readFile(fixtures / "card.der");
+    testDerTime();
+    testFields(card);
+    testExtensions(card);
+    testTruncated(card);
+  } catch (const std::exception &e) {
+    check(false, std::string("unexpected exception: ") + e.what());
+  }
+
+  if (failures) {
+    std::cerr << failures << " failures" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "certificate view: all passed" << std::endl;
+  return EXIT_SUCCESS;
+}
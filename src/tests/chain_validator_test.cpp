@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * Checks ChainValidator on the certificates in tests/x509 (see
+ * make_fixtures.sh there): a card certificate under a G3-style intermediate,
+ * tampered and forged signatures, an unknown issuer, validity periods of the
+ * certificate and of its CA, and the result cache. With the national
+ * anchors at hand it also checks that their roots and intermediates link.
+ *
+ * Usage: chain_validator_test [<fixture dir>] [<anchor dir>]
+ *
+ * The defaults are tests/x509 and assets/iran_root_certificates of the
+ * source tree, located by testPath().
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "TestSupport.hpp"
+#include "x509/ChainValidator.hpp"
+
+namespace {
+
+// Seconds since the epoch, UTC
+constexpr int64_t JUN_2024 = 1717200000;
+constexpr int64_t JAN_2026 = 1767225600;
+constexpr int64_t JAN_2027 = 1798761600;
+constexpr int64_t JAN_2029 = 1861920000; // card.der notAfter
+constexpr int64_t JAN_2030 = 1893456000;
+constexpr int64_t JAN_2031 = 1924992000; // intermediate notAfter
+constexpr int64_t JAN_2032 = 1956528000;
+
+void checkStatus(const ChainResult &result, ChainStatus expected,
+                 const std::string &what) {
+  check(result.status == expected,
+        what + ": " + chainStatusName(result.status) + ", expected " +
+            chainStatusName(expected));
+}
+
+void testAnchors(const ChainValidator &validator) {
+  const auto &anchors = validator.anchors();
+  check(anchors.size() == 2, "two anchors kept");
+  if (anchors.size() != 2)
+    return;
+  const TrustAnchor &root = *anchors[0];
+  const TrustAnchor &intermediate = *anchors[1];
+  check(root.issuer == nullptr, "root has no issuer");
+  check(intermediate.issuer == &root, "intermediate linked to the root");
+  check(intermediate.pathAllowance == 0, "pathlen 0 kept");
+  check(intermediate.validUntil == JAN_2031,
+        "intermediate validity ends with its own");
+}
+
+void testValidCard(const ChainValidator &validator,
+                   const std::vector<BYTE> &card) {
+  ChainResult result = validator.validate(card, JAN_2026);
+  checkStatus(result, ChainStatus::Valid, "card in 2026");
+  check(!result.cached, "first validation is not cached");
+  check(result.issuer == validator.anchors().back().get(),
+        "card issued by the intermediate");
+  check(result.issuer && result.issuer->issuer == validator.anchors()[0].get(),
+        "issuer path ends at the root");
+
+  checkStatus(validator.validate(card, JAN_2029), ChainStatus::Valid,
+              "card on its last second");
+}
+
+void testTampered(const ChainValidator &validator,
+                  const std::vector<BYTE> &card,
+                  const std::vector<BYTE> &forged) {
+  std::vector<BYTE> badSignature = card;
+  badSignature.back() ^= 0x01;
+  checkStatus(validator.validate(badSignature, JAN_2026),
+              ChainStatus::BadSignature, "flipped signature bit");
+
+  // A byte of the subject CN, which is inside the signed part
+  std::vector<BYTE> badContent = card;
+  std::string name = "Ali Testi";
+  auto at = std::search(badContent.begin(), badContent.end(), name.begin(),
+                        name.end());
+  check(at != badContent.end(), "subject CN found");
+  if (at != badContent.end()) {
+    *at = 'E';
+    checkStatus(validator.validate(badContent, JAN_2026),
+                ChainStatus::BadSignature, "changed subject");
+  }
+
+  checkStatus(validator.validate(forged, JAN_2026), ChainStatus::BadSignature,
+              "issuer name right, key wrong");
+}
+
+void testValidity(const ChainValidator &validator,
+                  const std::vector<BYTE> &card,
+                  const std::vector<BYTE> &outlivesCa) {
+  checkStatus(validator.validate(card, JUN_2024), ChainStatus::NotYetValid,
+              "card before notBefore");
+  checkStatus(validator.validate(card, JAN_2029 + 1), ChainStatus::Expired,
+              "card after notAfter");
+
+  checkStatus(validator.validate(outlivesCa, JAN_2027),
+              ChainStatus::NotYetValid, "second card before notBefore");
+  checkStatus(validator.validate(outlivesCa, JAN_2030), ChainStatus::Valid,
+              "second card in 2030");
+  checkStatus(validator.validate(outlivesCa, JAN_2032), ChainStatus::Expired,
+              "second card after its CA expired");
+}
+
+void testCache(ChainValidator &validator, const std::vector<BYTE> &card,
+               const std::vector<BYTE> &forged) {
+  validator.clearCache();
+  check(validator.cachedCount() == 0, "cache cleared");
+
+  ChainResult first = validator.validate(card, JAN_2026);
+  checkStatus(first, ChainStatus::Valid, "uncached");
+  check(!first.cached && validator.cachedCount() == 1, "result cached");
+
+  ChainResult second = validator.validate(card, JAN_2027);
+  checkStatus(second, ChainStatus::Valid, "cached");
+  check(second.cached, "cache hit");
+  check(second.issuer == first.issuer, "cached issuer");
+
+  // Outside the cached period the certificate is checked again
+  ChainResult expired = validator.validate(card, JAN_2030);
+  checkStatus(expired, ChainStatus::Expired, "cached, later expired");
+  check(!expired.cached, "no cache hit after the cached period");
+  ChainResult early = validator.validate(card, JUN_2024);
+  checkStatus(early, ChainStatus::NotYetValid, "cached, earlier");
+  check(!early.cached, "no cache hit before the cached period");
+
+  validator.validate(forged, JAN_2026);
+  check(!validator.validate(forged, JAN_2026).cached &&
+            validator.cachedCount() == 1,
+        "failures not cached");
+
+  validator.clearCache();
+  check(!validator.validate(card, JAN_2026).cached, "miss after clearCache");
+}
+
+void testMalformed(const ChainValidator &validator,
+                   const std::vector<BYTE> &card,
+                   const std::vector<BYTE> &stranger) {
+  checkStatus(validator.validate(stranger, JAN_2026),
+              ChainStatus::UnknownIssuer, "issuer not an anchor");
+
+  std::vector<BYTE> truncated(card.begin(), card.end() - 1);
+  checkStatus(validator.validate(truncated, JAN_2026), ChainStatus::Malformed,
+              "truncated certificate");
+  checkStatus(validator.validate(std::vector<BYTE>(), JAN_2026),
+              ChainStatus::Malformed, "empty input");
+}
+
+// The national roots and intermediates load and link
+void testNationalAnchors(const std::filesystem::path &directory) {
+  ChainValidator validator(directory);
+  size_t roots = 0, intermediates = 0;
+  for (const auto &anchor : validator.anchors())
+    (anchor->issuer ? intermediates : roots)++;
+  check(roots > 0, "national root found");
+  check(intermediates > 0, "national intermediates linked");
+  std::cout << directory.string() << ": " << roots << " roots, "
+            << intermediates << " intermediates" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::filesystem::path fixtures = argc > 1 ? argv[1] : testPath("x509");
+  std::filesystem::path national =
+      argc > 2 ? argv[2] : testPath("../../assets/iran_root_certificates");
+
+  try {
+    requireDirectory(fixtures);
+    ChainValidator validator(fixtures / "anchors");
+    std::vector<BYTE> card = readFile(fixtures / "card.der");
+    std::vector<BYTE> outlivesCa = readFile(fixtures / "card_outlives_ca.der");
+    std::vector<BYTE> forged = readFile(fixtures / "forged.der");
+    std::vector<BYTE> stranger = readFile(fixtures / "stranger.der");
+
+    testAnchors(validator);
+    testValidCard(validator, card);
+    testTampered(validator, card, forged);
+    testValidity(validator, card, outlivesCa);
+    testCache(validator, card, forged);
+    testMalformed(validator, card, stranger);
+
+    if (std::filesystem::is_directory(national))
+      testNationalAnchors(national);
+    else
+      std::cout << national.string() << " not found, skipped" << std::endl;
+  } catch (const std::exception &e) {
+    check(false, std::string("unexpected exception: ") + e.what());
+  }
+
+  if (failures) {
+    std::cerr << failures << " failures" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "chain validator: all passed" << std::endl;
+  return EXIT_SUCCESS;
+}
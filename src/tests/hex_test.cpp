@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * Checks every hex kernel built for this machine (SSE2, AVX2, NEON) against
+ * the scalar one and against a plain reference: all lengths up to past two
+ * AVX2 blocks, both cases, and a non-digit at every position.
+ *
+ * Hex.cpp is compiled into this program so that its kernels, which live in
+ * an anonymous namespace, can be called one at a time. Do not link it with
+ * the library as well.
+ *
+ * Usage: hex_test
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "transport/Hex.cpp"
+
+namespace {
+
+// Longest input; covers the scalar tail after every block size
+constexpr size_t MAX_LENGTH = 80;
+
+struct Kernel {
+  const char *name;
+  size_t (*encode)(const BYTE *bytes, size_t count, char *out,
+                   HexCase letters);
+  size_t (*decode)(const char *hex, size_t count, BYTE *out, bool &ok);
+};
+
+size_t encodeNone(const BYTE *, size_t, char *, HexCase) { return 0; }
+
+size_t decodeNone(const char *, size_t, BYTE *, bool &ok) {
+  ok = true;
+  return 0;
+}
+
+std::vector<Kernel> kernels() {
+  std::vector<Kernel> list{{"scalar", encodeNone, decodeNone}};
+#ifdef HEX_SSE2
+  list.push_back({"sse2", encodeSse2, decodeSse2});
+#ifdef HEX_AVX2
+  if (HAS_AVX2)
+    list.push_back({"avx2", encodeAvx2, decodeAvx2});
+#endif
+#endif
+#ifdef HEX_NEON
+  list.push_back({"neon", encodeNeon, decodeNeon});
+#endif
+  return list;
+}
+
+// What the kernel does not cover, the scalar code finishes, as in encodeHex()
+std::string encodeWith(const Kernel &kernel, const std::vector<BYTE> &bytes,
+                       HexCase letters) {
+  std::string out(2 * bytes.size(), '?');
+  size_t done = kernel.encode(bytes.data(), bytes.size(), out.data(), letters);
+  encodeScalar(bytes.data() + done, bytes.size() - done, out.data() + 2 * done,
+               letters == HexCase::Upper ? UPPER_DIGITS : LOWER_DIGITS);
+  return out;
+}
+
+bool decodeWith(const Kernel &kernel, const std::string &hex,
+                std::vector<BYTE> &out) {
+  bool ok = false;
+  size_t done = kernel.decode(hex.data(), out.size(), out.data(), ok);
+  return decodeScalar(hex.data() + 2 * done, out.size() - done,
+                      out.data() + done) &&
+         ok;
+}
+
+std::string referenceHex(const std::vector<BYTE> &bytes, HexCase letters) {
+  const char *digits = letters == HexCase::Upper ? "0123456789ABCDEF"
+                                                 : "0123456789abcdef";
+  std::string hex;
+  for (BYTE b : bytes) {
+    hex += digits[b >> 4];
+    hex += digits[b & 0x0F];
+  }
+  return hex;
+}
+
+bool isHexDigit(int c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+         (c >= 'A' && c <= 'F');
+}
+
+// `length` bytes of a sequence that takes every value
+std::vector<BYTE> sampleBytes(size_t length, unsigned seed) {
+  std::vector<BYTE> bytes(length);
+  for (size_t i = 0; i < length; i++)
+    bytes[i] = static_cast<BYTE>(seed + 97 * i);
+  return bytes;
+}
+
+// Upper case on letters where `seed` has a bit set, cycling
+std::string mixCase(std::string hex, unsigned seed) {
+  for (size_t i = 0; i < hex.size(); i++) {
+    if (hex[i] >= 'a' && (seed >> (i % 16)) & 1)
+      hex[i] = static_cast<char>(hex[i] - 'a' + 'A');
+  }
+  return hex;
+}
+
+int failures = 0;
+
+void check(bool condition, const std::string &what) {
+  if (condition)
+    return;
+  if (++failures <= 20)
+    std::cerr << "FAIL " << what << std::endl;
+}
+
+void testEncode(const Kernel &kernel) {
+  for (size_t length = 0; length <= MAX_LENGTH; length++) {
+    for (unsigned seed = 0; seed < 256; seed += 51) {
+      std::vector<BYTE> bytes = sampleBytes(length, seed);
+      for (HexCase letters : {HexCase::Lower, HexCase::Upper}) {
+        check(encodeWith(kernel, bytes, letters) ==
+                  referenceHex(bytes, letters),
+              std::string(kernel.name) + " encode, length " +
+                  std::to_string(length));
+      }
+    }
+  }
+}
+
+void testDecode(const Kernel &kernel) {
+  std::string nonDigits;
+  for (int c = 0; c < 256; c++) {
+    if (!isHexDigit(c))
+      nonDigits += static_cast<char>(c);
+  }
+
+  for (size_t length = 0; length <= MAX_LENGTH; length++) {
+    unsigned seed = static_cast<unsigned>(length);
+    std::vector<BYTE> bytes = sampleBytes(length, seed);
+    std::string hex =
+        mixCase(referenceHex(bytes, HexCase::Lower), 0x5A3C + seed);
+    std::string what =
+        std::string(kernel.name) + " decode, length " + std::to_string(length);
+
+    std::vector<BYTE> out(length);
+    check(decodeWith(kernel, hex, out) && out == bytes, what);
+
+    for (size_t pos = 0; pos < hex.size(); pos++) {
+      std::string bad = hex;
+      for (char c : nonDigits) {
+        bad[pos] = c;
+        if (decodeWith(kernel, bad, out)) {
+          check(false, what + ", accepted " +
+                           std::to_string(static_cast<BYTE>(c)) +
+                           " at " + std::to_string(pos));
+          break;
+        }
+      }
+    }
+  }
+}
+
+// encodeHex() and friends, whichever kernels they pick here
+void testPublicApi() {
+  for (size_t length = 0; length <= MAX_LENGTH; length++) {
+    std::vector<BYTE> bytes = sampleBytes(length, 7);
+    std::string lower = referenceHex(bytes, HexCase::Lower);
+    check(bytesToHexString(bytes) == lower,
+          "bytesToHexString, length " + std::to_string(length));
+
+    std::string upper(2 * length, '?');
+    encodeHex(bytes, upper.data(), HexCase::Upper);
+    check(upper == referenceHex(bytes, HexCase::Upper),
+          "encodeHex upper, length " + std::to_string(length));
+
+    std::string mixed = mixCase(lower, 0xC3A5);
+    check(hexStringToBytes(mixed) == bytes,
+          "hexStringToBytes, length " + std::to_string(length));
+    check(hexStringToBytes(mixed + "f") == bytes,
+          "hexStringToBytes odd digit, length " + std::to_string(length));
+
+    if (length > 0) {
+      mixed[length] = 'g';
+      bool thrown = false;
+      try {
+        hexStringToBytes(mixed);
+      } catch (const std::invalid_argument &) {
+        thrown = true;
+      }
+      check(thrown, "hexStringToBytes non-digit, length " +
+                        std::to_string(length));
+    }
+  }
+
+  std::vector<BYTE> out(4);
+  bool thrown = false;
+  try {
+    decodeHex("0011223", out);
+  } catch (const std::invalid_argument &) {
+    thrown = true;
+  }
+  check(thrown, "decodeHex short input");
+}
+
+} // namespace
+
+int main() {
+  try {
+    for (const Kernel &kernel : kernels()) {
+      testEncode(kernel);
+      testDecode(kernel);
+      std::cout << kernel.name << " checked" << std::endl;
+    }
+    testPublicApi();
+  } catch (const std::exception &e) {
+    check(false, std::string("unexpected exception: ") + e.what());
+  }
+
+  if (failures) {
+    std::cerr << failures << " failures" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "hex: all passed" << std::endl;
+  return EXIT_SUCCESS;
+}
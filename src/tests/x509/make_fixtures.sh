@@ -0,0 +1,99 @@
+#!/bin/sh
+# Regenerates the certificates the x509 tests read, with fixed validity
+# periods so that the tests can pick times around them:
+#
+#   anchors/TestRootCA-G3.pem             2020-01-01 to 2040-01-01
+#   anchors/TestIntermediateCA-G3.pem     2021-01-01 to 2031-01-01, pathlen 0
+#   card.der                              2025-01-01 to 2029-01-01
+#   card_outlives_ca.der                  2028-01-01 to 2033-01-01
+#   forged.der     same issuer name, signed by another key
+#   stranger.der   issued by a CA that is not an anchor
+#
+# Usage: sh make_fixtures.sh   (from this directory; needs openssl)
+set -e
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+cat > "$work/ca.cnf" <<CNF
+[ca]
+default_ca = test
+[test]
+dir = $work
+database = $work/index.txt
+new_certs_dir = $work
+serial = $work/serial
+default_md = sha256
+policy = any
+unique_subject = no
+copy_extensions = none
+[any]
+commonName = supplied
+[root]
+basicConstraints = critical, CA:true
+keyUsage = critical, keyCertSign, cRLSign
+subjectKeyIdentifier = hash
+[intermediate]
+basicConstraints = critical, CA:true, pathlen:0
+keyUsage = critical, keyCertSign, cRLSign
+subjectKeyIdentifier = hash
+authorityKeyIdentifier = keyid
+[card]
+basicConstraints = critical, CA:false
+keyUsage = critical, digitalSignature, nonRepudiation
+subjectKeyIdentifier = hash
+authorityKeyIdentifier = keyid
+CNF
+touch "$work/index.txt"
+echo 1000 > "$work/serial"
+
+key() { openssl genrsa -out "$work/$1.key" 2048 2>/dev/null; }
+csr() {
+  openssl req -new -key "$work/$1.key" -subj "$2" -out "$work/$1.csr"
+}
+# sign <name> <issuer> <section> <start> <end>
+sign() {
+  if [ "$2" = "$1" ]; then issuer="-selfsign"; else
+    issuer="-cert $work/$2.pem"; fi
+  openssl ca -batch -notext -config "$work/ca.cnf" $issuer \
+    -keyfile "$work/$2.key" -extensions "$3" -startdate "$4" -enddate "$5" \
+    -preserveDN -in "$work/$1.csr" -out "$work/$1.pem" 2>/dev/null
+}
+der() { openssl x509 -in "$work/$1.pem" -outform DER -out "$2"; }
+
+INTERMEDIATE="/C=IR/O=Test PKI/CN=Test Governmental Intermediate CA-G3"
+CARD="/C=IR/O=Test PKI/serialNumber=0012345678/SN=Testi/GN=Ali/CN=Ali Testi"
+
+key root
+csr root "/C=IR/O=Test PKI/CN=Test Root CA-G3"
+sign root root root 20200101000000Z 20400101000000Z
+key intermediate
+csr intermediate "$INTERMEDIATE"
+sign intermediate root intermediate 20210101000000Z 20310101000000Z
+
+key card
+csr card "$CARD"
+sign card intermediate card 20250101000000Z 20290101000000Z
+cp "$work/card.csr" "$work/card2.csr"
+sign card2 intermediate card 20280101000000Z 20330101000000Z
+
+# Same subject as the intermediate, different key, self-signed: an issuer
+# whose name matches but whose signature does not
+key impostor
+csr impostor "$INTERMEDIATE"
+sign impostor impostor intermediate 20210101000000Z 20310101000000Z
+cp "$work/card.csr" "$work/forged.csr"
+sign forged impostor card 20250101000000Z 20290101000000Z
+
+key unlisted
+csr unlisted "/C=IR/O=Test PKI/CN=Test Unlisted CA"
+sign unlisted unlisted root 20200101000000Z 20400101000000Z
+cp "$work/card.csr" "$work/stranger.csr"
+sign stranger unlisted card 20250101000000Z 20290101000000Z
+
+openssl x509 -in "$work/root.pem" -out anchors/TestRootCA-G3.pem
+openssl x509 -in "$work/intermediate.pem" \
+  -out anchors/TestIntermediateCA-G3.pem
+der card card.der
+der card2 card_outlives_ca.der
+der forged forged.der
+der stranger stranger.der
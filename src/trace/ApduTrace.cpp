@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ApduTrace.hpp"
+
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+const BYTE MAGIC[] = {'A', 'P', 'D', 'U', 'T', 'R', 'C', '1'};
+const size_t HEADER_SIZE = sizeof(MAGIC) + 8;
+
+// Reads LEB128 numbers and byte strings; `ok` turns false at the end.
+struct Cursor {
+  std::span<const BYTE> bytes;
+  size_t offset = 0;
+  bool ok = true;
+
+  uint64_t number() {
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      if (offset == bytes.size()) {
+        ok = false;
+        return 0;
+      }
+      BYTE b = bytes[offset++];
+      value |= static_cast<uint64_t>(b & 0x7F) << shift;
+      if (!(b & 0x80))
+        return value;
+    }
+    throw std::runtime_error("Corrupt trace number");
+  }
+
+  std::span<const BYTE> string() {
+    uint64_t length = number();
+    if (!ok || length > bytes.size() - offset) {
+      ok = false;
+      return {};
+    }
+    std::span<const BYTE> value = bytes.subspan(offset, length);
+    offset += length;
+    return value;
+  }
+};
+
+} // namespace
+
+TraceWriter::TraceWriter(const std::string &path)
+    : m_file(fopen(path.c_str(), "wb")),
+      m_start(std::chrono::steady_clock::now()) {
+  if (!m_file)
+    throw std::runtime_error("Failed to create trace " + path);
+
+  uint64_t wallClock = std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::system_clock::now().time_since_epoch())
+                           .count();
+  BYTE header[HEADER_SIZE];
+  std::memcpy(header, MAGIC, sizeof(MAGIC));
+  for (size_t i = 0; i < 8; i++)
+    header[sizeof(MAGIC) + i] = static_cast<BYTE>(wallClock >> (8 * i));
+  fwrite(header, 1, sizeof(header), m_file);
+}
+
+TraceWriter::~TraceWriter() { fclose(m_file); }
+
+uint64_t TraceWriter::now() const {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - m_start)
+      .count();
+}
+
+uint64_t TraceWriter::beginSession(std::string_view reader, DWORD protocol,
+                                   std::span<const BYTE> atr) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  uint64_t session = m_nextSession++;
+  begin(TraceRecord::Session, session, now());
+  putNumber(protocol);
+  putBytes({reinterpret_cast<const BYTE *>(reader.data()), reader.size()});
+  putBytes(atr);
+  write();
+  return session;
+}
+
+void TraceWriter::exchange(uint64_t session, uint64_t timeUs,
+                           uint64_t durationUs, std::span<const BYTE> command,
+                           std::span<const BYTE> response) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  begin(TraceRecord::Exchange, session, timeUs);
+  putNumber(durationUs);
+  putBytes(command);
+  putBytes(response);
+  write();
+}
+
+void TraceWriter::reconnect(uint64_t session, uint64_t timeUs,
+                            uint64_t durationUs, DWORD initialization,
+                            LONG status, DWORD protocol) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  begin(TraceRecord::Reconnect, session, timeUs);
+  putNumber(durationUs);
+  putNumber(initialization);
+  putNumber(static_cast<uint32_t>(status));
+  putNumber(protocol);
+  write();
+}
+
+void TraceWriter::flush() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  fflush(m_file);
+}
+
+void TraceWriter::begin(TraceRecord kind, uint64_t session, uint64_t timeUs) {
+  m_record.clear();
+  m_record.push_back(static_cast<BYTE>(kind));
+  putNumber(session);
+  putNumber(timeUs);
+}
+
+void TraceWriter::putNumber(uint64_t value) {
+  while (value >= 0x80) {
+    m_record.push_back(static_cast<BYTE>(value | 0x80));
+    value >>= 7;
+  }
+  m_record.push_back(static_cast<BYTE>(value));
+}
+
+void TraceWriter::putBytes(std::span<const BYTE> bytes) {
+  putNumber(bytes.size());
+  m_record.insert(m_record.end(), bytes.begin(), bytes.end());
+}
+
+void TraceWriter::write() {
+  fwrite(m_record.data(), 1, m_record.size(), m_file);
+}
+
+std::shared_ptr<TraceWriter> openTraceWriter(const std::string &path) {
+  static std::mutex mutex;
+  static std::map<std::string, std::weak_ptr<TraceWriter>> writers;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  std::shared_ptr<TraceWriter> writer = writers[path].lock();
+  if (!writer) {
+    writer = std::make_shared<TraceWriter>(path);
+    writers[path] = writer;
+  }
+  return writer;
+}
+
+ApduTrace::ApduTrace(const std::string &path) : m_file(path) {
+  std::span<const BYTE> bytes = m_file.bytes();
+  if (bytes.size() < HEADER_SIZE ||
+      std::memcmp(bytes.data(), MAGIC, sizeof(MAGIC)) != 0)
+    throw std::runtime_error("Not an APDU trace: " + path);
+  for (size_t i = 0; i < 8; i++)
+    m_startTimeUs |= static_cast<uint64_t>(bytes[sizeof(MAGIC) + i]) << (8 * i);
+
+  std::unordered_map<uint64_t, size_t> sessionIndex;
+  Cursor cursor{bytes, HEADER_SIZE};
+  while (cursor.offset < bytes.size()) {
+    auto kind = static_cast<TraceRecord>(bytes[cursor.offset++]);
+    uint64_t session = cursor.number();
+    uint64_t timeUs = cursor.number();
+
+    if (kind == TraceRecord::Session) {
+      TraceSession record;
+      record.id = session;
+      record.timeUs = timeUs;
+      record.protocol = static_cast<DWORD>(cursor.number());
+      std::span<const BYTE> reader = cursor.string();
+      record.reader = {reinterpret_cast<const char *>(reader.data()),
+                       reader.size()};
+      record.atr = cursor.string();
+      if (!cursor.ok)
+        break;
+      sessionIndex[session] = m_sessions.size();
+      m_sessions.push_back(std::move(record));
+      continue;
+    }
+
+    TraceEvent event;
+    event.kind = kind;
+    event.timeUs = timeUs;
+    event.durationUs = cursor.number();
+    if (kind == TraceRecord::Exchange) {
+      event.command = cursor.string();
+      event.response = cursor.string();
+    } else if (kind == TraceRecord::Reconnect) {
+      event.initialization = static_cast<DWORD>(cursor.number());
+      event.status = static_cast<LONG>(static_cast<uint32_t>(cursor.number()));
+      event.protocol = static_cast<DWORD>(cursor.number());
+    } else {
+      throw std::runtime_error("Unknown record in trace " + path);
+    }
+    if (!cursor.ok)
+      break;
+
+    auto found = sessionIndex.find(session);
+    if (found == sessionIndex.end())
+      throw std::runtime_error("Record of an unknown session in " + path);
+    m_sessions[found->second].events.push_back(event);
+  }
+  m_truncated = !cursor.ok;
+}
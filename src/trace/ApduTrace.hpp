@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "MappedFile.hpp"
+#include "transport/Pcsc.hpp"
+
+/*
+ * APDU trace files hold every exchange of one or more card sessions, with
+ * timestamps, as written by RecordingLink and served by ReplayBackend.
+ *
+ * A trace starts with the magic "APDUTRC1" and the wall-clock time it was
+ * started, in microseconds since the Unix epoch (64 bits, little-endian).
+ * Records follow: a kind byte, then unsigned LEB128 fields, first the
+ * session number and the time since the trace started in microseconds:
+ *
+ *   Session    protocol, reader name, ATR
+ *   Exchange   duration, command, response with SW1 SW2 (empty if the
+ *              transmit failed)
+ *   Reconnect  duration, initialization, PC/SC status, protocol
+ *
+ * Byte strings are a length followed by the bytes.
+ */
+
+enum class TraceRecord : BYTE { Session = 1, Exchange = 2, Reconnect = 3 };
+
+/** An exchange or reconnect of a recorded session. */
+struct TraceEvent {
+  TraceRecord kind = TraceRecord::Exchange;
+  uint64_t timeUs = 0; // since the trace started
+  uint64_t durationUs = 0;
+  // Exchange
+  std::span<const BYTE> command;
+  std::span<const BYTE> response;
+  // Reconnect
+  DWORD initialization = 0;
+  LONG status = SCARD_S_SUCCESS;
+  DWORD protocol = 0;
+};
+
+/** One connection to a card. Views point into the trace's mapping. */
+struct TraceSession {
+  uint64_t id = 0;
+  std::string_view reader;
+  DWORD protocol = 0;
+  std::span<const BYTE> atr;
+  uint64_t timeUs = 0;
+  std::vector<TraceEvent> events;
+};
+
+/**
+ * Appends sessions to a trace file. Thread-safe, so that the sessions of
+ * several readers can go to the same file.
+ */
+class TraceWriter {
+public:
+  /** @throws std::runtime_error if the file cannot be created. */
+  explicit TraceWriter(const std::string &path);
+  ~TraceWriter();
+
+  TraceWriter(const TraceWriter &) = delete;
+  TraceWriter &operator=(const TraceWriter &) = delete;
+
+  /** Microseconds since the trace started. */
+  uint64_t now() const;
+
+  /** Records a new connection and returns its session number. */
+  uint64_t beginSession(std::string_view reader, DWORD protocol,
+                        std::span<const BYTE> atr);
+  void exchange(uint64_t session, uint64_t timeUs, uint64_t durationUs,
+                std::span<const BYTE> command,
+                std::span<const BYTE> response);
+  void reconnect(uint64_t session, uint64_t timeUs, uint64_t durationUs,
+                 DWORD initialization, LONG status, DWORD protocol);
+
+  /** Hands buffered records to the operating system. */
+  void flush();
+
+private:
+  void begin(TraceRecord kind, uint64_t session, uint64_t timeUs);
+  void putNumber(uint64_t value);
+  void putBytes(std::span<const BYTE> bytes);
+  void write();
+
+  std::mutex m_mutex;
+  FILE *m_file;
+  std::chrono::steady_clock::time_point m_start;
+  uint64_t m_nextSession = 0;
+  std::vector<BYTE> m_record; // the record being built
+};
+
+/**
+ * The writer for `path`, shared by every caller in the process that records
+ * to the same file while it is open.
+ *
+ * @throws std::runtime_error if the file cannot be created.
+ */
+std::shared_ptr<TraceWriter> openTraceWriter(const std::string &path);
+
+/** A trace file, mapped into memory and split into sessions. */
+class ApduTrace {
+public:
+  /**
+   * @throws std::runtime_error if the file cannot be mapped or is not a
+   * trace.
+   */
+  explicit ApduTrace(const std::string &path);
+
+  /** Wall-clock start, in microseconds since the Unix epoch. */
+  uint64_t startTimeUs() const { return m_startTimeUs; }
+
+  /** Sessions in the order they were connected. */
+  const std::vector<TraceSession> &sessions() const { return m_sessions; }
+
+  /** The file ends inside a record, as when the recorder was killed. */
+  bool truncated() const { return m_truncated; }
+
+private:
+  MappedFile m_file;
+  uint64_t m_startTimeUs = 0;
+  std::vector<TraceSession> m_sessions;
+  bool m_truncated = false;
+};
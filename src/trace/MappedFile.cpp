@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "MappedFile.hpp"
+
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+[[noreturn]] void throwMapFailed(const std::string &path) {
+  throw std::runtime_error("Failed to map " + path);
+}
+
+} // namespace
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &path) {
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    throwMapFailed(path);
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    throwMapFailed(path);
+  }
+  m_size = static_cast<size_t>(size.QuadPart);
+  if (m_size == 0) { // empty files cannot be mapped
+    CloseHandle(file);
+    return;
+  }
+
+  // The mapping keeps the file open.
+  m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (!m_mapping)
+    throwMapFailed(path);
+  m_data = static_cast<const BYTE *>(
+      MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+  if (!m_data) {
+    CloseHandle(m_mapping);
+    throwMapFailed(path);
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (m_data)
+    UnmapViewOfFile(m_data);
+  if (m_mapping)
+    CloseHandle(m_mapping);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throwMapFailed(path);
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    throwMapFailed(path);
+  }
+  m_size = static_cast<size_t>(info.st_size);
+  if (m_size == 0) { // empty files cannot be mapped
+    close(fd);
+    return;
+  }
+
+  // The mapping stays valid after the descriptor is closed.
+  void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    throwMapFailed(path);
+  m_data = static_cast<const BYTE *>(data);
+}
+
+MappedFile::~MappedFile() {
+  if (m_data)
+    munmap(const_cast<BYTE *>(m_data), m_size);
+}
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+#include "transport/Pcsc.hpp"
+
+/** A whole file mapped read-only into memory. */
+class MappedFile {
+public:
+  /** @throws std::runtime_error if the file cannot be opened or mapped. */
+  explicit MappedFile(const std::string &path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  std::span<const BYTE> bytes() const { return {m_data, m_size}; }
+
+private:
+  const BYTE *m_data = nullptr;
+  size_t m_size = 0;
+#ifdef _WIN32
+  HANDLE m_mapping = nullptr;
+#endif
+};
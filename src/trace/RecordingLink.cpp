@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "RecordingLink.hpp"
+
+#include <stdexcept>
+
+RecordingLink::RecordingLink(std::unique_ptr<CardLink> link,
+                             std::shared_ptr<TraceWriter> writer,
+                             std::string_view reader, DWORD activeProtocol)
+    : m_link(std::move(link)), m_writer(std::move(writer)) {
+  if (!m_link || !m_writer)
+    throw std::invalid_argument("No card link or trace");
+
+  BYTE atr[36]; // as CardTransport
+  size_t atrLength = m_link->readAtr(atr);
+  m_session = m_writer->beginSession(reader, activeProtocol,
+                                     std::span<const BYTE>(atr, atrLength));
+}
+
+RecordingLink::~RecordingLink() { m_writer->flush(); }
+
+size_t RecordingLink::transmit(std::span<const BYTE> command,
+                               std::span<BYTE> response) {
+  uint64_t start = m_writer->now();
+  size_t length;
+  try {
+    length = m_link->transmit(command, response);
+  } catch (...) {
+    // An empty response marks the failure for replay.
+    m_writer->exchange(m_session, start, m_writer->now() - start, command, {});
+    throw;
+  }
+  m_writer->exchange(m_session, start, m_writer->now() - start, command,
+                     response.first(length));
+  return length;
+}
+
+LONG RecordingLink::reconnect(DWORD initialization, DWORD &activeProtocol) {
+  uint64_t start = m_writer->now();
+  DWORD protocol = 0;
+  LONG status = m_link->reconnect(initialization, protocol);
+  m_writer->reconnect(m_session, start, m_writer->now() - start,
+                      initialization, status, protocol);
+  if (status == SCARD_S_SUCCESS)
+    activeProtocol = protocol;
+  return status;
+}
+
+size_t RecordingLink::readAtr(std::span<BYTE> atr) {
+  return m_link->readAtr(atr);
+}
+
+LONG RecordingLink::beginTransaction() { return m_link->beginTransaction(); }
+
+void RecordingLink::endTransaction() { m_link->endTransaction(); }
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string_view>
+
+#include "ApduTrace.hpp"
+#include "transport/CardLink.hpp"
+#include "transport/Pcsc.hpp"
+
+/**
+ * Passes everything through to another link and writes each exchange and
+ * reconnect, timed, to a trace as one session.
+ */
+class RecordingLink : public CardLink {
+public:
+  /** Records the session start, with `link`'s ATR. */
+  RecordingLink(std::unique_ptr<CardLink> link,
+                std::shared_ptr<TraceWriter> writer, std::string_view reader,
+                DWORD activeProtocol);
+  ~RecordingLink() override;
+
+  size_t transmit(std::span<const BYTE> command,
+                  std::span<BYTE> response) override;
+  LONG reconnect(DWORD initialization, DWORD &activeProtocol) override;
+  size_t readAtr(std::span<BYTE> atr) override;
+  LONG beginTransaction() override;
+  void endTransaction() override;
+  bool shared() const override { return m_link->shared(); }
+
+private:
+  std::unique_ptr<CardLink> m_link;
+  std::shared_ptr<TraceWriter> m_writer;
+  uint64_t m_session;
+};
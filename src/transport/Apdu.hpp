@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "Pcsc.hpp"
+
+// Largest response to a short APDU: 256 data bytes plus SW1/SW2.
+constexpr size_t SHORT_RESPONSE_MAX = 256 + 2;
+
+/**
+ * Caller-owned receive buffer sized for any short APDU response. Declare one
+ * per flow and reuse it for every command instead of allocating per call.
+ */
+using ResponseBuffer = std::array<BYTE, SHORT_RESPONSE_MAX>;
+
+// Le requested by one extended READ BINARY. Cards accept up to 65536, but
+// reader drivers often cap their buffers, so stay well below that. 4 KB
+// covers a whole certificate or SOD in a single command.
+constexpr size_t EXTENDED_READ_CHUNK = 0x1000;
+
+/**
+ * Caller-owned receive buffer for extended-length responses. It is too large
+ * for comfortable stack use, so keep one alive per connection.
+ */
+using ExtendedResponseBuffer = std::array<BYTE, EXTENDED_READ_CHUNK + 2>;
+
+// Channels 0-3 use the first interindustry CLA coding, 4-19 the further one.
+constexpr BYTE MAX_LOGICAL_CHANNELS = 20;
+
+/** Logical channel a CLA byte addresses. */
+constexpr BYTE classChannel(BYTE cla) {
+  return (cla & 0x40) ? static_cast<BYTE>(4 + (cla & 0x0F)) : (cla & 0x03);
+}
+
+/**
+ * `cla` moved to logical channel `channel`. The proprietary and chaining bits
+ * are kept; secure messaging bits only fit the coding of channels 0-3.
+ */
+constexpr BYTE withChannel(BYTE cla, BYTE channel) {
+  BYTE kept = cla & 0x90;
+  if (channel < 4)
+    return kept | ((cla & 0x40) ? 0 : (cla & 0x0C)) | channel;
+  return kept | 0x40 | (channel - 4);
+}
+
+/**
+ * The SW1/SW2 trailer of an APDU response.
+ */
+struct StatusWord {
+  BYTE sw1 = 0;
+  BYTE sw2 = 0;
+
+  constexpr uint16_t value() const {
+    return static_cast<uint16_t>((sw1 << 8) | sw2);
+  }
+
+  // 9000
+  constexpr bool isSuccess() const { return sw1 == 0x90 && sw2 == 0x00; }
+  // 61xx: command done, SW2 more bytes waiting for GET RESPONSE
+  constexpr bool hasMoreData() const { return sw1 == 0x61; }
+  // 62xx / 63xx: data may still be usable
+  constexpr bool isWarning() const { return sw1 == 0x62 || sw1 == 0x63; }
+  // 6Cxx: wrong Le, SW2 carries the exact length
+  constexpr bool isWrongLength() const { return sw1 == 0x6C; }
+  // 6B00: offset beyond the end of the EF
+  constexpr bool isWrongParameters() const {
+    return sw1 == 0x6B && sw2 == 0x00;
+  }
+  // 6700 / 6D00 / 6E00: the command itself was rejected, which is how cards
+  // without extended-length support answer a 3-byte Le
+  constexpr bool isCommandRejected() const {
+    return (sw1 == 0x67 && sw2 == 0x00) || (sw1 == 0x6D && sw2 == 0x00) ||
+           (sw1 == 0x6E && sw2 == 0x00);
+  }
+  // 6982
+  constexpr bool isSecurityNotSatisfied() const {
+    return sw1 == 0x69 && sw2 == 0x82;
+  }
+
+  constexpr bool operator==(const StatusWord &) const = default;
+};
+
+constexpr StatusWord SW_SUCCESS{0x90, 0x00};
+constexpr StatusWord SW_WRONG_PARAMETERS{0x6B, 0x00};
+constexpr StatusWord SW_SECURITY_NOT_SATISFIED{0x69, 0x82};
+constexpr StatusWord SW_FILE_NOT_FOUND{0x6A, 0x82};
+
+/**
+ * Result of a transmit: `data` is a view into the caller's receive buffer
+ * (SW1/SW2 excluded) and stays valid until that buffer is reused.
+ */
+struct ApduResponse {
+  std::span<const BYTE> data;
+  StatusWord sw;
+};
@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ApduLog.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Hex.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const Clock::time_point LOG_START = Clock::now();
+
+// Longest payload kept per record; longer ones are cut.
+constexpr size_t MAX_PAYLOAD = 4096;
+
+struct RecordHeader {
+  uint64_t timeNs;
+  uint32_t length;         // payload bytes stored
+  uint32_t originalLength; // payload bytes written
+  LogLevel level;
+  LogRecord kind;
+};
+
+/**
+ * Single-producer single-consumer byte ring. The owning thread writes,
+ * drain() reads; `m_head` and `m_tail` count bytes ever written and read.
+ */
+class LogRing {
+public:
+  static constexpr size_t CAPACITY = 1 << 16;
+
+  explicit LogRing(uint32_t thread) : m_thread(thread) {}
+
+  void push(const RecordHeader &header, std::span<const BYTE> payload) {
+    size_t size = sizeof(header) + header.length;
+    uint64_t head = m_head.load(std::memory_order_relaxed);
+    uint64_t tail = m_tail.load(std::memory_order_acquire);
+    if (CAPACITY - (head - tail) < size) {
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    copyIn(head, &header, sizeof(header));
+    copyIn(head + sizeof(header), payload.data(), header.length);
+    m_head.store(head + size, std::memory_order_release);
+  }
+
+  // Hands each pending record to `take(header, payload)`.
+  template <typename Take> void pop(Take &&take) {
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    uint64_t tail = m_tail.load(std::memory_order_relaxed);
+    std::vector<BYTE> payload;
+    while (tail < head) {
+      RecordHeader header;
+      copyOut(tail, &header, sizeof(header));
+      payload.resize(header.length);
+      copyOut(tail + sizeof(header), payload.data(), header.length);
+      tail += sizeof(header) + header.length;
+      take(header, payload);
+    }
+    m_tail.store(tail, std::memory_order_release);
+  }
+
+  uint32_t thread() const { return m_thread; }
+  uint64_t dropped() const {
+    return m_dropped.load(std::memory_order_relaxed);
+  }
+
+private:
+  void copyIn(uint64_t position, const void *data, size_t size) {
+    size_t offset = position % CAPACITY;
+    size_t first = std::min(size, CAPACITY - offset);
+    std::memcpy(&m_bytes[offset], data, first);
+    std::memcpy(&m_bytes[0], static_cast<const BYTE *>(data) + first,
+                size - first);
+  }
+
+  void copyOut(uint64_t position, void *data, size_t size) const {
+    size_t offset = position % CAPACITY;
+    size_t first = std::min(size, CAPACITY - offset);
+    std::memcpy(data, &m_bytes[offset], first);
+    std::memcpy(static_cast<BYTE *>(data) + first, &m_bytes[0], size - first);
+  }
+
+  const uint32_t m_thread;
+  std::atomic<uint64_t> m_head{0};
+  std::atomic<uint64_t> m_tail{0};
+  std::atomic<uint64_t> m_dropped{0};
+  std::array<BYTE, CAPACITY> m_bytes;
+};
+
+struct Registry {
+  std::mutex mutex; // registration and draining, never the hot path
+  std::vector<std::shared_ptr<LogRing>> rings;
+  uint32_t nextThread = 0;
+  uint64_t droppedByGoneThreads = 0;
+};
+
+Registry &registry() {
+  static Registry instance;
+  return instance;
+}
+
+LogRing &threadRing() {
+  thread_local std::shared_ptr<LogRing> ring;
+  if (!ring) {
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    ring = std::make_shared<LogRing>(r.nextThread++);
+    r.rings.push_back(ring);
+  }
+  return *ring;
+}
+
+struct Line {
+  uint64_t timeNs;
+  uint32_t thread;
+  LogRecord kind;
+  std::string text;
+};
+
+const char *prefixOf(LogRecord kind) {
+  switch (kind) {
+  case LogRecord::Command:
+    return "> ";
+  case LogRecord::Response:
+    return "< ";
+  default:
+    return "";
+  }
+}
+
+} // namespace
+
+std::atomic<int> ApduLog::s_level{APDU_LOG_LEVEL};
+
+void ApduLog::setLevel(LogLevel level) {
+  s_level.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+void ApduLog::write(LogLevel level, LogRecord kind,
+                    std::span<const BYTE> bytes) {
+  RecordHeader header;
+  header.timeNs = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                           LOG_START)
+          .count());
+  header.length = static_cast<uint32_t>(std::min(bytes.size(), MAX_PAYLOAD));
+  header.originalLength = static_cast<uint32_t>(bytes.size());
+  header.level = level;
+  header.kind = kind;
+  threadRing().push(header, bytes);
+}
+
+void ApduLog::drain(std::ostream &out) {
+  std::vector<Line> lines;
+  Registry &r = registry();
+  {
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (const auto &ring : r.rings) {
+      ring->pop([&](const RecordHeader &header,
+                    std::span<const BYTE> payload) {
+        Line line{header.timeNs, ring->thread(), header.kind, {}};
+        if (header.kind == LogRecord::Message) {
+          line.text.assign(payload.begin(), payload.end());
+        } else {
+          appendHex(line.text, payload, HexCase::Upper);
+        }
+        if (header.originalLength > header.length)
+          line.text += "... (" + std::to_string(header.originalLength) +
+                       " bytes)";
+        lines.push_back(std::move(line));
+      });
+    }
+    // Rings of finished threads are empty now and nobody writes to them.
+    for (auto it = r.rings.begin(); it != r.rings.end();) {
+      if (it->use_count() == 1) {
+        r.droppedByGoneThreads += (*it)->dropped();
+        it = r.rings.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  std::stable_sort(lines.begin(), lines.end(),
+                   [](const Line &a, const Line &b) {
+                     return a.timeNs < b.timeNs;
+                   });
+  char stamp[40];
+  for (const Line &line : lines) {
+    snprintf(stamp, sizeof(stamp), "[%12.6f] T%u ",
+             static_cast<double>(line.timeNs) / 1e9, line.thread);
+    out << stamp << prefixOf(line.kind) << line.text << '\n';
+  }
+  out.flush();
+}
+
+uint64_t ApduLog::dropped() {
+  Registry &r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  uint64_t total = r.droppedByGoneThreads;
+  for (const auto &ring : r.rings)
+    total += ring->dropped();
+  return total;
+}
+
+ApduLogFlusher::ApduLogFlusher(std::ostream &out,
+                               std::chrono::milliseconds interval)
+    : m_out(out) {
+  m_thread = std::thread([this, interval] {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopping) {
+      m_wake.wait_for(lock, interval);
+      lock.unlock();
+      ApduLog::drain(m_out);
+      lock.lock();
+    }
+  });
+}
+
+ApduLogFlusher::~ApduLogFlusher() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_wake.notify_one();
+  m_thread.join();
+  ApduLog::drain(m_out);
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <span>
+#include <string_view>
+#include <thread>
+
+#include "Pcsc.hpp"
+
+enum class LogLevel : int { Error, Warning, Info, Debug };
+
+/*
+ * Most verbose level compiled in. Calls above it compile to nothing, so
+ * release builds pay nothing for APDU dumps; define APDU_LOG_LEVEL (0 = Error
+ * to 3 = Debug) to override.
+ */
+#ifndef APDU_LOG_LEVEL
+#ifdef NDEBUG
+#define APDU_LOG_LEVEL 2
+#else
+#define APDU_LOG_LEVEL 3
+#endif
+#endif
+
+constexpr LogLevel COMPILED_LOG_LEVEL = static_cast<LogLevel>(APDU_LOG_LEVEL);
+
+enum class LogRecord : uint8_t {
+  Message,  // text
+  Command,  // APDU sent
+  Response, // answer received, SW1 SW2 included
+};
+
+/**
+ * Binary log of APDUs and messages. Each thread writes into its own
+ * lock-free ring buffer: a record is a timestamp and the raw bytes, copied
+ * without formatting, locking or allocating. Formatting happens when the
+ * log is drained, on an ApduLogFlusher thread or on demand.
+ *
+ * A full ring drops new records rather than wait; dropped() counts them.
+ */
+class ApduLog {
+public:
+  /** Records below the compiled level are kept only up to `level`. */
+  static void setLevel(LogLevel level);
+  static LogLevel level() {
+    return static_cast<LogLevel>(s_level.load(std::memory_order_relaxed));
+  }
+
+  /** Appends a record to the calling thread's ring. */
+  static void write(LogLevel level, LogRecord kind,
+                    std::span<const BYTE> bytes);
+
+  /**
+   * Formats every record written so far to `out`, oldest first, one line
+   * each. Safe to call from any thread.
+   */
+  static void drain(std::ostream &out);
+
+  /** Records lost to full rings since the start. */
+  static uint64_t dropped();
+
+private:
+  static std::atomic<int> s_level;
+};
+
+/**
+ * True if a record at `level` would be kept. Above the compiled level this
+ * is false at compile time, so the code building the record goes away too.
+ */
+inline bool logEnabled(LogLevel level) {
+  return level <= COMPILED_LOG_LEVEL && level <= ApduLog::level();
+}
+
+template <LogLevel Level>
+inline void logApdu(LogRecord kind, std::span<const BYTE> bytes) {
+  if constexpr (Level <= COMPILED_LOG_LEVEL) {
+    if (Level <= ApduLog::level())
+      ApduLog::write(Level, kind, bytes);
+  }
+}
+
+template <LogLevel Level> inline void logMessage(std::string_view text) {
+  logApdu<Level>(LogRecord::Message,
+                 {reinterpret_cast<const BYTE *>(text.data()), text.size()});
+}
+
+/**
+ * Drains the log to a stream from a background thread while it exists, and
+ * once more when it is destroyed.
+ */
+class ApduLogFlusher {
+public:
+  explicit ApduLogFlusher(
+      std::ostream &out,
+      std::chrono::milliseconds interval = std::chrono::milliseconds(100));
+  ~ApduLogFlusher();
+
+  ApduLogFlusher(const ApduLogFlusher &) = delete;
+  ApduLogFlusher &operator=(const ApduLogFlusher &) = delete;
+
+private:
+  std::ostream &m_out;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  bool m_stopping = false;
+  std::thread m_thread;
+};
@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ApduMetrics.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+void LatencyHistogram::record(uint64_t nanoseconds) {
+  m_counts[bucketOf(nanoseconds)]++;
+  m_count++;
+  m_total += nanoseconds;
+  m_min = std::min(m_min, nanoseconds);
+  m_max = std::max(m_max, nanoseconds);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+  for (size_t i = 0; i < BUCKETS; i++)
+    m_counts[i] += other.m_counts[i];
+  m_count += other.m_count;
+  m_total += other.m_total;
+  m_min = std::min(m_min, other.m_min);
+  m_max = std::max(m_max, other.m_max);
+}
+
+uint64_t LatencyHistogram::percentile(double percent) const {
+  if (m_count == 0)
+    return 0;
+  double rank = std::ceil(std::clamp(percent, 0.0, 100.0) / 100.0 *
+                          static_cast<double>(m_count));
+  uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(rank));
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < BUCKETS; i++) {
+    seen += m_counts[i];
+    if (seen >= target)
+      return std::clamp(highestIn(i), min(), m_max);
+  }
+  return m_max;
+}
+
+size_t LatencyHistogram::bucketOf(uint64_t value) {
+  if (value < SUB_BUCKETS)
+    return static_cast<size_t>(value);
+  unsigned magnitude = std::bit_width(value) - 1;
+  if (magnitude >= MAX_BITS)
+    return BUCKETS - 1;
+  unsigned shift = magnitude - SUB_BUCKET_BITS;
+  return (shift + 1) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS);
+}
+
+uint64_t LatencyHistogram::highestIn(size_t bucket) {
+  if (bucket < SUB_BUCKETS)
+    return bucket;
+  unsigned shift = static_cast<unsigned>(bucket / SUB_BUCKETS) - 1;
+  uint64_t lowest = (bucket % SUB_BUCKETS + SUB_BUCKETS) << shift;
+  return lowest + (uint64_t(1) << shift) - 1;
+}
+
+const char *apduPhaseName(ApduPhase phase) {
+  switch (phase) {
+  case ApduPhase::Select:
+    return "select";
+  case ApduPhase::Read:
+    return "read";
+  case ApduPhase::Verify:
+    return "verify";
+  case ApduPhase::SecureMessaging:
+    return "secure messaging";
+  case ApduPhase::Execute:
+    return "execute";
+  default:
+    return "other";
+  }
+}
+
+ApduPhase classifyApdu(std::span<const BYTE> command) {
+  if (command.size() < 4)
+    return ApduPhase::Other;
+
+  // Interindustry classes carry the SM indication in b4-b3 (first
+  // interindustry values) or b6 (further ones).
+  BYTE cla = command[0];
+  if (!(cla & 0x80) && ((cla & 0x40) ? (cla & 0x20) : (cla & 0x0C)))
+    return ApduPhase::SecureMessaging;
+
+  switch (command[1]) {
+  case 0xA4:
+    return ApduPhase::Select;
+  case 0xB0:
+  case 0xB1:
+  case 0xB2:
+  case 0xB3:
+  case 0xCA:
+  case 0xCB:
+    return ApduPhase::Read;
+  case 0x20:
+  case 0x21:
+  case 0x24:
+  case 0x2C:
+    return ApduPhase::Verify;
+  case 0x22: // MANAGE SECURITY ENVIRONMENT
+  case 0x82: // EXTERNAL / MUTUAL AUTHENTICATE
+  case 0x84: // GET CHALLENGE
+  case 0x86: // GENERAL AUTHENTICATE
+  case 0x87:
+  case 0x88: // INTERNAL AUTHENTICATE
+    return ApduPhase::SecureMessaging;
+  case 0x2A: // PERFORM SECURITY OPERATION
+    return ApduPhase::Execute;
+  default:
+    return ApduPhase::Other;
+  }
+}
+
+ApduMetrics::Scope::Scope(ApduMetrics *metrics, ApduPhase phase)
+    : m_metrics(metrics) {
+  if (!m_metrics)
+    return;
+  m_previous = m_metrics->m_scopePhase;
+  m_hadPhase = m_metrics->m_hasScope;
+  m_metrics->m_scopePhase = phase;
+  m_metrics->m_hasScope = true;
+}
+
+ApduMetrics::Scope::~Scope() {
+  if (!m_metrics)
+    return;
+  m_metrics->m_scopePhase = m_previous;
+  m_metrics->m_hasScope = m_hadPhase;
+}
+
+const ApduMetrics::Entry *ApduMetrics::find(const Key &key) const {
+  for (const Entry &entry : m_entries) {
+    if (entry.key == key)
+      return &entry;
+  }
+  return nullptr;
+}
+
+LatencyHistogram ApduMetrics::link(ApduPhase phase) const {
+  LatencyHistogram histogram;
+  for (const Entry &entry : m_entries) {
+    if (entry.key.phase == phase)
+      histogram.merge(entry.link);
+  }
+  return histogram;
+}
+
+LatencyHistogram ApduMetrics::link() const {
+  LatencyHistogram histogram;
+  for (const Entry &entry : m_entries)
+    histogram.merge(entry.link);
+  return histogram;
+}
+
+void ApduMetrics::reset() {
+  m_entries.clear();
+  m_lastEntry = 0;
+  m_transport.reset();
+  m_host.reset();
+  m_reconnects.reset();
+  m_hasLastEnd = false;
+}
+
+void ApduMetrics::beginCommand(std::span<const BYTE> command, uint16_t file,
+                               Clock::time_point now) {
+  if (m_hasLastEnd)
+    m_host.record(now - m_lastEnd);
+  m_command.phase = m_hasScope ? m_scopePhase : classifyApdu(command);
+  m_command.ins = command.size() > 1 ? command[1] : 0;
+  m_command.file = file;
+  m_commandStart = now;
+  m_commandLink = {};
+}
+
+void ApduMetrics::recordExchange(BYTE ins, size_t sent, size_t received,
+                                 Clock::duration elapsed) {
+  Entry &target = entry({m_command.phase, ins, m_command.file});
+  target.link.record(elapsed);
+  target.bytesSent += sent;
+  target.bytesReceived += received;
+  m_commandLink += elapsed;
+}
+
+void ApduMetrics::endCommand(Clock::time_point now) {
+  Clock::duration own = now - m_commandStart - m_commandLink;
+  m_transport.record(std::max(own, Clock::duration::zero()));
+  m_lastEnd = now;
+  m_hasLastEnd = true;
+}
+
+void ApduMetrics::recordReconnect(Clock::duration elapsed) {
+  m_reconnects.record(elapsed);
+}
+
+ApduMetrics::Entry &ApduMetrics::entry(const Key &key) {
+  // Consecutive exchanges mostly share a key.
+  if (m_lastEntry < m_entries.size() && m_entries[m_lastEntry].key == key)
+    return m_entries[m_lastEntry];
+  for (size_t i = 0; i < m_entries.size(); i++) {
+    if (m_entries[i].key == key) {
+      m_lastEntry = i;
+      return m_entries[i];
+    }
+  }
+  m_lastEntry = m_entries.size();
+  m_entries.push_back(Entry{key, {}, 0, 0});
+  return m_entries.back();
+}
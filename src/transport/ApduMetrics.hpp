@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "Pcsc.hpp"
+
+/**
+ * Durations in nanoseconds, counted in log-linear buckets like an HDR
+ * histogram: 16 linear buckets per power of two, so any recorded value is
+ * reported within 1/16 (about 6%) of itself, from 1 ns to about 18 minutes.
+ * Recording is an index computation and an increment.
+ */
+class LatencyHistogram {
+public:
+  void record(uint64_t nanoseconds);
+  void record(std::chrono::nanoseconds duration) {
+    record(static_cast<uint64_t>(duration.count()));
+  }
+
+  /** Adds the counts of `other`. */
+  void merge(const LatencyHistogram &other);
+  void reset() { *this = LatencyHistogram(); }
+
+  uint64_t count() const { return m_count; }
+  uint64_t total() const { return m_total; } // sum of all values
+  uint64_t min() const { return m_count ? m_min : 0; }
+  uint64_t max() const { return m_max; }
+  uint64_t mean() const { return m_count ? m_total / m_count : 0; }
+
+  /**
+   * The value below which `percent` of the recorded values fall, e.g. 50
+   * for the median or 99.9; 0 if nothing was recorded.
+   */
+  uint64_t percentile(double percent) const;
+
+private:
+  static constexpr unsigned SUB_BUCKET_BITS = 4;
+  static constexpr unsigned SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+  static constexpr unsigned MAX_BITS = 40; // 2^40 ns, about 18 minutes
+  static constexpr size_t BUCKETS =
+      (MAX_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  static size_t bucketOf(uint64_t value);
+  static uint64_t highestIn(size_t bucket);
+
+  std::array<uint32_t, BUCKETS> m_counts{};
+  uint64_t m_count = 0;
+  uint64_t m_total = 0;
+  uint64_t m_min = UINT64_MAX;
+  uint64_t m_max = 0;
+};
+
+/**
+ * What an APDU is for. CardTransport works it out from CLA and INS; code
+ * running a larger operation, such as an MDAS script step, can charge its
+ * APDUs to a phase with ApduMetrics::Scope.
+ */
+enum class ApduPhase : uint8_t {
+  Other,
+  Select,          // SELECT
+  Read,            // READ BINARY / RECORD, GET DATA
+  Verify,          // VERIFY, CHANGE / RESET RETRY COUNTER
+  SecureMessaging, // SM-wrapped commands, GET CHALLENGE, authentication
+  Execute,         // PSO and script steps
+};
+constexpr size_t APDU_PHASE_COUNT = 6;
+
+const char *apduPhaseName(ApduPhase phase);
+
+/** The phase CardTransport charges `command` to. */
+ApduPhase classifyApdu(std::span<const BYTE> command);
+
+/**
+ * Timing of one connection, fed by the CardTransport it is attached to with
+ * CardTransport::setMetrics(). It splits where the time goes:
+ *
+ *   link       each exchange with the card, as the link reports it: card,
+ *              reader and PC/SC stack together, per phase, INS and file
+ *   transport  CardTransport's own work around those exchanges
+ *   host       between two transmit() calls, i.e. the caller's code
+ *
+ * GET RESPONSE exchanges are charged to the phase and file of the command
+ * they continue. Not thread-safe, like the transport.
+ */
+class ApduMetrics {
+public:
+  struct Key {
+    ApduPhase phase = ApduPhase::Other;
+    BYTE ins = 0;
+    uint16_t file = 0; // FID selected or being selected, 0 if unknown
+
+    bool operator==(const Key &) const = default;
+  };
+
+  struct Entry {
+    Key key;
+    LatencyHistogram link;
+    uint64_t bytesSent = 0;
+    uint64_t bytesReceived = 0;
+  };
+
+  /** Charges the APDUs sent while it exists to `phase`. */
+  class Scope {
+  public:
+    Scope(ApduMetrics *metrics, ApduPhase phase);
+    ~Scope();
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    ApduMetrics *m_metrics;
+    ApduPhase m_previous;
+    bool m_hadPhase;
+  };
+
+  /** Link time per phase, INS and file, in the order first seen. */
+  const std::vector<Entry> &entries() const { return m_entries; }
+  const Entry *find(const Key &key) const;
+
+  /** Link time of every exchange in `phase`. */
+  LatencyHistogram link(ApduPhase phase) const;
+  /** Link time of every exchange. */
+  LatencyHistogram link() const;
+
+  const LatencyHistogram &transport() const { return m_transport; }
+  const LatencyHistogram &host() const { return m_host; }
+  const LatencyHistogram &reconnects() const { return m_reconnects; }
+
+  void reset();
+
+  // Called by CardTransport
+  using Clock = std::chrono::steady_clock;
+  void beginCommand(std::span<const BYTE> command, uint16_t file,
+                    Clock::time_point now);
+  void recordExchange(BYTE ins, size_t sent, size_t received,
+                      Clock::duration elapsed);
+  void endCommand(Clock::time_point now);
+  void recordReconnect(Clock::duration elapsed);
+
+private:
+  Entry &entry(const Key &key);
+
+  std::vector<Entry> m_entries;
+  size_t m_lastEntry = 0;
+  LatencyHistogram m_transport;
+  LatencyHistogram m_host;
+  LatencyHistogram m_reconnects;
+
+  ApduPhase m_scopePhase = ApduPhase::Other;
+  bool m_hasScope = false;
+
+  // The command in progress
+  Key m_command;
+  Clock::time_point m_commandStart;
+  Clock::duration m_commandLink{};
+  Clock::time_point m_lastEnd;
+  bool m_hasLastEnd = false;
+};
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "BerTlv.hpp"
+
+namespace {
+
+constexpr size_t MAX_TAG_BYTES = 3;
+constexpr size_t MAX_LENGTH_BYTES = 4;
+
+// Filler an EF may carry between or after its objects
+constexpr bool isPadding(BYTE b) { return b == 0x00 || b == 0xFF; }
+
+// Parses the objects of `data[pos, end)`, offsets relative to `data`, into
+// `objects`, descending into constructed ones.
+bool indexLevel(std::span<const BYTE> data, size_t pos, size_t end,
+                std::vector<Tlv> &objects) {
+  data = data.first(end);
+  while (pos < end) {
+    if (isPadding(data[pos])) {
+      pos++;
+      continue;
+    }
+    Tlv tlv;
+    if (parseTlv(data, pos, tlv) != TlvStatus::Ok)
+      return false;
+    objects.push_back(tlv);
+    if (tlv.constructed() &&
+        !indexLevel(data, tlv.offset + tlv.headerLength, tlv.end(), objects))
+      return false;
+    pos = tlv.end();
+  }
+  return true;
+}
+
+} // namespace
+
+TlvStatus parseTlv(std::span<const BYTE> data, size_t pos, Tlv &tlv) {
+  const size_t start = pos;
+  if (pos >= data.size())
+    return TlvStatus::Incomplete;
+
+  // Tag: one byte, or more while the low five bits of the first are all set
+  // and the following ones have bit 8 set
+  uint32_t tag = data[pos++];
+  if ((tag & 0x1F) == 0x1F) {
+    BYTE b;
+    do {
+      if (pos >= data.size())
+        return TlvStatus::Incomplete;
+      if (pos - start >= MAX_TAG_BYTES)
+        return TlvStatus::Malformed;
+      b = data[pos++];
+      tag = (tag << 8) | b;
+    } while (b & 0x80);
+  }
+
+  // Length: short form, or 8n followed by n bytes
+  if (pos >= data.size())
+    return TlvStatus::Incomplete;
+  size_t length = data[pos++];
+  if (length & 0x80) {
+    size_t count = length & 0x7F;
+    if (count == 0 || count > MAX_LENGTH_BYTES)
+      return TlvStatus::Malformed; // indefinite or oversized
+    if (data.size() - pos < count)
+      return TlvStatus::Incomplete;
+    length = 0;
+    for (size_t i = 0; i < count; i++)
+      length = (length << 8) | data[pos++];
+  }
+
+  if (data.size() - pos < length)
+    return TlvStatus::Incomplete;
+  tlv.tag = tag;
+  tlv.offset = start;
+  tlv.headerLength = pos - start;
+  tlv.value = data.subspan(pos, length);
+  return TlvStatus::Ok;
+}
+
+bool TlvReader::next(Tlv &tlv) {
+  while (m_pos < m_data.size() && isPadding(m_data[m_pos]))
+    m_pos++;
+  if (m_pos >= m_data.size() || m_malformed)
+    return false;
+  if (parseTlv(m_data, m_pos, tlv) != TlvStatus::Ok) {
+    m_malformed = true;
+    return false;
+  }
+  m_pos = tlv.end();
+  return true;
+}
+
+bool findTlv(std::span<const BYTE> data, uint32_t tag, Tlv &tlv) {
+  TlvReader reader(data);
+  while (reader.next(tlv)) {
+    if (tlv.tag == tag)
+      return true;
+  }
+  return false;
+}
+
+TlvIndex::TlvIndex(std::span<const BYTE> data) {
+  size_t pos = 0;
+  while (pos < data.size()) {
+    if (isPadding(data[pos])) {
+      pos++;
+      continue;
+    }
+    Tlv tlv;
+    if (parseTlv(data, pos, tlv) != TlvStatus::Ok) {
+      m_malformed = true;
+      break;
+    }
+    m_objects.push_back(tlv);
+    if (tlv.constructed())
+      addChildren(tlv, data);
+    pos = tlv.end();
+  }
+}
+
+void TlvIndex::addChildren(const Tlv &parent, std::span<const BYTE> data) {
+  // A constructed value that does not parse is kept as a whole; only its
+  // children are left out.
+  std::vector<Tlv> children;
+  if (indexLevel(data, parent.offset + parent.headerLength, parent.end(),
+                 children))
+    m_objects.insert(m_objects.end(), children.begin(), children.end());
+}
+
+const Tlv *TlvIndex::find(uint32_t tag) const {
+  for (const Tlv &tlv : m_objects) {
+    if (tlv.tag == tag)
+      return &tlv;
+  }
+  return nullptr;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "Pcsc.hpp"
+
+/**
+ * One BER-TLV data object, pointing into the buffer it was parsed from.
+ */
+struct Tlv {
+  uint32_t tag = 0;        // tag bytes as a big-endian number, e.g. 0x9F7F
+  size_t offset = 0;       // of the first tag byte in the parsed buffer
+  size_t headerLength = 0; // tag and length bytes
+  std::span<const BYTE> value;
+
+  // Bit 6 of the first tag byte: the value holds further objects
+  bool constructed() const {
+    return ((tag >> (8 * (tagLength() - 1))) & 0x20) != 0;
+  }
+  size_t tagLength() const { return tag > 0xFFFF ? 3 : tag > 0xFF ? 2 : 1; }
+  size_t end() const { return offset + headerLength + value.size(); }
+};
+
+enum class TlvStatus {
+  Ok,
+  Incomplete, // the object runs past the end of the bytes given
+  Malformed,
+};
+
+/**
+ * Parses the object starting at `data[pos]`. Tags of up to three bytes and
+ * definite lengths in short form or 81 to 84 are accepted.
+ */
+TlvStatus parseTlv(std::span<const BYTE> data, size_t pos, Tlv &tlv);
+
+/**
+ * Walks the objects of one level of a buffer in order, in place. 00 and FF
+ * bytes between objects are padding and skipped.
+ */
+class TlvReader {
+public:
+  explicit TlvReader(std::span<const BYTE> data) : m_data(data) {}
+
+  /** Returns false at the end of the buffer or on a malformed object. */
+  bool next(Tlv &tlv);
+
+  bool malformed() const { return m_malformed; }
+
+private:
+  std::span<const BYTE> m_data;
+  size_t m_pos = 0;
+  bool m_malformed = false;
+};
+
+/** Finds the first object tagged `tag` on the top level of `data`. */
+bool findTlv(std::span<const BYTE> data, uint32_t tag, Tlv &tlv);
+
+/**
+ * A tag index over the objects of a buffer, and over the objects inside
+ * constructed ones, built in one pass without copying. The buffer must not
+ * move while the index is in use.
+ */
+class TlvIndex {
+public:
+  explicit TlvIndex(std::span<const BYTE> data);
+
+  /** The first object tagged `tag`, in buffer order, or nullptr. */
+  const Tlv *find(uint32_t tag) const;
+
+  const std::vector<Tlv> &objects() const { return m_objects; }
+  /** True if the buffer did not parse to its end; what came before counts. */
+  bool malformed() const { return m_malformed; }
+
+private:
+  void addChildren(const Tlv &parent, std::span<const BYTE> data);
+
+  std::vector<Tlv> m_objects;
+  bool m_malformed = false;
+};
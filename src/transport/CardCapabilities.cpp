@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "CardCapabilities.hpp"
+
+namespace {
+
+// Category indicators of the historical bytes
+constexpr BYTE CATEGORY_TLV_WITH_STATUS = 0x00; // status in the last 3 bytes
+constexpr BYTE CATEGORY_TLV = 0x80;
+
+constexpr BYTE TAG_CARD_CAPABILITIES = 0x7;
+constexpr BYTE EXTENDED_LENGTH_BIT = 0x40;
+
+} // namespace
+
+std::optional<size_t> dataUnitFromCoding(BYTE dataCoding) {
+  // 1 means two quartets, one byte
+  BYTE power = dataCoding & 0x0F;
+  if (power == 0 || power > 8)
+    return std::nullopt;
+  return size_t{1} << (power - 1);
+}
+
+CardCapabilities parseAtrCapabilities(std::span<const BYTE> atr) {
+  // TS, T0
+  if (atr.size() < 2)
+    return {};
+
+  size_t historicalCount = atr[1] & 0x0F;
+  BYTE indicator = atr[1] >> 4; // Y1: which of TA/TB/TC/TD follow
+  size_t pos = 2;
+
+  // Walk the interface bytes; each TDi announces the next group.
+  while (true) {
+    for (BYTE bit = 0x1; bit <= 0x4; bit <<= 1) {
+      if (indicator & bit)
+        pos++;
+    }
+    if (!(indicator & 0x8))
+      break;
+    if (pos >= atr.size())
+      return {};
+    indicator = atr[pos] >> 4;
+    pos++;
+  }
+
+  if (pos + historicalCount > atr.size())
+    return {};
+  return parseHistoricalBytes(atr.subspan(pos, historicalCount));
+}
+
+CardCapabilities parseHistoricalBytes(std::span<const BYTE> historical) {
+  CardCapabilities capabilities;
+  if (historical.empty())
+    return capabilities;
+
+  std::span<const BYTE> objects;
+  if (historical[0] == CATEGORY_TLV) {
+    objects = historical.subspan(1);
+  } else if (historical[0] == CATEGORY_TLV_WITH_STATUS &&
+             historical.size() >= 4) {
+    objects = historical.subspan(1, historical.size() - 4);
+  } else {
+    return capabilities;
+  }
+
+  // Compact-TLV: high nibble is the tag, low nibble the length.
+  size_t pos = 0;
+  while (pos < objects.size()) {
+    BYTE tag = objects[pos] >> 4;
+    size_t length = objects[pos] & 0x0F;
+    pos++;
+    if (pos + length > objects.size())
+      break;
+
+    if (tag == TAG_CARD_CAPABILITIES && length >= 2)
+      capabilities.dataUnit =
+          dataUnitFromCoding(objects[pos + 1]).value_or(1);
+    if (tag == TAG_CARD_CAPABILITIES && length >= 3)
+      capabilities.extendedLength =
+          (objects[pos + 2] & EXTENDED_LENGTH_BIT) != 0;
+
+    pos += length;
+  }
+  return capabilities;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <span>
+
+#include "Pcsc.hpp"
+
+/**
+ * What the card announces about itself in its ATR (ISO 7816-4 section 8).
+ */
+struct CardCapabilities {
+  // Card capabilities object (compact-TLV tag 7), third byte, bit b7:
+  // the card accepts extended Lc/Le fields. nullopt if the ATR does not
+  // say, as on the MAV4 chips; CardTransport then tries once.
+  std::optional<bool> extendedLength;
+  // Bytes per READ BINARY offset step, from the same object's data coding
+  // byte (its second byte). Applets may differ; see
+  // CardTransport::dataUnitSize().
+  size_t dataUnit = 1;
+};
+
+/**
+ * Bytes per data unit announced by a data coding byte (ISO 7816-4,
+ * low nibble: the unit in quartets as a power of two). nullopt for
+ * half-byte units and sizes past 128 bytes, which no reader here handles.
+ */
+std::optional<size_t> dataUnitFromCoding(BYTE dataCoding);
+
+/**
+ * Parses the historical bytes out of a full ATR and decodes them with
+ * parseHistoricalBytes(). Malformed ATRs yield default capabilities.
+ */
+CardCapabilities parseAtrCapabilities(std::span<const BYTE> atr);
+
+/**
+ * Decodes the compact-TLV objects of historical bytes, or of the contents of
+ * EF.ATR, which uses the same encoding.
+ */
+CardCapabilities parseHistoricalBytes(std::span<const BYTE> historical);
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "CardLink.hpp"
+
+#include <stdexcept>
+
+#include "TransportError.hpp"
+
+namespace {
+
+LPCSCARD_IO_REQUEST pciForProtocol(DWORD activeProtocol) {
+  switch (activeProtocol) {
+  case SCARD_PROTOCOL_T0:
+    return SCARD_PCI_T0;
+  case SCARD_PROTOCOL_T1:
+    return SCARD_PCI_T1;
+  case SCARD_PROTOCOL_RAW:
+    return SCARD_PCI_RAW;
+  default:
+    throw std::invalid_argument("Unsupported card protocol");
+  }
+}
+
+} // namespace
+
+PcscLink::PcscLink(SCARDHANDLE cardHandle, DWORD activeProtocol,
+                   bool ownsHandle)
+    : m_cardHandle(cardHandle), m_sendPci(pciForProtocol(activeProtocol)),
+      m_ownsHandle(ownsHandle) {}
+
+PcscLink::~PcscLink() {
+  if (m_ownsHandle)
+    SCardDisconnect(m_cardHandle, SCARD_LEAVE_CARD);
+}
+
+size_t PcscLink::transmit(std::span<const BYTE> command,
+                          std::span<BYTE> response) {
+  DWORD responseLen = static_cast<DWORD>(response.size());
+  LONG status = SCardTransmit(m_cardHandle, m_sendPci, command.data(),
+                              static_cast<DWORD>(command.size()), nullptr,
+                              response.data(), &responseLen);
+  if (status != SCARD_S_SUCCESS)
+    throwPcscError("Transmit failed", status);
+  return responseLen;
+}
+
+LONG PcscLink::reconnect(DWORD initialization, DWORD &activeProtocol) {
+  DWORD protocol = 0;
+  LONG status = SCardReconnect(m_cardHandle, SCARD_SHARE_SHARED,
+                               SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1,
+                               initialization, &protocol);
+  if (status != SCARD_S_SUCCESS)
+    return status;
+
+  m_sendPci = pciForProtocol(protocol);
+  activeProtocol = protocol;
+  return SCARD_S_SUCCESS;
+}
+
+size_t PcscLink::readAtr(std::span<BYTE> atr) {
+  DWORD atrLen = static_cast<DWORD>(atr.size());
+  DWORD readerLen = 0, state = 0, protocol = 0;
+  LONG status = SCardStatusA(m_cardHandle, nullptr, &readerLen, &state,
+                             &protocol, atr.data(), &atrLen);
+  return status == SCARD_S_SUCCESS ? atrLen : 0;
+}
+
+LONG PcscLink::beginTransaction() {
+  return SCardBeginTransaction(m_cardHandle);
+}
+
+void PcscLink::endTransaction() {
+  SCardEndTransaction(m_cardHandle, SCARD_LEAVE_CARD);
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+#include "Pcsc.hpp"
+
+/**
+ * The wire under CardTransport: moves one command APDU to the card and its
+ * response back, with no T=0 or chaining logic of its own. PcscLink goes
+ * through a PC/SC card handle; a virtual card can stand in for it.
+ */
+class CardLink {
+public:
+  virtual ~CardLink() = default;
+
+  /**
+   * Sends `command` as is and stores the card's answer in `response`.
+   *
+   * @return the response length including SW1/SW2.
+   * @throws TransportError if the exchange fails.
+   */
+  virtual size_t transmit(std::span<const BYTE> command,
+                          std::span<BYTE> response) = 0;
+
+  /**
+   * Resets or re-powers the card like SCardReconnect. On success
+   * `activeProtocol` receives the protocol now in use.
+   *
+   * @return a PC/SC status code.
+   */
+  virtual LONG reconnect(DWORD initialization, DWORD &activeProtocol) = 0;
+
+  /** Copies the ATR into `atr` and returns its length, 0 if unknown. */
+  virtual size_t readAtr(std::span<BYTE> atr) = 0;
+
+  /**
+   * Claims the card for a sequence of commands, like SCardBeginTransaction.
+   * Links with a single user have nothing to claim.
+   *
+   * @return a PC/SC status code.
+   */
+  virtual LONG beginTransaction() { return SCARD_S_SUCCESS; }
+  virtual void endTransaction() {}
+
+  /**
+   * True if other processes may send to the card between two of our
+   * commands, unless a transaction holds it.
+   */
+  virtual bool shared() const { return false; }
+};
+
+/** CardLink over a handle returned by SCardConnect. */
+class PcscLink : public CardLink {
+public:
+  /**
+   * @param ownsHandle Disconnect the handle when the link is destroyed.
+   * @throws std::invalid_argument if the protocol is not T=0, T=1 or raw.
+   */
+  PcscLink(SCARDHANDLE cardHandle, DWORD activeProtocol,
+           bool ownsHandle = false);
+  ~PcscLink() override;
+
+  PcscLink(const PcscLink &) = delete;
+  PcscLink &operator=(const PcscLink &) = delete;
+
+  size_t transmit(std::span<const BYTE> command,
+                  std::span<BYTE> response) override;
+  LONG reconnect(DWORD initialization, DWORD &activeProtocol) override;
+  size_t readAtr(std::span<BYTE> atr) override;
+  LONG beginTransaction() override;
+  void endTransaction() override;
+  // Connected with SCARD_SHARE_SHARED
+  bool shared() const override { return true; }
+
+private:
+  SCARDHANDLE m_cardHandle;
+  LPCSCARD_IO_REQUEST m_sendPci;
+  bool m_ownsHandle;
+};
@@ -0,0 +1,384 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "CardTransport.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "ApduLog.hpp"
+#include "TransportError.hpp"
+
+namespace {
+
+void checkProtocol(DWORD activeProtocol) {
+  if (activeProtocol != SCARD_PROTOCOL_T0 &&
+      activeProtocol != SCARD_PROTOCOL_T1 &&
+      activeProtocol != SCARD_PROTOCOL_RAW)
+    throw std::invalid_argument("Unsupported card protocol");
+}
+
+// CLA INS P1 P2 Lc data Le
+bool isCase4(std::span<const BYTE> command) {
+  return command.size() > 5 && command[4] != 0 &&
+         command.size() == 5u + command[4] + 1;
+}
+
+// Header, 255 data bytes and up to three Le bytes
+constexpr size_t SHORT_COMMAND_MAX = 4 + 1 + 255 + 3;
+
+constexpr BYTE INS_SELECT = 0xA4;
+
+// A000000018300301, the MAV4 ID applet; the tools select it zero-padded
+constexpr BYTE MAV4_ID_AID[] = {0xA0, 0x00, 0x00, 0x00,
+                                0x18, 0x30, 0x03, 0x01};
+constexpr size_t MAV4_ID_DATA_UNIT = 4;
+constexpr BYTE INS_MANAGE_CHANNEL = 0x70;
+
+} // namespace
+
+CardTransport::CardTransport(SCARDHANDLE cardHandle, DWORD activeProtocol)
+    : m_ownedLink(std::make_unique<PcscLink>(cardHandle, activeProtocol)),
+      m_link(m_ownedLink.get()), m_cardHandle(cardHandle),
+      m_activeProtocol(activeProtocol) {
+  initCursors();
+}
+
+CardTransport::CardTransport(CardLink &link, DWORD activeProtocol)
+    : m_link(&link), m_cardHandle(0), m_activeProtocol(activeProtocol) {
+  checkProtocol(activeProtocol);
+  initCursors();
+}
+
+CardTransport::CardTransport(std::unique_ptr<CardLink> link,
+                             DWORD activeProtocol)
+    : m_ownedLink(std::move(link)), m_link(m_ownedLink.get()),
+      m_cardHandle(0), m_activeProtocol(activeProtocol) {
+  if (!m_link)
+    throw std::invalid_argument("No card link");
+  checkProtocol(activeProtocol);
+  initCursors();
+}
+
+void CardTransport::initCursors() {
+  for (BYTE channel = 0; channel < MAX_LOGICAL_CHANNELS; channel++)
+    m_cursors[channel] = SelectionCursor(channel);
+}
+
+ApduResponse CardTransport::transmit(std::span<const BYTE> command,
+                                     std::span<BYTE> responseBuffer) {
+  if (m_metrics)
+    m_metrics->beginCommand(command, fileOf(command),
+                            ApduMetrics::Clock::now());
+
+  ApduResponse response;
+  try {
+    response = transmitChained(command, responseBuffer);
+  } catch (const TransportError &e) {
+    // The card may have been reset or removed underneath us.
+    invalidateCursors();
+    if (e.fault() == TransportFault::CardReset) {
+      m_cardState = CardState::Unknown;
+      m_resetCount++;
+    } else {
+      m_cardState = CardState::Poisoned;
+    }
+    if (m_metrics)
+      m_metrics->endCommand(ApduMetrics::Clock::now());
+    throw;
+  } catch (...) {
+    invalidateCursors();
+    m_cardState = CardState::Poisoned;
+    if (m_metrics)
+      m_metrics->endCommand(ApduMetrics::Clock::now());
+    throw;
+  }
+  if (!command.empty())
+    m_cursors[classChannel(command[0])].observe(command, response.sw);
+  // Execution errors (64xx, 65xx) and 6Fxx may leave the card half-way.
+  if (response.sw.sw1 == 0x64 || response.sw.sw1 == 0x65 ||
+      response.sw.sw1 == 0x6F)
+    m_cardState = CardState::Poisoned;
+
+  if (m_metrics)
+    m_metrics->endCommand(ApduMetrics::Clock::now());
+  return response;
+}
+
+ApduResponse CardTransport::transmit(BYTE channel,
+                                     std::span<const BYTE> command,
+                                     std::span<BYTE> responseBuffer) {
+  if (channel >= MAX_LOGICAL_CHANNELS)
+    throw std::invalid_argument("Invalid logical channel");
+  if (command.empty() || classChannel(command[0]) == channel)
+    return transmit(command, responseBuffer);
+
+  BYTE buffer[SHORT_COMMAND_MAX];
+  std::vector<BYTE> large;
+  std::span<BYTE> rewritten(buffer, command.size());
+  if (command.size() > SHORT_COMMAND_MAX) {
+    large.resize(command.size());
+    rewritten = large;
+  }
+  std::memcpy(rewritten.data(), command.data(), command.size());
+  rewritten[0] = withChannel(command[0], channel);
+  return transmit(rewritten, responseBuffer);
+}
+
+ApduResponse
+CardTransport::transmitChained(std::span<const BYTE> command,
+                               std::span<BYTE> responseBuffer) {
+  std::span<const BYTE> sent = command;
+  if (m_activeProtocol == SCARD_PROTOCOL_T0 && isCase4(command))
+    sent = command.first(command.size() - 1);
+
+  size_t length = exchange(sent, responseBuffer);
+  StatusWord sw{responseBuffer[length - 2], responseBuffer[length - 1]};
+
+  // T=0 case 2: the card wants the exact Le
+  if (m_activeProtocol == SCARD_PROTOCOL_T0 && command.size() == 5 &&
+      sw.isWrongLength()) {
+    BYTE retry[5];
+    std::memcpy(retry, command.data(), 5);
+    retry[4] = sw.sw2;
+    length = exchange(retry, responseBuffer);
+    sw = {responseBuffer[length - 2], responseBuffer[length - 1]};
+  }
+
+  size_t collected = length - 2;
+  while (sw.hasMoreData()) {
+    size_t expected = sw.sw2 == 0 ? 256 : sw.sw2;
+    std::span<BYTE> remaining = responseBuffer.subspan(collected);
+    if (remaining.size() < expected + 2)
+      throw std::runtime_error("Response buffer too small for GET RESPONSE");
+
+    const BYTE getResponse[] = {withChannel(0x00, classChannel(command[0])),
+                                0xC0, 0x00, 0x00, sw.sw2};
+    length = exchange(getResponse, remaining);
+    sw = {remaining[length - 2], remaining[length - 1]};
+    collected += length - 2;
+  }
+
+  ApduResponse response;
+  response.data = responseBuffer.first(collected);
+  response.sw = sw;
+  return response;
+}
+
+size_t CardTransport::exchange(std::span<const BYTE> command,
+                               std::span<BYTE> response) {
+  logApdu<LogLevel::Debug>(LogRecord::Command, command);
+  size_t responseLen;
+  if (m_metrics) {
+    auto start = ApduMetrics::Clock::now();
+    responseLen = m_link->transmit(command, response);
+    m_metrics->recordExchange(command.size() > 1 ? command[1] : 0,
+                              command.size(), responseLen,
+                              ApduMetrics::Clock::now() - start);
+  } else {
+    responseLen = m_link->transmit(command, response);
+  }
+  logApdu<LogLevel::Debug>(LogRecord::Response, response.first(responseLen));
+  if (responseLen < 2)
+    throw TransportError(TransportFault::Failed, "Invalid response length");
+  return responseLen;
+}
+
+ApduResponse CardTransport::transmitChecked(std::span<const BYTE> command,
+                                            std::span<BYTE> responseBuffer) {
+  ApduResponse response = transmit(command, responseBuffer);
+  if (!response.sw.isSuccess()) {
+    char message[32];
+    snprintf(message, sizeof(message), "APDU failed. SW: %04X",
+             response.sw.value());
+    throw std::runtime_error(message);
+  }
+  return response;
+}
+
+ApduResponse CardTransport::select(const FilePath &path,
+                                   std::span<BYTE> responseBuffer,
+                                   bool returnFcp) {
+  return select(0, path, responseBuffer, returnFcp);
+}
+
+ApduResponse CardTransport::select(BYTE channel, const FilePath &path,
+                                   std::span<BYTE> responseBuffer,
+                                   bool returnFcp) {
+  SelectionCursor &cursor = m_cursors.at(channel);
+  // Without a transaction, someone else may have moved the selection.
+  if (!exclusive())
+    cursor.invalidate();
+  return cursor.select(*this, path, responseBuffer, returnFcp);
+}
+
+std::optional<BYTE> CardTransport::openChannel(std::span<BYTE> responseBuffer) {
+  const BYTE open[] = {0x00, INS_MANAGE_CHANNEL, 0x00, 0x00, 0x01};
+  ApduResponse response = transmit(open, responseBuffer);
+  if (!response.sw.isSuccess() || response.data.size() != 1)
+    return std::nullopt;
+
+  BYTE channel = response.data[0];
+  if (channel == 0 || channel >= MAX_LOGICAL_CHANNELS)
+    return std::nullopt;
+  // A new channel starts with the card's default selection.
+  m_cursors[channel].invalidate();
+  return channel;
+}
+
+StatusWord CardTransport::closeChannel(BYTE channel,
+                                       std::span<BYTE> responseBuffer) {
+  SelectionCursor &cursor = m_cursors.at(channel);
+  const BYTE close[] = {0x00, INS_MANAGE_CHANNEL, 0x80, channel};
+  StatusWord sw = transmit(close, responseBuffer).sw;
+  cursor.invalidate();
+  return sw;
+}
+
+LONG CardTransport::reconnect(DWORD initialization) {
+  invalidateCursors();
+  m_generation++;
+
+  auto start = ApduMetrics::Clock::now();
+  LONG status = m_link->reconnect(initialization, m_activeProtocol);
+  if (m_metrics)
+    m_metrics->recordReconnect(ApduMetrics::Clock::now() - start);
+  if (status != SCARD_S_SUCCESS) {
+    m_cardState = CardState::Poisoned;
+    return status;
+  }
+  m_capabilities.reset();
+  if (initialization != SCARD_LEAVE_CARD) {
+    m_cardState = CardState::Reset;
+    m_resetCount++;
+  }
+  return status;
+}
+
+bool CardTransport::needsReset(ResetPolicy policy) const {
+  switch (policy) {
+  case ResetPolicy::Always:
+    return true;
+  case ResetPolicy::WhenUnknown:
+    return m_cardState != CardState::Reset;
+  case ResetPolicy::WhenPoisoned:
+    return m_cardState == CardState::Poisoned;
+  }
+  return true;
+}
+
+LONG CardTransport::resetIfNeeded(ResetPolicy policy) {
+  if (!needsReset(policy))
+    return SCARD_S_SUCCESS;
+  return reconnect(SCARD_RESET_CARD);
+}
+
+LONG CardTransport::beginTransaction() {
+  LONG status = m_link->beginTransaction();
+  if (status != SCARD_S_SUCCESS)
+    return status;
+  if (!m_inTransaction && m_link->shared())
+    invalidateCursors();
+  m_inTransaction = true;
+  m_transactionStart = std::chrono::steady_clock::now();
+  return status;
+}
+
+void CardTransport::endTransaction() {
+  m_link->endTransaction();
+  m_inTransaction = false;
+}
+
+bool CardTransport::yieldTransaction() {
+  if (!m_inTransaction || m_hold.count() == 0 ||
+      std::chrono::steady_clock::now() - m_transactionStart < m_hold)
+    return false;
+
+  endTransaction();
+  LONG status = beginTransaction();
+  if (status != SCARD_S_SUCCESS)
+    throwPcscError("Failed to begin transaction", status);
+  return true;
+}
+
+const CardCapabilities &CardTransport::capabilities() {
+  if (!m_capabilities) {
+    // Without an ATR assume nothing beyond short APDUs.
+    m_atrLength = m_link->readAtr(m_atr);
+    m_capabilities =
+        parseAtrCapabilities(std::span(m_atr.data(), m_atrLength));
+  }
+  return *m_capabilities;
+}
+
+std::span<const BYTE> CardTransport::atr() {
+  if (!m_capabilities)
+    capabilities();
+  return std::span(m_atr.data(), m_atrLength);
+}
+
+bool CardTransport::supportsExtendedLength() {
+  return m_activeProtocol == SCARD_PROTOCOL_T1 &&
+         capabilities().extendedLength.value_or(true);
+}
+
+size_t CardTransport::dataUnitSize(BYTE channel) {
+  std::span<const BYTE> aid = m_cursors.at(channel).application();
+  if (aid.size() >= sizeof(MAV4_ID_AID) &&
+      std::equal(std::begin(MAV4_ID_AID), std::end(MAV4_ID_AID), aid.begin()))
+    return MAV4_ID_DATA_UNIT;
+  return capabilities().dataUnit;
+}
+
+void CardTransport::setExtendedLength(bool enabled) {
+  capabilities();
+  m_capabilities->extendedLength = enabled;
+}
+
+uint16_t CardTransport::fileOf(std::span<const BYTE> command) const {
+  if (command.size() < 4)
+    return 0;
+  // A SELECT by FID is charged to the file it selects.
+  if (command[1] == INS_SELECT && command[2] != 0x04 && command.size() >= 7 &&
+      command[4] == 2)
+    return static_cast<uint16_t>((command[5] << 8) | command[6]);
+  return m_cursors[classChannel(command[0])].currentFile();
+}
+
+void CardTransport::invalidateCursors() {
+  for (SelectionCursor &cursor : m_cursors)
+    cursor.invalidate();
+}
+
+CardTransaction::CardTransaction(CardTransport &transport)
+    : m_transport(transport), m_owned(!transport.inTransaction()) {
+  if (!m_owned)
+    return;
+  LONG status = transport.beginTransaction();
+  if (status != SCARD_S_SUCCESS)
+    throwPcscError("Failed to begin transaction", status);
+}
+
+CardTransaction::~CardTransaction() {
+  if (m_owned && m_transport.inTransaction())
+    m_transport.endTransaction();
+}
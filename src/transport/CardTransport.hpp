@@ -0,0 +1,308 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+
+#include "Apdu.hpp"
+#include "ApduMetrics.hpp"
+#include "CardCapabilities.hpp"
+#include "CardLink.hpp"
+#include "Pcsc.hpp"
+#include "SelectionCursor.hpp"
+
+/**
+ * What a transport knows about the card's volatile state: the selection, the
+ * security status and any secure-messaging session.
+ */
+enum class CardState {
+  Unknown,  // as connected, or after someone else reset the card
+  Reset,    // reset by this transport; every command since went through it
+  Poisoned, // an error that may have left the card in an undefined state
+};
+
+/** When a flow that wants a freshly reset card actually gets one. */
+enum class ResetPolicy {
+  Always,       // every time, as the vendor scripts do
+  WhenUnknown,  // unless this transport reset the card and nothing broke
+  WhenPoisoned, // only after an error that may have corrupted the state
+};
+
+/**
+ * Sends APDUs over an already connected PC/SC card handle, or any other
+ * CardLink.
+ *
+ * The protocol control information is picked once from the protocol that
+ * SCardConnect negotiated, and responses are written into buffers owned by
+ * the caller, so the hot path performs no heap allocation.
+ */
+class CardTransport {
+public:
+  /**
+   * @param cardHandle     Handle returned by SCardConnect.
+   * @param activeProtocol Protocol reported by SCardConnect (T=0, T=1 or raw).
+   * @throws std::invalid_argument if the protocol is not one of the above.
+   */
+  CardTransport(SCARDHANDLE cardHandle, DWORD activeProtocol);
+
+  /**
+   * Sends through `link`, which must outlive the transport.
+   *
+   * @param activeProtocol Protocol the link behaves as (T=0, T=1 or raw).
+   * @throws std::invalid_argument if the protocol is not one of the above.
+   */
+  CardTransport(CardLink &link, DWORD activeProtocol);
+
+  /** Sends through `link` and keeps it alive as long as the transport. */
+  CardTransport(std::unique_ptr<CardLink> link, DWORD activeProtocol);
+
+  /**
+   * Transmits `command` and stores the response in `responseBuffer`. Any
+   * status word is returned to the caller.
+   *
+   * A 61xx answer is followed by GET RESPONSE commands until the card has
+   * nothing left, and their data is appended contiguously in
+   * `responseBuffer`. On T=0 the Le of a case-4 command is dropped before
+   * sending, as the protocol cannot carry it, and a case-2 command answered
+   * with 6Cxx is re-sent with the corrected Le.
+   *
+   * @throws TransportError if the link fails or the card answers with fewer
+   *         than two bytes.
+   * @throws std::runtime_error if `responseBuffer` cannot hold the chained
+   *         response.
+   */
+  ApduResponse transmit(std::span<const BYTE> command,
+                        std::span<BYTE> responseBuffer);
+
+  /**
+   * transmit() on logical channel `channel`: the CLA byte of `command` is
+   * rewritten to address it.
+   *
+   * @throws std::invalid_argument if `channel` is not below
+   *         MAX_LOGICAL_CHANNELS.
+   */
+  ApduResponse transmit(BYTE channel, std::span<const BYTE> command,
+                        std::span<BYTE> responseBuffer);
+
+  /**
+   * Same as transmit(), but also throws std::runtime_error unless the card
+   * answers 9000.
+   */
+  ApduResponse transmitChecked(std::span<const BYTE> command,
+                               std::span<BYTE> responseBuffer);
+
+  /**
+   * Selects `path` through the connection's SelectionCursor, skipping the
+   * SELECTs that are already satisfied. Unless the transport is exclusive(),
+   * the cursor is not trusted and every SELECT is sent. See
+   * SelectionCursor::select().
+   */
+  ApduResponse select(const FilePath &path, std::span<BYTE> responseBuffer,
+                      bool returnFcp = false);
+
+  /** select() on logical channel `channel`, through that channel's cursor. */
+  ApduResponse select(BYTE channel, const FilePath &path,
+                      std::span<BYTE> responseBuffer, bool returnFcp = false);
+
+  SelectionCursor &cursor(BYTE channel = 0) { return m_cursors.at(channel); }
+
+  /**
+   * Opens a logical channel with MANAGE CHANNEL. The card picks the number.
+   *
+   * @return the new channel, or nothing if the card has no channel left or
+   *         does not support them.
+   */
+  std::optional<BYTE> openChannel(std::span<BYTE> responseBuffer);
+
+  /** Closes `channel` with MANAGE CHANNEL and returns the card's SW. */
+  StatusWord closeChannel(BYTE channel, std::span<BYTE> responseBuffer);
+
+  /**
+   * Re-establishes the connection with SCardReconnect (or the link's
+   * equivalent) and picks the PCI for the renegotiated protocol. The
+   * selection cursors are reset. A successful reset or unpower leaves the
+   * card in CardState::Reset; a failed reconnect poisons it.
+   *
+   * @param initialization SCARD_LEAVE_CARD, SCARD_RESET_CARD or
+   *                       SCARD_UNPOWER_CARD.
+   * @return PC/SC status code of SCardReconnect.
+   */
+  LONG reconnect(DWORD initialization);
+
+  /** True if `policy` calls for a reset in the current card state. */
+  bool needsReset(ResetPolicy policy) const;
+
+  /**
+   * Resets the card with SCARD_RESET_CARD if `policy` calls for it, so that
+   * flows sharing a connection reset it once rather than each in turn.
+   *
+   * @return SCARD_S_SUCCESS if no reset was needed, else the status of the
+   *         reconnect.
+   */
+  LONG resetIfNeeded(ResetPolicy policy);
+
+  CardState cardState() const { return m_cardState; }
+
+  /**
+   * Incremented whenever the card is reset, by reconnect() or by someone
+   * else. Secure-messaging sessions and security status set up under an
+   * earlier value are gone; the selection cursors already start over.
+   */
+  uint32_t resetCount() const { return m_resetCount; }
+
+  /**
+   * Claims the card for this transport until endTransaction(), with
+   * SCardBeginTransaction or the link's equivalent. On a shared link the
+   * selection cursors start over, as another process may have moved the
+   * selection since our last command.
+   *
+   * @return PC/SC status code.
+   */
+  LONG beginTransaction();
+  void endTransaction();
+
+  /** True between a successful beginTransaction() and endTransaction(). */
+  bool inTransaction() const { return m_inTransaction; }
+
+  /**
+   * True if no other process can send to the card between our commands:
+   * inside a transaction, or on a link nobody else uses. Only then does
+   * select() trust the cursor to skip SELECTs.
+   */
+  bool exclusive() const { return m_inTransaction || !m_link->shared(); }
+
+  /**
+   * Longest a transaction is held before yieldTransaction() lets other
+   * processes in, e.g. a monitoring agent polling the same reader. Zero,
+   * the default, holds it until endTransaction().
+   */
+  void setTransactionHold(std::chrono::milliseconds hold) { m_hold = hold; }
+
+  /**
+   * Call between logical operations. If the transaction has been held
+   * longer than the hold time, ends it and begins a new one.
+   *
+   * @return true if it did; the selection must then be made again.
+   * @throws TransportError if the new transaction cannot be begun.
+   */
+  bool yieldTransaction();
+
+  /**
+   * Capabilities decoded from the card's ATR. The ATR is fetched with
+   * SCardStatus on first use and again after every reconnect.
+   */
+  const CardCapabilities &capabilities();
+
+  /** The card's ATR, fetched together with capabilities(). */
+  std::span<const BYTE> atr();
+
+  /**
+   * True if extended-length APDUs may be sent: the protocol is T=1 and the
+   * card announces them or its ATR is silent. In the latter case the first
+   * extended command is the probe; readBinary() calls setExtendedLength()
+   * with false when it is rejected, so a session pays for at most one.
+   * Never on T=0, which maps an extended Le onto P3=00 and GET RESPONSE
+   * (ISO 7816-3 12.2.3) and so saves no round trips.
+   */
+  bool supportsExtendedLength();
+
+  /**
+   * Bytes per READ BINARY offset step in the application selected on
+   * `channel`. The MAV4 ID applet addresses its EFs in 4-byte data units
+   * (its tools step P1P2 by Le/4); elsewhere the ATR decides, else 1. An
+   * FCP that carries a data coding byte overrides this; see readEf().
+   */
+  size_t dataUnitSize(BYTE channel = 0);
+
+  /**
+   * Forces extended-length support on or off, e.g. after the card or the
+   * reader rejected an extended command despite what the ATR claims.
+   */
+  void setExtendedLength(bool enabled);
+
+  /**
+   * Times every APDU into `metrics`, which must outlive the transport or be
+   * detached with nullptr. Without metrics nothing is measured.
+   */
+  void setMetrics(ApduMetrics *metrics) { m_metrics = metrics; }
+  ApduMetrics *metrics() const { return m_metrics; }
+
+  // 0 when sending through a CardLink other than PC/SC
+  SCARDHANDLE handle() const { return m_cardHandle; }
+  DWORD activeProtocol() const { return m_activeProtocol; }
+
+  /**
+   * Incremented by every reconnect(). Logical channels opened under an
+   * earlier value were closed by the card.
+   */
+  uint32_t generation() const { return m_generation; }
+
+private:
+  // transmit() without the cursor bookkeeping
+  ApduResponse transmitChained(std::span<const BYTE> command,
+                               std::span<BYTE> responseBuffer);
+
+  // One exchange on the link; returns the response length including SW1/SW2.
+  size_t exchange(std::span<const BYTE> command, std::span<BYTE> response);
+
+  // The file an APDU is charged to in the metrics
+  uint16_t fileOf(std::span<const BYTE> command) const;
+
+  void initCursors();
+  void invalidateCursors();
+
+  std::unique_ptr<CardLink> m_ownedLink;
+  CardLink *m_link;
+  SCARDHANDLE m_cardHandle;
+  DWORD m_activeProtocol;
+  std::optional<CardCapabilities> m_capabilities;
+  std::array<BYTE, 36> m_atr{};
+  size_t m_atrLength = 0;
+  std::array<SelectionCursor, MAX_LOGICAL_CHANNELS> m_cursors;
+  uint32_t m_generation = 0;
+  CardState m_cardState = CardState::Unknown;
+  uint32_t m_resetCount = 0;
+  bool m_inTransaction = false;
+  std::chrono::milliseconds m_hold{0};
+  std::chrono::steady_clock::time_point m_transactionStart;
+  ApduMetrics *m_metrics = nullptr;
+};
+
+/**
+ * Holds a transaction on a transport for one logical operation, or for a
+ * whole snapshot, and ends it when destroyed. Inside a transaction already
+ * held, e.g. an operation within a snapshot, it does nothing.
+ */
+class CardTransaction {
+public:
+  /** @throws TransportError if the transaction cannot be begun. */
+  explicit CardTransaction(CardTransport &transport);
+  ~CardTransaction();
+
+  CardTransaction(const CardTransaction &) = delete;
+  CardTransaction &operator=(const CardTransaction &) = delete;
+
+private:
+  CardTransport &m_transport;
+  bool m_owned;
+};
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "EfReader.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "BerTlv.hpp"
+
+namespace {
+
+constexpr BYTE TAG_FCP = 0x62;
+constexpr BYTE TAG_FMD = 0x64;
+constexpr BYTE TAG_FCI = 0x6F;
+constexpr BYTE TAG_DATA_BYTES = 0x80;
+constexpr BYTE TAG_TOTAL_BYTES = 0x81;
+constexpr BYTE TAG_FILE_DESCRIPTOR = 0x82;
+
+size_t bigEndian(std::span<const BYTE> value) {
+  size_t result = 0;
+  for (BYTE b : value)
+    result = (result << 8) | b;
+  return result;
+}
+
+// Reads the EF whose SELECT answered `selectResponse`, after the bytes `out`
+// already holds. If the transport throws, `out` keeps what was read.
+StatusWord readSelectedEf(CardTransport &transport,
+                          const ApduResponse &selectResponse,
+                          std::vector<BYTE> &out, std::span<BYTE> rx,
+                          size_t shortChunk, size_t maxSize) {
+  if (!selectResponse.sw.isSuccess())
+    return selectResponse.sw;
+
+  size_t size = parseFileSize(selectResponse.data).value_or(maxSize);
+  size = std::min(size, maxSize);
+  size_t unit = parseDataUnitSize(selectResponse.data).value_or(0);
+  ReadBinaryResult result;
+  result.length = std::min(out.size(), size);
+  out.resize(size);
+
+  try {
+    continueReadBinary(transport, 0, out, rx, result, shortChunk, unit);
+  } catch (...) {
+    out.resize(result.length);
+    throw;
+  }
+  out.resize(result.length);
+  return result.sw;
+}
+
+} // namespace
+
+std::optional<size_t> parseFileSize(std::span<const BYTE> selectResponse) {
+  Tlv outer;
+  if (parseTlv(selectResponse, 0, outer) != TlvStatus::Ok ||
+      (outer.tag != TAG_FCP && outer.tag != TAG_FCI && outer.tag != TAG_FMD))
+    return std::nullopt;
+
+  std::optional<size_t> totalBytes;
+  TlvReader reader(outer.value);
+  Tlv inner;
+  while (reader.next(inner)) {
+    size_t length = inner.value.size();
+    if (length > 0 && length <= sizeof(size_t)) {
+      if (inner.tag == TAG_DATA_BYTES)
+        return bigEndian(inner.value);
+      if (inner.tag == TAG_TOTAL_BYTES)
+        totalBytes = bigEndian(inner.value);
+    }
+  }
+  return totalBytes;
+}
+
+std::optional<size_t>
+parseDataUnitSize(std::span<const BYTE> selectResponse) {
+  Tlv outer;
+  if (parseTlv(selectResponse, 0, outer) != TlvStatus::Ok ||
+      (outer.tag != TAG_FCP && outer.tag != TAG_FCI && outer.tag != TAG_FMD))
+    return std::nullopt;
+
+  Tlv descriptor;
+  if (!findTlv(outer.value, TAG_FILE_DESCRIPTOR, descriptor) ||
+      descriptor.value.size() < 2)
+    return std::nullopt;
+  return dataUnitFromCoding(descriptor.value[1]);
+}
+
+StatusWord readEf(CardTransport &transport,
+                  std::span<const BYTE> selectCommand, std::vector<BYTE> &out,
+                  std::span<BYTE> rx, size_t shortChunk, size_t maxSize) {
+  out.clear();
+  return resumeEf(transport, selectCommand, out, rx, shortChunk, maxSize);
+}
+
+StatusWord readEf(CardTransport &transport, const FilePath &path,
+                  std::vector<BYTE> &out, std::span<BYTE> rx,
+                  size_t shortChunk, size_t maxSize) {
+  out.clear();
+  return resumeEf(transport, path, out, rx, shortChunk, maxSize);
+}
+
+StatusWord resumeEf(CardTransport &transport,
+                    std::span<const BYTE> selectCommand,
+                    std::vector<BYTE> &out, std::span<BYTE> rx,
+                    size_t shortChunk, size_t maxSize) {
+  // CLA INS P1 P2 Lc data, optionally followed by Le
+  if (selectCommand.size() < 5 || selectCommand.size() < 5u + selectCommand[4])
+    throw std::invalid_argument("Malformed SELECT command");
+  size_t headerAndData = 5u + selectCommand[4];
+
+  BYTE select[5 + 255 + 1];
+  std::memcpy(select, selectCommand.data(), headerAndData);
+  select[3] = 0x00; // return FCP
+  select[headerAndData] = 0x00;
+
+  ApduResponse response =
+      transport.transmit(std::span(select, headerAndData + 1), rx);
+  return readSelectedEf(transport, response, out, rx, shortChunk, maxSize);
+}
+
+StatusWord resumeEf(CardTransport &transport, const FilePath &path,
+                    std::vector<BYTE> &out, std::span<BYTE> rx,
+                    size_t shortChunk, size_t maxSize) {
+  ApduResponse response = transport.select(path, rx, true);
+  return readSelectedEf(transport, response, out, rx, shortChunk, maxSize);
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "Apdu.hpp"
+#include "CardTransport.hpp"
+#include "Pcsc.hpp"
+#include "ReadBinary.hpp"
+
+// Read limit for EFs whose SELECT response does not announce a size
+constexpr size_t DEFAULT_MAX_EF_SIZE = 0x2000;
+
+/**
+ * Returns the EF size announced in a SELECT response: the FCP (62), FCI (6F)
+ * or FMD (64) template, tag 80 (data bytes) or else tag 81 (total bytes).
+ */
+std::optional<size_t> parseFileSize(std::span<const BYTE> selectResponse);
+
+/**
+ * Returns the data unit size, in bytes, of the data coding byte in tag 82
+ * (after the file descriptor byte) of a SELECT response, if there is one.
+ */
+std::optional<size_t>
+parseDataUnitSize(std::span<const BYTE> selectResponse);
+
+/**
+ * Selects an EF and reads its whole content into `out`.
+ *
+ * `selectCommand` is the usual SELECT for the file (P2 may be 00 or 0C); it
+ * is sent with P2=00 and Le=00 so the card answers with the FCP. `out` is
+ * then sized to the announced length once and filled with the minimal run of
+ * exact-size READ BINARY commands, so no 6Cxx/6B00 round trips are needed.
+ * Offsets are counted in the data unit the FCP announces, else in
+ * CardTransport::dataUnitSize().
+ * Without a size in the answer, the EF is read to its end, up to `maxSize`.
+ *
+ * @return SW of the failing SELECT, or of the last READ BINARY.
+ * @throws TransportError on PC/SC failures. `out` then holds the bytes read
+ *         before the failure, for resumeEf().
+ */
+StatusWord readEf(CardTransport &transport,
+                  std::span<const BYTE> selectCommand, std::vector<BYTE> &out,
+                  std::span<BYTE> rx, size_t shortChunk = SHORT_READ_CHUNK,
+                  size_t maxSize = DEFAULT_MAX_EF_SIZE);
+
+/**
+ * Same as above, but reaches the EF through the transport's selection
+ * cursor, so only the final SELECT (for its FCP) is sent when the
+ * application and DFs are already selected.
+ */
+StatusWord readEf(CardTransport &transport, const FilePath &path,
+                  std::vector<BYTE> &out, std::span<BYTE> rx,
+                  size_t shortChunk = SHORT_READ_CHUNK,
+                  size_t maxSize = DEFAULT_MAX_EF_SIZE);
+
+/**
+ * Continues a readEf() that the transport interrupted: the EF is selected
+ * again for its size, the bytes already in `out` are kept and only the rest
+ * is read. With an empty `out` this is readEf().
+ */
+StatusWord resumeEf(CardTransport &transport,
+                    std::span<const BYTE> selectCommand,
+                    std::vector<BYTE> &out, std::span<BYTE> rx,
+                    size_t shortChunk = SHORT_READ_CHUNK,
+                    size_t maxSize = DEFAULT_MAX_EF_SIZE);
+StatusWord resumeEf(CardTransport &transport, const FilePath &path,
+                    std::vector<BYTE> &out, std::span<BYTE> rx,
+                    size_t shortChunk = SHORT_READ_CHUNK,
+                    size_t maxSize = DEFAULT_MAX_EF_SIZE);
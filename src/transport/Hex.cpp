@@ -0,0 +1,368 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Hex.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+
+// Vector kernels: SSE2 is part of x86-64, AVX2 is picked at run time, NEON
+// is part of AArch64. Anything else takes the table-driven scalar path.
+#if defined(__SSE2__) || defined(_M_X64) ||                                   \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HEX_SSE2 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define HEX_AVX2 1
+#define HEX_TARGET_AVX2
+#elif defined(__GNUC__)
+#define HEX_AVX2 1
+#define HEX_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define HEX_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+const char LOWER_DIGITS[] = "0123456789abcdef";
+const char UPPER_DIGITS[] = "0123456789ABCDEF";
+
+// Nibble value of every character, 0xFF for non-digits
+struct DigitTable {
+  BYTE value[256];
+  constexpr DigitTable() : value() {
+    for (int c = 0; c < 256; c++)
+      value[c] = 0xFF;
+    for (int i = 0; i < 10; i++)
+      value['0' + i] = static_cast<BYTE>(i);
+    for (int i = 0; i < 6; i++) {
+      value['a' + i] = static_cast<BYTE>(10 + i);
+      value['A' + i] = static_cast<BYTE>(10 + i);
+    }
+  }
+};
+constexpr DigitTable DIGIT_VALUES;
+
+void encodeScalar(const BYTE *bytes, size_t count, char *out,
+                  const char *digits) {
+  for (size_t i = 0; i < count; i++) {
+    out[2 * i] = digits[bytes[i] >> 4];
+    out[2 * i + 1] = digits[bytes[i] & 0x0F];
+  }
+}
+
+bool decodeScalar(const char *hex, size_t count, BYTE *out) {
+  BYTE invalid = 0;
+  for (size_t i = 0; i < count; i++) {
+    BYTE high = DIGIT_VALUES.value[static_cast<BYTE>(hex[2 * i])];
+    BYTE low = DIGIT_VALUES.value[static_cast<BYTE>(hex[2 * i + 1])];
+    invalid |= (high | low) & 0xF0;
+    out[i] = static_cast<BYTE>(high << 4 | low);
+  }
+  return invalid == 0;
+}
+
+#ifdef HEX_SSE2
+
+// Letters start at 'a' (or 'A'); digits 10-15 need this added past '0' + n
+inline int letterOffset(HexCase letters) {
+  return letters == HexCase::Upper ? 'A' - '0' - 10 : 'a' - '0' - 10;
+}
+
+// Nibbles to ASCII digits
+inline __m128i nibblesToAscii(__m128i nibbles, __m128i letter) {
+  __m128i isLetter = _mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9));
+  return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')),
+                      _mm_and_si128(isLetter, letter));
+}
+
+size_t encodeSse2(const BYTE *bytes, size_t count, char *out,
+                  HexCase letters) {
+  const __m128i mask = _mm_set1_epi8(0x0F);
+  const __m128i letter =
+      _mm_set1_epi8(static_cast<char>(letterOffset(letters)));
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i));
+    __m128i high = nibblesToAscii(_mm_and_si128(_mm_srli_epi16(v, 4), mask),
+                                  letter);
+    __m128i low = nibblesToAscii(_mm_and_si128(v, mask), letter);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i),
+                     _mm_unpacklo_epi8(high, low));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i + 16),
+                     _mm_unpackhi_epi8(high, low));
+  }
+  return i;
+}
+
+// x < limit for unsigned bytes, as an all-ones mask
+inline __m128i lessThan(__m128i x, BYTE limit) {
+  return _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(limit - 1)), x);
+}
+
+// ASCII digits to nibbles; `valid` is cleared for non-digits
+inline __m128i asciiToNibbles(__m128i chars, __m128i &valid) {
+  __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+  __m128i alpha = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)),
+                               _mm_set1_epi8('a'));
+  __m128i isDigit = lessThan(digit, 10);
+  __m128i isAlpha = lessThan(alpha, 6);
+  valid = _mm_and_si128(valid, _mm_or_si128(isDigit, isAlpha));
+  return _mm_or_si128(
+      _mm_and_si128(isDigit, digit),
+      _mm_and_si128(isAlpha, _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+}
+
+// Pairs of nibbles, high first, to 8 bytes in the low half of 16-bit lanes
+inline __m128i joinNibbles(__m128i nibbles) {
+  __m128i high = _mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0xFF)),
+                                4);
+  return _mm_or_si128(high, _mm_srli_epi16(nibbles, 8));
+}
+
+size_t decodeSse2(const char *hex, size_t count, BYTE *out, bool &ok) {
+  __m128i valid = _mm_set1_epi8(-1);
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i first = asciiToNibbles(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(hex + 2 * i)),
+        valid);
+    __m128i second = asciiToNibbles(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(hex + 2 * i + 16)),
+        valid);
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i *>(out + i),
+        _mm_packus_epi16(joinNibbles(first), joinNibbles(second)));
+  }
+  ok = _mm_movemask_epi8(valid) == 0xFFFF;
+  return i;
+}
+
+#ifdef HEX_AVX2
+
+bool cpuHasAvx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+  __cpuid(info, 1);
+  bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 0x6) == 0x6;
+  __cpuidex(info, 7, 0);
+  return osSavesYmm && (info[1] & (1 << 5));
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+const bool HAS_AVX2 = cpuHasAvx2();
+
+HEX_TARGET_AVX2 size_t encodeAvx2(const BYTE *bytes, size_t count, char *out,
+                                  HexCase letters) {
+  const __m256i mask = _mm256_set1_epi8(0x0F);
+  const __m256i nine = _mm256_set1_epi8(9);
+  const __m256i zero = _mm256_set1_epi8('0');
+  const __m256i letter =
+      _mm256_set1_epi8(static_cast<char>(letterOffset(letters)));
+  size_t i = 0;
+  for (; i + 32 <= count; i += 32) {
+    __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes + i));
+    __m256i high = _mm256_and_si256(_mm256_srli_epi16(v, 4), mask);
+    __m256i low = _mm256_and_si256(v, mask);
+    high = _mm256_add_epi8(
+        _mm256_add_epi8(high, zero),
+        _mm256_and_si256(_mm256_cmpgt_epi8(high, nine), letter));
+    low = _mm256_add_epi8(
+        _mm256_add_epi8(low, zero),
+        _mm256_and_si256(_mm256_cmpgt_epi8(low, nine), letter));
+    // Unpacking works per 128-bit lane; put the lanes back in order.
+    __m256i first = _mm256_unpacklo_epi8(high, low);
+    __m256i second = _mm256_unpackhi_epi8(high, low);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 2 * i),
+                        _mm256_permute2x128_si256(first, second, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 2 * i + 32),
+                        _mm256_permute2x128_si256(first, second, 0x31));
+  }
+  return i;
+}
+
+HEX_TARGET_AVX2 inline __m256i lessThanAvx2(__m256i x, BYTE limit) {
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(x, _mm256_set1_epi8(limit - 1)),
+                           x);
+}
+
+HEX_TARGET_AVX2 inline __m256i asciiToNibblesAvx2(__m256i chars,
+                                                  __m256i &valid) {
+  __m256i digit = _mm256_sub_epi8(chars, _mm256_set1_epi8('0'));
+  __m256i alpha = _mm256_sub_epi8(
+      _mm256_or_si256(chars, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+  __m256i isDigit = lessThanAvx2(digit, 10);
+  __m256i isAlpha = lessThanAvx2(alpha, 6);
+  valid = _mm256_and_si256(valid, _mm256_or_si256(isDigit, isAlpha));
+  return _mm256_or_si256(
+      _mm256_and_si256(isDigit, digit),
+      _mm256_and_si256(isAlpha,
+                       _mm256_add_epi8(alpha, _mm256_set1_epi8(10))));
+}
+
+HEX_TARGET_AVX2 inline __m256i joinNibblesAvx2(__m256i nibbles) {
+  __m256i high = _mm256_slli_epi16(
+      _mm256_and_si256(nibbles, _mm256_set1_epi16(0xFF)), 4);
+  return _mm256_or_si256(high, _mm256_srli_epi16(nibbles, 8));
+}
+
+HEX_TARGET_AVX2 size_t decodeAvx2(const char *hex, size_t count, BYTE *out,
+                                  bool &ok) {
+  __m256i valid = _mm256_set1_epi8(-1);
+  size_t i = 0;
+  for (; i + 32 <= count; i += 32) {
+    __m256i first = asciiToNibblesAvx2(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(hex + 2 * i)),
+        valid);
+    __m256i second = asciiToNibblesAvx2(
+        _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(hex + 2 * i + 32)),
+        valid);
+    // Packing also works per lane: 64-bit blocks come out as 0 2 1 3.
+    __m256i packed = _mm256_packus_epi16(joinNibblesAvx2(first),
+                                         joinNibblesAvx2(second));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i),
+                        _mm256_permute4x64_epi64(packed, 0xD8));
+  }
+  ok = static_cast<uint32_t>(_mm256_movemask_epi8(valid)) == 0xFFFFFFFFu;
+  return i;
+}
+
+#endif // HEX_AVX2
+
+#endif // HEX_SSE2
+
+#ifdef HEX_NEON
+
+inline uint8x16_t nibblesToAscii(uint8x16_t nibbles, uint8x16_t letter) {
+  uint8x16_t isLetter = vcgtq_u8(nibbles, vdupq_n_u8(9));
+  return vaddq_u8(vaddq_u8(nibbles, vdupq_n_u8('0')),
+                  vandq_u8(isLetter, letter));
+}
+
+size_t encodeNeon(const BYTE *bytes, size_t count, char *out,
+                  HexCase letters) {
+  const uint8x16_t letter = vdupq_n_u8(static_cast<uint8_t>(
+      letters == HexCase::Upper ? 'A' - '0' - 10 : 'a' - '0' - 10));
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    uint8x16_t v = vld1q_u8(bytes + i);
+    uint8x16x2_t digits;
+    digits.val[0] = nibblesToAscii(vshrq_n_u8(v, 4), letter);
+    digits.val[1] = nibblesToAscii(vandq_u8(v, vdupq_n_u8(0x0F)), letter);
+    vst2q_u8(reinterpret_cast<uint8_t *>(out + 2 * i), digits); // interleaves
+  }
+  return i;
+}
+
+inline uint8x16_t asciiToNibbles(uint8x16_t chars, uint8x16_t &valid) {
+  uint8x16_t digit = vsubq_u8(chars, vdupq_n_u8('0'));
+  uint8x16_t alpha =
+      vsubq_u8(vorrq_u8(chars, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+  uint8x16_t isDigit = vcltq_u8(digit, vdupq_n_u8(10));
+  uint8x16_t isAlpha = vcltq_u8(alpha, vdupq_n_u8(6));
+  valid = vandq_u8(valid, vorrq_u8(isDigit, isAlpha));
+  return vbslq_u8(isDigit, digit, vaddq_u8(alpha, vdupq_n_u8(10)));
+}
+
+size_t decodeNeon(const char *hex, size_t count, BYTE *out, bool &ok) {
+  uint8x16_t valid = vdupq_n_u8(0xFF);
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    // Deinterleaves high and low digits
+    uint8x16x2_t chars =
+        vld2q_u8(reinterpret_cast<const uint8_t *>(hex + 2 * i));
+    uint8x16_t high = asciiToNibbles(chars.val[0], valid);
+    uint8x16_t low = asciiToNibbles(chars.val[1], valid);
+    vst1q_u8(out + i, vorrq_u8(vshlq_n_u8(high, 4), low));
+  }
+  ok = vminvq_u8(valid) == 0xFF;
+  return i;
+}
+
+#endif // HEX_NEON
+
+} // namespace
+
+void encodeHex(std::span<const BYTE> bytes, char *out, HexCase letters) {
+  const BYTE *data = bytes.data();
+  size_t count = bytes.size();
+  size_t done = 0;
+#if defined(HEX_AVX2)
+  if (HAS_AVX2)
+    done = encodeAvx2(data, count, out, letters);
+#endif
+#if defined(HEX_SSE2)
+  done += encodeSse2(data + done, count - done, out + 2 * done, letters);
+#elif defined(HEX_NEON)
+  done = encodeNeon(data, count, out, letters);
+#endif
+  encodeScalar(data + done, count - done, out + 2 * done,
+               letters == HexCase::Upper ? UPPER_DIGITS : LOWER_DIGITS);
+}
+
+bool decodeHex(std::string_view hex, std::span<BYTE> out) {
+  if (hex.size() / 2 < out.size())
+    throw std::invalid_argument("Hex string shorter than its output");
+
+  const char *text = hex.data();
+  BYTE *data = out.data();
+  size_t count = out.size();
+  size_t done = 0;
+  bool ok = true;
+#if defined(HEX_AVX2)
+  if (HAS_AVX2)
+    done = decodeAvx2(text, count, data, ok);
+#endif
+#if defined(HEX_SSE2)
+  bool sse2Ok;
+  done += decodeSse2(text + 2 * done, count - done, data + done, sse2Ok);
+  ok = ok && sse2Ok;
+#elif defined(HEX_NEON)
+  done = decodeNeon(text, count, data, ok);
+#endif
+  return decodeScalar(text + 2 * done, count - done, data + done) && ok;
+}
+
+void appendHex(std::string &out, std::span<const BYTE> bytes,
+               HexCase letters) {
+  size_t pos = out.size();
+  out.resize(pos + bytes.size() * 2);
+  encodeHex(bytes, out.data() + pos, letters);
+}
+
+std::string bytesToHexString(std::span<const BYTE> bytes) {
+  std::string hex;
+  appendHex(hex, bytes);
+  return hex;
+}
+
+std::vector<BYTE> hexStringToBytes(std::string_view hex) {
+  std::vector<BYTE> bytes(hex.size() / 2);
+  if (!decodeHex(hex, bytes))
+    throw std::invalid_argument("Not a hex string: " + std::string(hex));
+  return bytes;
+}
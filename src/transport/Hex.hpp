@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Pcsc.hpp"
+
+/**
+ * Hex text for card data, at the edge where it is printed or logged. Card
+ * data itself stays in byte buffers.
+ */
+
+enum class HexCase { Lower, Upper };
+
+/**
+ * Writes two digits per byte of `bytes` to `out`, which must have room for
+ * 2 * bytes.size() characters. Uses SSE2, AVX2 or NEON where available.
+ */
+void encodeHex(std::span<const BYTE> bytes, char *out,
+               HexCase letters = HexCase::Lower);
+
+/**
+ * Decodes the first 2 * out.size() digits of `hex`, either case, into `out`.
+ *
+ * @return false if one of them is not a hex digit; `out` is then partly
+ *         written.
+ * @throws std::invalid_argument if `hex` is too short.
+ */
+bool decodeHex(std::string_view hex, std::span<BYTE> out);
+
+/** Appends two digits per byte of `bytes` to `out`. */
+void appendHex(std::string &out, std::span<const BYTE> bytes,
+               HexCase letters = HexCase::Lower);
+
+/** `bytes` as lowercase hex, e.g. "3f00". */
+std::string bytesToHexString(std::span<const BYTE> bytes);
+
+/**
+ * Parses pairs of hex digits, either case. A trailing odd digit is ignored.
+ *
+ * @throws std::invalid_argument on a character that is not a hex digit.
+ */
+std::vector<BYTE> hexStringToBytes(std::string_view hex);
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/*
+ * The PC/SC API of the platform: WinSCard on Windows, pcsc-lite elsewhere.
+ * Include this instead of <windows.h> and <winscard.h>.
+ */
+
+#ifdef _WIN32
+// Keeps the old winsock.h out, so Winsock 2 can be included after this
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <winscard.h>
+
+#pragma comment(lib, "winscard.lib")
+#else
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+
+// pcsc-lite has no ANSI and wide variants; map the names used here.
+#define SCardListReadersA SCardListReaders
+#define SCardConnectA SCardConnect
+#define SCardStatusA SCardStatus
+#define SCardGetStatusChangeA SCardGetStatusChange
+#define SCARD_READERSTATEA SCARD_READERSTATE
+#endif
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ReadBinary.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// READ BINARY with INS B0 carries the offset, in data units, in 15 bits of
+// P1P2.
+constexpr size_t MAX_OFFSET = 0x7FFF;
+
+ApduResponse sendShortRead(CardTransport &transport, size_t offset,
+                           size_t length, std::span<BYTE> rx) {
+  const BYTE command[] = {0x00,
+                          0xB0,
+                          static_cast<BYTE>(offset >> 8),
+                          static_cast<BYTE>(offset),
+                          static_cast<BYTE>(length)}; // 0x100 -> Le=00
+  return transport.transmit(command, rx);
+}
+
+ApduResponse sendExtendedRead(CardTransport &transport, size_t offset,
+                              size_t length, std::span<BYTE> rx) {
+  // 00 B0 P1 P2 00 LeHi LeLo
+  const BYTE command[] = {0x00,
+                          0xB0,
+                          static_cast<BYTE>(offset >> 8),
+                          static_cast<BYTE>(offset),
+                          0x00,
+                          static_cast<BYTE>(length >> 8),
+                          static_cast<BYTE>(length)};
+  return transport.transmit(command, rx);
+}
+
+} // namespace
+
+ReadBinaryResult readBinary(CardTransport &transport, size_t offset,
+                            std::span<BYTE> out, std::span<BYTE> rx,
+                            size_t shortChunk, size_t dataUnit) {
+  ReadBinaryResult result;
+  continueReadBinary(transport, offset, out, rx, result, shortChunk,
+                     dataUnit);
+  return result;
+}
+
+void continueReadBinary(CardTransport &transport, size_t offset,
+                        std::span<BYTE> out, std::span<BYTE> rx,
+                        ReadBinaryResult &result, size_t shortChunk,
+                        size_t dataUnit) {
+  size_t unit = dataUnit ? dataUnit : transport.dataUnitSize();
+  if (offset % unit != 0)
+    throw std::invalid_argument("READ BINARY offset not on a data unit");
+  if (offset + out.size() > (MAX_OFFSET + 1) * unit)
+    throw std::invalid_argument("READ BINARY range exceeds 15-bit offsets");
+  if (result.length > out.size())
+    throw std::invalid_argument("READ BINARY progress past the buffer");
+  // Whole units per chunk, so the next one starts on a unit
+  shortChunk = std::clamp<size_t>(shortChunk, 1, SHORT_READ_CHUNK);
+  shortChunk = std::max(shortChunk - shortChunk % unit, unit);
+  result.sw = SW_SUCCESS;
+
+  while (result.length < out.size()) {
+    size_t remaining = out.size() - result.length;
+    size_t position = offset + result.length;
+    if (position % unit != 0)
+      throw std::invalid_argument("READ BINARY resumed off a data unit");
+    position /= unit;
+    size_t requested = 0;
+    bool lastChunk = false;
+    ApduResponse response;
+
+    bool extended = rx.size() >= EXTENDED_READ_CHUNK + 2 &&
+                    remaining > shortChunk &&
+                    transport.supportsExtendedLength();
+    if (extended) {
+      requested = std::min(remaining, EXTENDED_READ_CHUNK);
+      response = sendExtendedRead(transport, position, requested, rx);
+      if (response.sw.isCommandRejected()) {
+        transport.setExtendedLength(false);
+        continue;
+      }
+      // SW2 cannot express an extended length; redo this chunk short.
+      if (response.sw.isWrongLength())
+        extended = false;
+    }
+
+    if (!extended) {
+      requested = std::min(remaining, shortChunk);
+      response = sendShortRead(transport, position, requested, rx);
+      if (response.sw.isWrongLength()) {
+        requested = response.sw.sw2 == 0 ? SHORT_READ_CHUNK : response.sw.sw2;
+        requested = std::min(requested, remaining);
+        response = sendShortRead(transport, position, requested, rx);
+        // The card only had that many bytes left.
+        lastChunk = true;
+      }
+    }
+
+    result.sw = response.sw;
+    if (!response.sw.isSuccess() && !response.sw.isWarning())
+      break;
+
+    size_t received = std::min(response.data.size(), remaining);
+    std::memcpy(out.data() + result.length, response.data.data(), received);
+    result.length += received;
+
+    // A short answer or a warning (6282: end of file) ends the file.
+    if (lastChunk || received < requested || response.sw.isWarning())
+      break;
+  }
+}
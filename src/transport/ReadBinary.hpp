@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+#include "Apdu.hpp"
+#include "CardTransport.hpp"
+#include "Pcsc.hpp"
+
+// Largest Le of a short READ BINARY (Le=00)
+constexpr size_t SHORT_READ_CHUNK = 0x100;
+
+struct ReadBinaryResult {
+  // Bytes stored at the start of the output buffer
+  size_t length = 0;
+  // SW of the last READ BINARY. 9000, 62xx and 6B00 mean the read ended
+  // normally (buffer full or end of file); anything else stopped it early.
+  StatusWord sw;
+};
+
+/**
+ * True if a read stopped normally: buffer full (9000), end-of-file warning
+ * (62xx) or offset past the end (6B00).
+ */
+constexpr bool readCompleted(StatusWord sw) {
+  return sw.isSuccess() || sw.isWarning() || sw.isWrongParameters();
+}
+
+/**
+ * Reads up to `out.size()` bytes of the currently selected EF, starting at
+ * byte `offset`, stopping early at the end of the file.
+ *
+ * P1P2 counts data units of `dataUnit` bytes, or of
+ * transport.dataUnitSize() bytes if it is 0. `offset` must then fall on a
+ * unit, and every chunk but the last is a whole number of units.
+ *
+ * When the transport supports extended-length APDUs and `rx` can hold an
+ * ExtendedResponseBuffer, each command asks for EXTENDED_READ_CHUNK bytes
+ * (3-byte Le), so a certificate comes back in one or two round trips. A card
+ * or reader that rejects the extended form is switched to short APDUs for
+ * the rest of the connection and the chunk is retried. Short reads ask for at
+ * most `shortChunk` bytes and follow a 6Cxx with the exact length.
+ *
+ * @throws std::invalid_argument if `offset` is not on a data unit or the
+ *         range does not fit in 15-bit offsets.
+ * @throws TransportError on PC/SC failures.
+ */
+ReadBinaryResult readBinary(CardTransport &transport, size_t offset,
+                            std::span<BYTE> out, std::span<BYTE> rx,
+                            size_t shortChunk = SHORT_READ_CHUNK,
+                            size_t dataUnit = 0);
+
+/**
+ * readBinary() that carries on from `result.length` bytes already in `out`
+ * and updates `result` after every chunk. If the transport throws, the first
+ * `result.length` bytes of `out` are good, and calling again with the same
+ * `result` (after a reconnect, with the EF selected again) resumes there.
+ */
+void continueReadBinary(CardTransport &transport, size_t offset,
+                        std::span<BYTE> out, std::span<BYTE> rx,
+                        ReadBinaryResult &result,
+                        size_t shortChunk = SHORT_READ_CHUNK,
+                        size_t dataUnit = 0);
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ReaderMonitor.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "TransportError.hpp"
+
+namespace {
+
+// Pseudo reader whose state changes when a reader is attached or removed
+const char PNP_NOTIFICATION[] = "\\\\?PnP?\\Notification";
+
+// A mute card is in the reader but answered no ATR; treat it as absent.
+bool hasCard(DWORD state) {
+  return (state & SCARD_STATE_PRESENT) &&
+         !(state & (SCARD_STATE_MUTE | SCARD_STATE_UNKNOWN |
+                    SCARD_STATE_IGNORE));
+}
+
+} // namespace
+
+ReaderMonitor::ReaderMonitor() {
+  LONG status =
+      SCardEstablishContext(SCARD_SCOPE_SYSTEM, nullptr, nullptr, &m_context);
+  if (status != SCARD_S_SUCCESS) {
+    m_context = 0;
+    throwPcscError("Failed to establish context", status);
+  }
+  refreshReaders();
+}
+
+ReaderMonitor::~ReaderMonitor() {
+  if (m_context)
+    SCardReleaseContext(m_context);
+}
+
+bool ReaderMonitor::watch(const Callback &callback, DWORD timeoutMs) {
+  return watch(callback, timeoutMs, false);
+}
+
+bool ReaderMonitor::watch(const Callback &callback, DWORD timeoutMs,
+                          bool overall) {
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point deadline =
+      Clock::now() + std::chrono::milliseconds(timeoutMs);
+  overall = overall && timeoutMs != INFINITE;
+  for (;;) {
+    DWORD waitMs = timeoutMs;
+    if (overall) {
+      auto left = std::chrono::ceil<std::chrono::milliseconds>(
+          deadline - Clock::now());
+      waitMs = static_cast<DWORD>(std::max<Clock::rep>(left.count(), 0));
+    }
+    LONG status = SCardGetStatusChangeA(m_context, waitMs, m_states.data(),
+                                        static_cast<DWORD>(m_states.size()));
+    if (status == SCARD_E_TIMEOUT || status == SCARD_E_CANCELLED)
+      return false;
+    if (status != SCARD_S_SUCCESS)
+      throwPcscError("Failed to get reader status", status);
+
+    bool readersChanged = false;
+    for (size_t i = 0; i < m_states.size(); i++) {
+      SCARD_READERSTATEA &state = m_states[i];
+      DWORD event = state.dwEventState;
+      if (!(event & SCARD_STATE_CHANGED))
+        continue;
+
+      bool hadCard = hasCard(state.dwCurrentState);
+      state.dwCurrentState = event & ~SCARD_STATE_CHANGED;
+      if (i + 1 == m_states.size() ||
+          (event & (SCARD_STATE_UNKNOWN | SCARD_STATE_IGNORE)))
+        readersChanged = true;
+      if (i + 1 == m_states.size() || hasCard(event) == hadCard)
+        continue;
+
+      ReaderEvent readerEvent{hadCard ? ReaderEventKind::CardRemoved
+                                      : ReaderEventKind::CardInserted,
+                              m_names[i], {}};
+      if (!hadCard)
+        readerEvent.atr = std::span(state.rgbAtr, state.cbAtr);
+      if (!callback(readerEvent))
+        return true;
+    }
+
+    if (readersChanged)
+      refreshReaders();
+  }
+}
+
+std::optional<std::string> ReaderMonitor::waitForCard(DWORD timeoutMs) {
+  // A card seen by an earlier wait raises no new event.
+  for (size_t i = 0; i + 1 < m_states.size(); i++) {
+    if (hasCard(m_states[i].dwCurrentState)) {
+      m_lastAtr.assign(m_states[i].rgbAtr,
+                       m_states[i].rgbAtr + m_states[i].cbAtr);
+      return m_names[i];
+    }
+  }
+
+  std::optional<std::string> reader;
+  watch(
+      [&](const ReaderEvent &event) {
+        if (event.kind != ReaderEventKind::CardInserted)
+          return true;
+        reader = event.reader;
+        m_lastAtr.assign(event.atr.begin(), event.atr.end());
+        return false;
+      },
+      timeoutMs, true);
+  return reader;
+}
+
+void ReaderMonitor::cancel() { SCardCancel(m_context); }
+
+void ReaderMonitor::refreshReaders() {
+  std::vector<std::string> names;
+  LPSTR readersStr = nullptr;
+  DWORD readersLen = SCARD_AUTOALLOCATE;
+  // Without readers only the PnP notification is watched.
+  if (SCardListReadersA(m_context, nullptr, (LPSTR)&readersStr,
+                        &readersLen) == SCARD_S_SUCCESS) {
+    for (LPSTR current = readersStr; current && *current;
+         current += strlen(current) + 1)
+      names.push_back(current);
+    SCardFreeMemory(m_context, readersStr);
+  }
+  names.push_back(PNP_NOTIFICATION);
+
+  // Readers still attached keep their known state.
+  std::vector<SCARD_READERSTATEA> states(names.size());
+  for (size_t i = 0; i < names.size(); i++) {
+    auto known = std::find(m_names.begin(), m_names.end(), names[i]);
+    if (known != m_names.end())
+      states[i] = m_states[known - m_names.begin()];
+  }
+
+  m_names = std::move(names);
+  m_states = std::move(states);
+  for (size_t i = 0; i < m_states.size(); i++)
+    m_states[i].szReader = m_names[i].c_str();
+}
+
+bool waitForCard(DWORD timeoutMs) {
+  try {
+    ReaderMonitor monitor;
+    return monitor.waitForCard(timeoutMs).has_value();
+  } catch (const std::exception &) {
+    return false;
+  }
+}
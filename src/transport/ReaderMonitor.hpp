@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "Pcsc.hpp"
+
+// How long the src/read tools wait for a card before giving up
+constexpr DWORD CARD_WAIT_TIMEOUT_MS = 30000;
+
+enum class ReaderEventKind { CardInserted, CardRemoved };
+
+/** A card arriving in or leaving a reader. */
+struct ReaderEvent {
+  ReaderEventKind kind;
+  const std::string &reader;
+  std::span<const BYTE> atr; // CardInserted only; valid during the callback
+};
+
+/**
+ * Watches every PC/SC reader with SCardGetStatusChange, so a card is noticed
+ * as soon as the resource manager sees it instead of on the next poll.
+ * Readers plugged in or out while watching are picked up through the PnP
+ * notification reader.
+ *
+ * One thread runs watch(); any other may call cancel().
+ */
+class ReaderMonitor {
+public:
+  // Return false to stop watching.
+  using Callback = std::function<bool(const ReaderEvent &)>;
+
+  /** @throws TransportError if no PC/SC context can be established. */
+  ReaderMonitor();
+  ~ReaderMonitor();
+
+  ReaderMonitor(const ReaderMonitor &) = delete;
+  ReaderMonitor &operator=(const ReaderMonitor &) = delete;
+
+  /**
+   * Reports the cards already present, then every insertion and removal,
+   * until the callback returns false, `timeoutMs` passes without any change
+   * or cancel() is called.
+   *
+   * @return true if the callback stopped it, false on timeout or cancel.
+   * @throws TransportError if SCardGetStatusChange fails otherwise.
+   */
+  bool watch(const Callback &callback, DWORD timeoutMs = INFINITE);
+
+  /**
+   * Blocks until a reader holds a card and returns that reader's name. The
+   * card's ATR is then available from lastAtr(). Unlike watch(), readers
+   * coming and going do not restart `timeoutMs`; it bounds the whole wait.
+   *
+   * @return nothing on timeout or cancel.
+   */
+  std::optional<std::string> waitForCard(DWORD timeoutMs = INFINITE);
+
+  /** ATR of the card waitForCard() returned for. */
+  std::span<const BYTE> lastAtr() const { return m_lastAtr; }
+
+  /** Makes a blocked watch() or waitForCard() return false. Thread-safe. */
+  void cancel();
+
+private:
+  /** watch(); with `overall`, `timeoutMs` is counted from the first call. */
+  bool watch(const Callback &callback, DWORD timeoutMs, bool overall);
+  void refreshReaders();
+
+  SCARDCONTEXT m_context = 0;
+  std::vector<std::string> m_names; // last one is the PnP notification
+  std::vector<SCARD_READERSTATEA> m_states;
+  std::vector<BYTE> m_lastAtr;
+};
+
+/**
+ * Waits up to `timeoutMs` for a card in any reader, for tools that connect
+ * on their own afterwards.
+ *
+ * @return false on timeout or if PC/SC is not available.
+ */
+bool waitForCard(DWORD timeoutMs = CARD_WAIT_TIMEOUT_MS);
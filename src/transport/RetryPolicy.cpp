@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "RetryPolicy.hpp"
+
+#include <cstdio>
+#include <thread>
+
+#include "ApduLog.hpp"
+
+bool recoverTransport(CardTransport &transport, const RetryPolicy &policy,
+                      const TransportError &error, unsigned attempt) {
+  if (attempt == 0 || attempt > policy.maxReconnects ||
+      !policy.retries(error.fault()))
+    return false;
+
+  if (logEnabled(LogLevel::Warning)) {
+    char message[96];
+    snprintf(message, sizeof(message), "Reconnecting after %s (attempt %u)",
+             transportFaultName(error.fault()), attempt);
+    logMessage<LogLevel::Warning>(message);
+  }
+  std::this_thread::sleep_for(policy.delay * (1u << (attempt - 1)));
+
+  // A reset ends the transaction; release whatever is left of it.
+  bool inTransaction = transport.inTransaction();
+  if (inTransaction)
+    transport.endTransaction();
+
+  if (transport.reconnect(policy.initialization) != SCARD_S_SUCCESS)
+    return false;
+  return !inTransaction || transport.beginTransaction() == SCARD_S_SUCCESS;
+}
+
+StatusWord readEfWithRetry(CardTransport &transport, const FilePath &path,
+                           std::vector<BYTE> &out, std::span<BYTE> rx,
+                           const RetryPolicy &policy, size_t shortChunk,
+                           size_t maxSize) {
+  out.clear();
+  // The reconnect reset the selection cursor, so resumeEf() walks the whole
+  // path again before reading on.
+  return withRetry(transport, policy, [&] {
+    return resumeEf(transport, path, out, rx, shortChunk, maxSize);
+  });
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "CardTransport.hpp"
+#include "EfReader.hpp"
+#include "Pcsc.hpp"
+#include "TransportError.hpp"
+
+/** When and how to reconnect after a TransportError. */
+struct RetryPolicy {
+  // Reconnects allowed for one operation; 0 never recovers
+  unsigned maxReconnects = 2;
+  // Wait before the first reconnect, doubled for each one after it
+  std::chrono::milliseconds delay{50};
+  // SCardReconnect initialization. SCARD_LEAVE_CARD acknowledges a reset
+  // done by someone else without resetting the card again.
+  DWORD initialization = SCARD_LEAVE_CARD;
+
+  /**
+   * True for the faults a reconnect can fix: a reset card, a protocol
+   * mismatch (the reconnect renegotiates) and other link failures. A
+   * removed card or a vanished reader needs a new connection instead.
+   */
+  bool retries(TransportFault fault) const {
+    return fault != TransportFault::CardRemoved &&
+           fault != TransportFault::ReaderGone;
+  }
+};
+
+/**
+ * Reconnects `transport` after `error`, if `policy` retries that fault and
+ * `attempt` (1 for the first reconnect of an operation) is within its
+ * budget. A transaction the transport held is claimed again. The selection
+ * cursors start over, so the caller must select its files again.
+ *
+ * @return true if the transport is connected again.
+ */
+bool recoverTransport(CardTransport &transport, const RetryPolicy &policy,
+                      const TransportError &error, unsigned attempt);
+
+/**
+ * Runs `operation`, and after each TransportError that recoverTransport()
+ * recovers from, runs it again. `operation` must cope with a transport
+ * whose selection was reset.
+ *
+ * @throws TransportError once the policy gives up.
+ */
+template <typename Operation>
+auto withRetry(CardTransport &transport, const RetryPolicy &policy,
+               Operation &&operation) {
+  for (unsigned attempt = 1;; attempt++) {
+    try {
+      return operation();
+    } catch (const TransportError &error) {
+      if (!recoverTransport(transport, policy, error, attempt))
+        throw;
+    }
+  }
+}
+
+/**
+ * readEf() that rides out transport glitches: after a recoverable failure it
+ * reconnects, selects `path` again from the application down and resumes the
+ * read at the last offset that came back, instead of starting over.
+ *
+ * @throws TransportError once the policy gives up. `out` then holds the
+ *         bytes read so far.
+ */
+StatusWord readEfWithRetry(CardTransport &transport, const FilePath &path,
+                           std::vector<BYTE> &out, std::span<BYTE> rx,
+                           const RetryPolicy &policy = RetryPolicy(),
+                           size_t shortChunk = SHORT_READ_CHUNK,
+                           size_t maxSize = DEFAULT_MAX_EF_SIZE);
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "SelectionCursor.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "CardTransport.hpp"
+
+namespace {
+
+constexpr BYTE INS_SELECT = 0xA4;
+constexpr BYTE P1_BY_NAME = 0x04;
+constexpr BYTE P1_BY_FID = 0x00;
+constexpr BYTE P1_CHILD_DF = 0x01;
+constexpr BYTE P1_EF = 0x02;
+constexpr BYTE P2_RETURN_FCP = 0x00;
+
+uint16_t fidOf(std::span<const BYTE> data) {
+  return static_cast<uint16_t>((data[0] << 8) | data[1]);
+}
+
+} // namespace
+
+template <typename Send>
+ApduResponse SelectionCursor::sendSelect(Send &&send, BYTE p1, BYTE p2,
+                                         std::span<const BYTE> data,
+                                         Pending kind, bool requestFcp) {
+  BYTE command[5 + MAX_AID + 1];
+  command[0] = 0x00;
+  command[1] = INS_SELECT;
+  command[2] = p1;
+  command[3] = p2;
+  command[4] = static_cast<BYTE>(data.size());
+  std::memcpy(command + 5, data.data(), data.size());
+  size_t length = 5 + data.size();
+  if (requestFcp)
+    command[length++] = 0x00; // Le
+
+  m_pending = kind;
+  return send(std::span<const BYTE>(command, length));
+}
+
+template <typename Send>
+ApduResponse SelectionCursor::walk(const FilePath &path, bool returnFcp,
+                                   Send &&send) {
+  if (path.aid.size() > MAX_AID || path.dfs.size() > MAX_DEPTH)
+    throw std::invalid_argument("File path too long");
+
+  // Work out where the walk has to start.
+  bool selectApp = false;
+  size_t start = 0;
+  if (!path.aid.empty() && (!m_valid || !hasApplication(path.aid))) {
+    selectApp = true;
+  } else if (m_valid) {
+    size_t common = 0;
+    while (common < m_depth && common < path.dfs.size() &&
+           m_dfs[common] == path.dfs[common])
+      common++;
+
+    if (common == m_depth) {
+      start = common; // target is at or below the current DF
+    } else if (!path.dfs.empty() && path.dfs[0] == FID_MF) {
+      start = 0; // climb back up by selecting the MF
+    } else if (!path.aid.empty()) {
+      selectApp = true;
+    } else if (!path.dfs.empty() || path.ef) {
+      // Selecting dfs[0] as a child of an unrelated DF would land elsewhere.
+      throw std::invalid_argument(
+          "File path is not below the current DF; give its application or "
+          "start it at the MF");
+    }
+  }
+  bool selectEf = path.ef && (selectApp || start < path.dfs.size() ||
+                              m_ef != path.ef || returnFcp);
+
+  // Re-send the final SELECT when the caller needs its FCP.
+  bool reselectCurrent = false;
+  if (returnFcp && !selectEf && !selectApp && start == path.dfs.size()) {
+    if (!path.dfs.empty())
+      reselectCurrent = true;
+    else
+      selectApp = !path.aid.empty();
+  }
+
+  size_t needed = (path.aid.empty() ? 0 : 1) + path.dfs.size() +
+                  (path.ef ? 1 : 0);
+  size_t sent = 0;
+  ApduResponse last{{}, SW_SUCCESS};
+
+  auto finalP2 = [&](bool isLast) {
+    return isLast && returnFcp ? P2_RETURN_FCP : path.p2;
+  };
+
+  if (selectApp) {
+    // Applets are only selected by SELECT with P2=00
+    bool isLast = path.dfs.empty() && !path.ef;
+    last = sendSelect(send, P1_BY_NAME, P2_RETURN_FCP, path.aid,
+                      Pending::Application, isLast && returnFcp);
+    sent++;
+    if (!last.sw.isSuccess())
+      return last;
+  }
+
+  for (size_t i = start; i < path.dfs.size(); i++) {
+    BYTE fid[2] = {static_cast<BYTE>(path.dfs[i] >> 8),
+                   static_cast<BYTE>(path.dfs[i])};
+    bool isMf = i == 0 && path.dfs[i] == FID_MF;
+    bool isLast = i + 1 == path.dfs.size() && !path.ef;
+    last = sendSelect(send, isMf ? P1_BY_FID : path.dfP1,
+                      finalP2(isLast), fid, Pending::Df,
+                      isLast && returnFcp);
+    sent++;
+    if (!last.sw.isSuccess())
+      return last;
+  }
+
+  if (reselectCurrent) {
+    BYTE fid[2] = {static_cast<BYTE>(path.dfs.back() >> 8),
+                   static_cast<BYTE>(path.dfs.back())};
+    last = sendSelect(send, P1_BY_FID, P2_RETURN_FCP, fid,
+                      Pending::Current, true);
+    sent++;
+  }
+
+  if (selectEf) {
+    BYTE fid[2] = {static_cast<BYTE>(*path.ef >> 8),
+                   static_cast<BYTE>(*path.ef)};
+    last = sendSelect(send, path.efP1, finalP2(true), fid, Pending::Ef,
+                      returnFcp);
+    sent++;
+  }
+
+  if (sent < needed)
+    m_elided += needed - sent;
+  return last;
+}
+
+ApduResponse SelectionCursor::select(CardTransport &transport,
+                                     const FilePath &path, std::span<BYTE> rx,
+                                     bool returnFcp) {
+  return walk(path, returnFcp, [&](std::span<const BYTE> command) {
+    return transport.transmit(m_channel, command, rx);
+  });
+}
+
+void SelectionCursor::plan(const FilePath &path, bool returnFcp,
+                           std::vector<std::vector<BYTE>> &commands) {
+  walk(path, returnFcp, [&](std::span<const BYTE> command) {
+    commands.emplace_back(command.begin(), command.end());
+    observe(command, SW_SUCCESS);
+    return ApduResponse{{}, SW_SUCCESS};
+  });
+}
+
+bool SelectionCursor::isSelected(const FilePath &path) const {
+  if (!m_valid || m_depth != path.dfs.size() || m_ef != path.ef)
+    return false;
+  if (!path.aid.empty() && !hasApplication(path.aid))
+    return false;
+  return std::equal(path.dfs.begin(), path.dfs.end(), m_dfs.begin());
+}
+
+void SelectionCursor::observe(std::span<const BYTE> command, StatusWord sw) {
+  Pending pending = m_pending;
+  m_pending = Pending::None;
+  if (command.size() < 4)
+    return;
+
+  if (command[1] != INS_SELECT) {
+    // Errors that may leave the card in an unknown state
+    if (sw.sw1 == 0x64 || sw.sw1 == 0x65 || sw.sw1 == 0x6F)
+      invalidate();
+    return;
+  }
+
+  if (!sw.isSuccess()) {
+    invalidate();
+    return;
+  }
+
+  std::span<const BYTE> data;
+  if (command.size() > 5)
+    data = command.subspan(5, std::min<size_t>(command[4], command.size() - 5));
+  BYTE p1 = command[2];
+
+  if (p1 == P1_BY_NAME) {
+    setApplication(data);
+    return;
+  }
+  // Selections below an unknown application are not worth tracking.
+  if (!m_valid)
+    return;
+
+  if (pending == Pending::Current)
+    return;
+  if (p1 == P1_BY_FID && (data.empty() || fidOf(data) == FID_MF)) {
+    m_depth = 0;
+    pushDf(FID_MF);
+  } else if (data.size() != 2) {
+    invalidate();
+  } else if (pending == Pending::Df || p1 == P1_CHILD_DF) {
+    pushDf(fidOf(data));
+  } else if (pending == Pending::Ef || p1 == P1_EF) {
+    m_ef = fidOf(data);
+  } else {
+    // P1=00 by FID from outside the cursor: DF or EF is unknown
+    invalidate();
+  }
+}
+
+void SelectionCursor::invalidate() {
+  m_valid = false;
+  m_aidLength = 0;
+  m_depth = 0;
+  m_ef.reset();
+}
+
+void SelectionCursor::setApplication(std::span<const BYTE> aid) {
+  if (aid.size() > MAX_AID) {
+    invalidate();
+    return;
+  }
+  m_valid = true;
+  std::copy(aid.begin(), aid.end(), m_aid.begin());
+  m_aidLength = aid.size();
+  m_depth = 0;
+  m_ef.reset();
+}
+
+bool SelectionCursor::hasApplication(std::span<const BYTE> aid) const {
+  return aid.size() == m_aidLength &&
+         std::equal(aid.begin(), aid.end(), m_aid.begin());
+}
+
+void SelectionCursor::pushDf(uint16_t fid) {
+  if (m_depth == MAX_DEPTH) {
+    invalidate();
+    return;
+  }
+  m_dfs[m_depth++] = fid;
+  m_ef.reset();
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "Apdu.hpp"
+#include "Pcsc.hpp"
+
+class CardTransport;
+
+constexpr uint16_t FID_MF = 0x3F00;
+
+/**
+ * Location of a file: an application, the chain of DFs below it (starting
+ * with the MF where the card has one) and optionally an EF in the last DF.
+ *
+ * The P1/P2 fields keep the SELECT variants each card family accepts, e.g.
+ * the IAS applet wants DFs selected with P1=00 rather than P1=01.
+ */
+struct FilePath {
+  std::span<const BYTE> aid;     // empty: stay in the current application
+  std::span<const uint16_t> dfs; // e.g. {0x3F00, 0x5000}
+  std::optional<uint16_t> ef;    // EF inside the last DF
+  BYTE dfP1 = 0x01;              // select child DF
+  BYTE efP1 = 0x02;              // select EF under the current DF
+  BYTE p2 = 0x00;                // P2 of the intermediate SELECTs
+};
+
+/**
+ * Tracks which application, DF and EF are selected on one logical channel so
+ * that SELECTs that would not change anything are never sent.
+ *
+ * CardTransport owns one cursor per logical channel and reports every command
+ * to the cursor of its channel, so hand-written SELECTs keep it in sync too.
+ * Anything the cursor cannot follow (a failed SELECT, an error SW, a reset
+ * or reconnect, a PC/SC failure, a new transaction on a shared connection)
+ * makes it forget the selection, and the next select() starts over from the
+ * application.
+ */
+class SelectionCursor {
+public:
+  /** A cursor for the selection on logical channel `channel`. */
+  explicit SelectionCursor(BYTE channel = 0) : m_channel(channel) {}
+
+  /**
+   * Brings the card to `path`, sending only the SELECTs that are needed.
+   * With `returnFcp` the final SELECT is always sent, with P2=00 and Le=00,
+   * and its FCP is returned in the response data.
+   *
+   * @return the response of the last SELECT sent; 9000 with no data if none
+   *         was needed. The cursor stops at the first SELECT that fails.
+   * @throws std::invalid_argument if `path` has no application and neither
+   *         starts at the MF nor lies below the current DF, so no SELECT
+   *         would reach it. plan() throws the same.
+   */
+  ApduResponse select(CardTransport &transport, const FilePath &path,
+                      std::span<BYTE> rx, bool returnFcp = false);
+
+  /**
+   * Appends to `commands` the SELECTs select() would send for `path` and
+   * moves the cursor as if each of them succeeded. A cursor that mirrors the
+   * card's can so work out a whole sequence ahead of time.
+   */
+  void plan(const FilePath &path, bool returnFcp,
+            std::vector<std::vector<BYTE>> &commands);
+
+  /** Updates the tracked selection after `command` completed with `sw`. */
+  void observe(std::span<const BYTE> command, StatusWord sw);
+
+  /** Forgets the selection; the next select() re-selects everything. */
+  void invalidate();
+
+  /** True if `path` is already selected. */
+  bool isSelected(const FilePath &path) const;
+
+  /** True if `aid` is the selected application, whatever DF is current. */
+  bool inApplication(std::span<const BYTE> aid) const {
+    return m_valid && hasApplication(aid);
+  }
+
+  /** AID of the selected application; empty if unknown. */
+  std::span<const BYTE> application() const {
+    if (!m_valid)
+      return {};
+    return std::span(m_aid.data(), m_aidLength);
+  }
+
+  /** FID of the selected EF, else of the current DF; 0 if unknown. */
+  uint16_t currentFile() const {
+    if (!m_valid)
+      return 0;
+    if (m_ef)
+      return *m_ef;
+    return m_depth ? m_dfs[m_depth - 1] : 0;
+  }
+
+  /** Number of SELECTs select() did not have to send, for diagnostics. */
+  size_t elidedCount() const { return m_elided; }
+
+  BYTE channel() const { return m_channel; }
+
+private:
+  static constexpr size_t MAX_AID = 16;
+  static constexpr size_t MAX_DEPTH = 8;
+
+  // What the SELECT being sent by select() will do, since P1=00 alone does
+  // not say whether a FID names a DF or an EF
+  enum class Pending { None, Application, Df, Ef, Current };
+
+  // Works out the SELECTs for `path` and hands each to `send`, which
+  // returns its response.
+  template <typename Send>
+  ApduResponse walk(const FilePath &path, bool returnFcp, Send &&send);
+  template <typename Send>
+  ApduResponse sendSelect(Send &&send, BYTE p1, BYTE p2,
+                          std::span<const BYTE> data, Pending kind,
+                          bool requestFcp);
+  void setApplication(std::span<const BYTE> aid);
+  bool hasApplication(std::span<const BYTE> aid) const;
+  void pushDf(uint16_t fid);
+
+  BYTE m_channel;
+  bool m_valid = false;
+  std::array<BYTE, MAX_AID> m_aid{};
+  size_t m_aidLength = 0;
+  std::array<uint16_t, MAX_DEPTH> m_dfs{};
+  size_t m_depth = 0;
+  std::optional<uint16_t> m_ef;
+
+  Pending m_pending = Pending::None;
+  size_t m_elided = 0;
+};
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "TransportError.hpp"
+
+#include <cstdio>
+
+TransportFault classifyPcscStatus(LONG status) {
+  switch (status) {
+  case SCARD_W_REMOVED_CARD:
+  case SCARD_E_NO_SMARTCARD:
+    return TransportFault::CardRemoved;
+  case SCARD_W_RESET_CARD:
+  case SCARD_W_UNPOWERED_CARD:
+    return TransportFault::CardReset;
+  case SCARD_E_READER_UNAVAILABLE:
+  case SCARD_E_UNKNOWN_READER:
+  case SCARD_E_NO_READERS_AVAILABLE:
+  case SCARD_E_NO_SERVICE:
+  case SCARD_E_SERVICE_STOPPED:
+  case SCARD_E_INVALID_HANDLE:
+    return TransportFault::ReaderGone;
+  case SCARD_E_PROTO_MISMATCH:
+  case SCARD_E_UNSUPPORTED_FEATURE:
+    return TransportFault::ProtocolMismatch;
+  default:
+    return TransportFault::Failed;
+  }
+}
+
+const char *transportFaultName(TransportFault fault) {
+  switch (fault) {
+  case TransportFault::CardRemoved:
+    return "card removed";
+  case TransportFault::CardReset:
+    return "card reset";
+  case TransportFault::ReaderGone:
+    return "reader gone";
+  case TransportFault::ProtocolMismatch:
+    return "protocol mismatch";
+  default:
+    return "transport failure";
+  }
+}
+
+void throwPcscError(const char *what, LONG status) {
+  char message[96];
+  snprintf(message, sizeof(message), "%s. Error: 0x%08lx", what,
+           static_cast<unsigned long>(status));
+  throw TransportError(classifyPcscStatus(status), message, status);
+}
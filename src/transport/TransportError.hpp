@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+#include "Pcsc.hpp"
+
+/** What went wrong underneath a CardTransport, as far as can be told. */
+enum class TransportFault {
+  CardRemoved,      // the card left the reader
+  CardReset,        // another application or the reader reset the card
+  ReaderGone,       // reader unplugged or resource manager stopped
+  ProtocolMismatch, // the card or reader rejected the protocol in use
+  Failed,           // anything else: comm error, timeout, garbled answer
+};
+
+/** Maps a PC/SC status code to the fault it reports. */
+TransportFault classifyPcscStatus(LONG status);
+
+/** "card removed", "card reset", ... for messages. */
+const char *transportFaultName(TransportFault fault);
+
+/**
+ * A failure of the link to the card rather than an error status from the
+ * card. Everything a CardLink or CardTransport throws for a failed exchange
+ * is one of these, so callers can tell a reset card, which is worth a
+ * reconnect, from a removed one, which is not.
+ */
+class TransportError : public std::runtime_error {
+public:
+  TransportError(TransportFault fault, const std::string &message,
+                 LONG status = SCARD_S_SUCCESS)
+      : std::runtime_error(message), m_fault(fault), m_status(status) {}
+
+  TransportFault fault() const { return m_fault; }
+  // PC/SC status code behind the failure; SCARD_S_SUCCESS if there was none
+  LONG status() const { return m_status; }
+
+private:
+  TransportFault m_fault;
+  LONG m_status;
+};
+
+/**
+ * Throws the TransportError for `status`, with the message
+ * "<what>. Error: 0x<status>".
+ */
+[[noreturn]] void throwPcscError(const char *what, LONG status);
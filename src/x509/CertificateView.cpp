@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "CertificateView.hpp"
+
+#include <algorithm>
+
+#include "transport/BerTlv.hpp"
+
+namespace {
+
+constexpr uint32_t TAG_BOOLEAN = 0x01;
+constexpr uint32_t TAG_INTEGER = 0x02;
+constexpr uint32_t TAG_BIT_STRING = 0x03;
+constexpr uint32_t TAG_OCTET_STRING = 0x04;
+constexpr uint32_t TAG_OID = 0x06;
+constexpr uint32_t TAG_UTC_TIME = 0x17;
+constexpr uint32_t TAG_GENERALIZED_TIME = 0x18;
+constexpr uint32_t TAG_SEQUENCE = 0x30;
+constexpr uint32_t TAG_SET = 0x31;
+constexpr uint32_t TAG_VERSION = 0xA0;    // [0] EXPLICIT
+constexpr uint32_t TAG_EXTENSIONS = 0xA3; // [3] EXPLICIT
+
+// Start of every certificate of this PKI: two SEQUENCEs with two-byte
+// lengths, then version v3
+constexpr BYTE V3_PREFIX[] = {0xA0, 0x03, 0x02, 0x01, 0x02};
+constexpr size_t V3_TBS_OFFSET = 8;
+
+// Reads the next object of `rest` into `tlv` and moves past it. `object`,
+// if given, receives the whole object.
+bool take(std::span<const BYTE> &rest, Tlv &tlv,
+          std::span<const BYTE> *object = nullptr) {
+  if (parseTlv(rest, 0, tlv) != TlvStatus::Ok)
+    return false;
+  if (object)
+    *object = rest.first(tlv.end());
+  rest = rest.subspan(tlv.end());
+  return true;
+}
+
+bool take(std::span<const BYTE> &rest, uint32_t tag, Tlv &tlv,
+          std::span<const BYTE> *object = nullptr) {
+  std::span<const BYTE> before = rest;
+  if (!take(rest, tlv, object) || tlv.tag != tag) {
+    rest = before;
+    return false;
+  }
+  return true;
+}
+
+// AlgorithmIdentifier ::= SEQUENCE { algorithm OID, parameters ANY OPTIONAL }
+bool takeAlgorithm(std::span<const BYTE> &rest, std::span<const BYTE> &oid,
+                   std::span<const BYTE> &parameters) {
+  Tlv algorithm, field;
+  if (!take(rest, TAG_SEQUENCE, algorithm))
+    return false;
+  std::span<const BYTE> inner = algorithm.value;
+  if (!take(inner, TAG_OID, field))
+    return false;
+  oid = field.value;
+  if (!inner.empty() && !take(inner, field, &parameters))
+    return false;
+  return true;
+}
+
+// Contents of a BIT STRING without its unused-bits byte
+bool takeBits(std::span<const BYTE> &rest, std::span<const BYTE> &bits) {
+  Tlv tlv;
+  if (!take(rest, TAG_BIT_STRING, tlv) || tlv.value.empty())
+    return false;
+  bits = tlv.value.subspan(1);
+  return true;
+}
+
+bool isTime(const Tlv &tlv) {
+  return tlv.tag == TAG_UTC_TIME || tlv.tag == TAG_GENERALIZED_TIME;
+}
+
+// Name ::= SEQUENCE OF SET OF SEQUENCE { type OID, value ANY }
+std::span<const BYTE> findAttribute(std::span<const BYTE> name,
+                                    std::span<const BYTE> oid) {
+  Tlv sequence;
+  if (!take(name, TAG_SEQUENCE, sequence))
+    return {};
+  std::span<const BYTE> rdns = sequence.value;
+  Tlv rdn;
+  while (take(rdns, TAG_SET, rdn)) {
+    std::span<const BYTE> attributes = rdn.value;
+    Tlv attribute;
+    while (take(attributes, TAG_SEQUENCE, attribute)) {
+      std::span<const BYTE> fields = attribute.value;
+      Tlv type, value;
+      if (take(fields, TAG_OID, type) && take(fields, value) &&
+          std::ranges::equal(type.value, oid))
+        return value.value;
+    }
+  }
+  return {};
+}
+
+// Two decimal digits at `text[pos]`, or -1
+int twoDigits(std::span<const BYTE> text, size_t pos) {
+  BYTE high = text[pos] - '0', low = text[pos + 1] - '0';
+  return high < 10 && low < 10 ? high * 10 + low : -1;
+}
+
+// Days from 1970-01-01 to a proleptic Gregorian date
+int64_t daysFromCivil(int64_t year, unsigned month, unsigned day) {
+  year -= month <= 2;
+  const int64_t era = (year >= 0 ? year : year - 399) / 400;
+  const unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+  const unsigned dayOfYear =
+      (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  const unsigned dayOfEra =
+      yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + static_cast<int64_t>(dayOfEra) - 719468;
+}
+
+} // namespace
+
+void CertificateView::parse() const {
+  Fields fields;
+  std::span<const BYTE> rest = m_der;
+
+  // Certificate ::= SEQUENCE { tbsCertificate, signatureAlgorithm,
+  //                            signatureValue }
+  Tlv certificate, tbs, tlv;
+  if (!take(rest, TAG_SEQUENCE, certificate, &fields.certificate))
+    return;
+  rest = certificate.value;
+  if (!take(rest, TAG_SEQUENCE, tbs, &fields.tbs) ||
+      !takeAlgorithm(rest, fields.signatureAlgorithm,
+                     fields.signatureParameters) ||
+      !takeBits(rest, fields.signature))
+    return;
+
+  // The certificates on the card all start the same way, so the version
+  // is checked in place; others go through the general path.
+  std::span<const BYTE> field = tbs.value;
+  std::span<const BYTE> prefix = fields.certificate;
+  if (prefix.size() > V3_TBS_OFFSET + sizeof(V3_PREFIX) &&
+      prefix[1] == 0x82 && prefix[4] == TAG_SEQUENCE && prefix[5] == 0x82 &&
+      std::ranges::equal(prefix.subspan(V3_TBS_OFFSET, sizeof(V3_PREFIX)),
+                         V3_PREFIX)) {
+    field = field.subspan(sizeof(V3_PREFIX));
+  } else if (!field.empty() && field[0] == TAG_VERSION &&
+             !take(field, TAG_VERSION, tlv)) {
+    return;
+  }
+
+  std::span<const BYTE> unused;
+  Tlv validity, publicKeyInfo;
+  if (!take(field, TAG_INTEGER, tlv))
+    return;
+  fields.serial = tlv.value;
+  if (!takeAlgorithm(field, unused, unused) ||
+      !take(field, TAG_SEQUENCE, tlv, &fields.issuer) ||
+      !take(field, TAG_SEQUENCE, validity) ||
+      !take(field, TAG_SEQUENCE, tlv, &fields.subject) ||
+      !take(field, TAG_SEQUENCE, publicKeyInfo, &fields.publicKeyInfo))
+    return;
+
+  std::span<const BYTE> times = validity.value;
+  if (!take(times, tlv, &fields.notBefore) || !isTime(tlv) ||
+      !take(times, tlv, &fields.notAfter) || !isTime(tlv))
+    return;
+
+  std::span<const BYTE> key = publicKeyInfo.value;
+  if (!takeAlgorithm(key, fields.publicKeyAlgorithm,
+                     fields.publicKeyParameters) ||
+      !takeBits(key, fields.publicKey))
+    return;
+
+  // issuerUniqueID [1] and subjectUniqueID [2] are skipped; extensions [3]
+  // wrap a SEQUENCE.
+  while (take(field, tlv)) {
+    if (tlv.tag == TAG_EXTENSIONS) {
+      std::span<const BYTE> wrapped = tlv.value;
+      Tlv extensions;
+      if (!take(wrapped, TAG_SEQUENCE, extensions))
+        return;
+      fields.extensions = extensions.value;
+    }
+  }
+  if (!field.empty())
+    return;
+
+  fields.valid = true;
+  m_fields = fields;
+}
+
+std::span<const BYTE>
+CertificateView::subjectAttribute(std::span<const BYTE> oid) const {
+  return findAttribute(subject(), oid);
+}
+
+std::span<const BYTE>
+CertificateView::issuerAttribute(std::span<const BYTE> oid) const {
+  return findAttribute(issuer(), oid);
+}
+
+std::span<const BYTE> CertificateView::extension(std::span<const BYTE> oid,
+                                                 bool *critical) const {
+  // Extension ::= SEQUENCE { extnID OID, critical BOOLEAN DEFAULT FALSE,
+  //                          extnValue OCTET STRING }
+  std::span<const BYTE> rest = index().extensions;
+  Tlv extension;
+  while (take(rest, TAG_SEQUENCE, extension)) {
+    std::span<const BYTE> fields = extension.value;
+    Tlv id, flag, value;
+    if (!take(fields, TAG_OID, id) || !std::ranges::equal(id.value, oid))
+      continue;
+    bool isCritical = take(fields, TAG_BOOLEAN, flag) &&
+                      flag.value.size() == 1 && flag.value[0] != 0;
+    if (!take(fields, TAG_OCTET_STRING, value))
+      return {};
+    if (critical)
+      *critical = isCritical;
+    return value.value;
+  }
+  return {};
+}
+
+std::optional<int64_t> derTimeToUnix(std::span<const BYTE> time) {
+  Tlv tlv;
+  if (parseTlv(time, 0, tlv) != TlvStatus::Ok || !isTime(tlv))
+    return std::nullopt;
+
+  std::span<const BYTE> text = tlv.value;
+  size_t yearDigits = tlv.tag == TAG_UTC_TIME ? 2 : 4;
+  if (text.size() != yearDigits + 11 || text.back() != 'Z')
+    return std::nullopt;
+
+  int year = twoDigits(text, 0);
+  if (yearDigits == 4) {
+    int low = twoDigits(text, 2);
+    year = year < 0 || low < 0 ? -1 : year * 100 + low;
+  } else if (year >= 0) {
+    year += year < 50 ? 2000 : 1900; // RFC 5280
+  }
+  int month = twoDigits(text, yearDigits);
+  int day = twoDigits(text, yearDigits + 2);
+  int hour = twoDigits(text, yearDigits + 4);
+  int minute = twoDigits(text, yearDigits + 6);
+  int second = twoDigits(text, yearDigits + 8);
+  if (year < 0 || month < 1 || month > 12 || day < 1 || day > 31 ||
+      hour < 0 || hour > 23 || minute < 0 || minute > 59 || second < 0 ||
+      second > 60)
+    return std::nullopt;
+
+  return daysFromCivil(year, month, day) * 86400 + hour * 3600 +
+         minute * 60 + second;
+}
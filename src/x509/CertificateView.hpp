@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+
+#include "transport/Pcsc.hpp"
+
+// Contents of the attribute type OIDs of a Name
+inline constexpr BYTE OID_COMMON_NAME[] = {0x55, 0x04, 0x03};   // CN
+inline constexpr BYTE OID_SURNAME[] = {0x55, 0x04, 0x04};       // SN
+inline constexpr BYTE OID_SERIAL_NUMBER[] = {0x55, 0x04, 0x05}; // serialNumber
+inline constexpr BYTE OID_GIVEN_NAME[] = {0x55, 0x04, 0x2A};    // G
+
+/**
+ * A DER X.509 certificate, read in place: every accessor returns a span
+ * into the buffer the view was made over, which must outlive it. Nothing
+ * is parsed until the first accessor is called; that call walks the
+ * TBSCertificate once and remembers where its fields are. A view is not
+ * safe to share between threads before then.
+ *
+ * Accessors return empty spans for a malformed certificate or an absent
+ * field.
+ */
+class CertificateView {
+public:
+  CertificateView() = default;
+  explicit CertificateView(std::span<const BYTE> der) : m_der(der) {}
+
+  /** True if the buffer holds a well-formed certificate. */
+  bool valid() const { return index().valid; }
+
+  /** The certificate, without anything after it in the buffer. */
+  std::span<const BYTE> der() const { return index().certificate; }
+
+  /** The TBSCertificate with its header: the bytes the issuer signed. */
+  std::span<const BYTE> tbs() const { return index().tbs; }
+
+  /** Contents of the serialNumber INTEGER, big-endian. */
+  std::span<const BYTE> serialNumber() const { return index().serial; }
+
+  /** Issuer and subject Names, each a whole DER SEQUENCE. */
+  std::span<const BYTE> issuer() const { return index().issuer; }
+  std::span<const BYTE> subject() const { return index().subject; }
+
+  /** notBefore and notAfter, each a whole UTCTime or GeneralizedTime. */
+  std::span<const BYTE> notBefore() const { return index().notBefore; }
+  std::span<const BYTE> notAfter() const { return index().notAfter; }
+
+  /** The SubjectPublicKeyInfo SEQUENCE. */
+  std::span<const BYTE> subjectPublicKeyInfo() const {
+    return index().publicKeyInfo;
+  }
+  /**
+   * Contents of the key's algorithm OID, and its parameters (e.g. the curve
+   * OID) as a whole object if present.
+   */
+  std::span<const BYTE> publicKeyAlgorithm() const {
+    return index().publicKeyAlgorithm;
+  }
+  std::span<const BYTE> publicKeyParameters() const {
+    return index().publicKeyParameters;
+  }
+  /** The subjectPublicKey BIT STRING, past its unused-bits byte. */
+  std::span<const BYTE> publicKey() const { return index().publicKey; }
+
+  /** Same for the outer signatureAlgorithm. */
+  std::span<const BYTE> signatureAlgorithm() const {
+    return index().signatureAlgorithm;
+  }
+  std::span<const BYTE> signatureParameters() const {
+    return index().signatureParameters;
+  }
+  /** The signatureValue BIT STRING, past its unused-bits byte. */
+  std::span<const BYTE> signature() const { return index().signature; }
+
+  /**
+   * Value of the first attribute of type `oid` in the subject or issuer,
+   * as the string's bytes (UTF8String, PrintableString, ...).
+   */
+  std::span<const BYTE> subjectAttribute(std::span<const BYTE> oid) const;
+  std::span<const BYTE> issuerAttribute(std::span<const BYTE> oid) const;
+
+  /** Subject CN, which carries the card's CRN on sign certificates. */
+  std::span<const BYTE> commonName() const {
+    return subjectAttribute(OID_COMMON_NAME);
+  }
+  std::span<const BYTE> surname() const {
+    return subjectAttribute(OID_SURNAME);
+  }
+  std::span<const BYTE> givenName() const {
+    return subjectAttribute(OID_GIVEN_NAME);
+  }
+
+  /**
+   * The extnValue OCTET STRING contents of extension `oid`, or an empty
+   * span. `critical` receives the extension's critical flag.
+   */
+  std::span<const BYTE> extension(std::span<const BYTE> oid,
+                                  bool *critical = nullptr) const;
+
+private:
+  struct Fields {
+    bool valid = false;
+    std::span<const BYTE> certificate, tbs, serial, issuer, subject;
+    std::span<const BYTE> notBefore, notAfter;
+    std::span<const BYTE> publicKeyInfo, publicKeyAlgorithm,
+        publicKeyParameters, publicKey;
+    std::span<const BYTE> extensions; // contents of the Extensions SEQUENCE
+    std::span<const BYTE> signatureAlgorithm, signatureParameters, signature;
+  };
+
+  const Fields &index() const {
+    if (!m_indexed) {
+      parse();
+      m_indexed = true;
+    }
+    return m_fields;
+  }
+  void parse() const;
+
+  std::span<const BYTE> m_der;
+  mutable bool m_indexed = false;
+  mutable Fields m_fields;
+};
+
+/**
+ * Seconds since 1970 of a whole DER UTCTime (YYMMDDHHMMSSZ, years 1950 to
+ * 2049) or GeneralizedTime (YYYYMMDDHHMMSSZ).
+ */
+std::optional<int64_t> derTimeToUnix(std::span<const BYTE> time);
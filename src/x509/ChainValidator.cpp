@@ -0,0 +1,410 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "ChainValidator.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include "transport/BerTlv.hpp"
+
+namespace {
+
+constexpr uint32_t TAG_BOOLEAN = 0x01;
+constexpr uint32_t TAG_INTEGER = 0x02;
+constexpr uint32_t TAG_SEQUENCE = 0x30;
+
+constexpr BYTE OID_RSA_ENCRYPTION[] = {0x2A, 0x86, 0x48, 0x86, 0xF7,
+                                       0x0D, 0x01, 0x01, 0x01};
+constexpr BYTE OID_SHA1_WITH_RSA[] = {0x2A, 0x86, 0x48, 0x86, 0xF7,
+                                      0x0D, 0x01, 0x01, 0x05};
+constexpr BYTE OID_SHA256_WITH_RSA[] = {0x2A, 0x86, 0x48, 0x86, 0xF7,
+                                        0x0D, 0x01, 0x01, 0x0B};
+constexpr BYTE OID_BASIC_CONSTRAINTS[] = {0x55, 0x1D, 0x13};
+
+// DigestInfo up to the digest itself (RFC 8017, section 9.2, note 1)
+constexpr BYTE SHA1_DIGEST_INFO[] = {0x30, 0x21, 0x30, 0x09, 0x06,
+                                     0x05, 0x2B, 0x0E, 0x03, 0x02,
+                                     0x1A, 0x05, 0x00, 0x04, 0x14};
+constexpr BYTE SHA256_DIGEST_INFO[] = {
+    0x30, 0x31, 0x30, 0x0D, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01,
+    0x65, 0x03, 0x04, 0x02, 0x01, 0x05, 0x00, 0x04, 0x20};
+
+constexpr char PEM_BEGIN[] = "-----BEGIN CERTIFICATE-----";
+constexpr char PEM_END[] = "-----END CERTIFICATE-----";
+
+std::string_view asKey(std::span<const BYTE> name) {
+  return {reinterpret_cast<const char *>(name.data()), name.size()};
+}
+
+// Valid if `issuer`'s key made the signature on `certificate`
+ChainStatus checkSignature(const CertificateView &certificate,
+                           const TrustAnchor &issuer) {
+  if (!issuer.key)
+    return ChainStatus::UnsupportedAlgorithm;
+
+  BYTE digestInfo[sizeof(SHA256_DIGEST_INFO) + 32];
+  size_t length;
+  std::span<const BYTE> algorithm = certificate.signatureAlgorithm();
+  if (std::ranges::equal(algorithm, OID_SHA256_WITH_RSA)) {
+    Sha256Digest digest = sha256(certificate.tbs());
+    BYTE *end = std::ranges::copy(SHA256_DIGEST_INFO, digestInfo).out;
+    length = std::ranges::copy(digest, end).out - digestInfo;
+  } else if (std::ranges::equal(algorithm, OID_SHA1_WITH_RSA)) {
+    Sha1Digest digest = sha1(certificate.tbs());
+    BYTE *end = std::ranges::copy(SHA1_DIGEST_INFO, digestInfo).out;
+    length = std::ranges::copy(digest, end).out - digestInfo;
+  } else {
+    return ChainStatus::UnsupportedAlgorithm;
+  }
+  return issuer.key->verifyPkcs1(certificate.signature(),
+                                 std::span<const BYTE>(digestInfo, length))
+             ? ChainStatus::Valid
+             : ChainStatus::BadSignature;
+}
+
+// The pathLenConstraint of a CA certificate, INT_MAX if it has none, or
+// nullopt if the certificate is not a CA
+std::optional<int> caPathLength(const CertificateView &certificate) {
+  // BasicConstraints ::= SEQUENCE { cA BOOLEAN DEFAULT FALSE,
+  //                                 pathLenConstraint INTEGER OPTIONAL }
+  Tlv constraints, ca, pathLength;
+  if (parseTlv(certificate.extension(OID_BASIC_CONSTRAINTS), 0,
+               constraints) != TlvStatus::Ok ||
+      constraints.tag != TAG_SEQUENCE)
+    return std::nullopt;
+  std::span<const BYTE> fields = constraints.value;
+  if (parseTlv(fields, 0, ca) != TlvStatus::Ok || ca.tag != TAG_BOOLEAN ||
+      ca.value.size() != 1 || ca.value[0] == 0)
+    return std::nullopt;
+  if (ca.end() == fields.size())
+    return INT_MAX;
+  if (parseTlv(fields, ca.end(), pathLength) != TlvStatus::Ok ||
+      pathLength.tag != TAG_INTEGER || pathLength.value.empty() ||
+      pathLength.value.size() > 2 || (pathLength.value[0] & 0x80))
+    return std::nullopt;
+  int value = 0;
+  for (BYTE b : pathLength.value)
+    value = value << 8 | b;
+  return value;
+}
+
+int8_t base64Value(char c) {
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A';
+  if (c >= 'a' && c <= 'z')
+    return c - 'a' + 26;
+  if (c >= '0' && c <= '9')
+    return c - '0' + 52;
+  if (c == '+')
+    return 62;
+  if (c == '/')
+    return 63;
+  return -1;
+}
+
+// Decodes the base64 between PEM armour lines, skipping line breaks
+std::vector<BYTE> decodeBase64(std::string_view text,
+                               const std::string &source) {
+  std::vector<BYTE> bytes;
+  bytes.reserve(text.size() / 4 * 3);
+  uint32_t bits = 0;
+  int count = 0;
+  for (char c : text) {
+    if (c == '\r' || c == '\n' || c == ' ' || c == '\t')
+      continue;
+    if (c == '=')
+      break;
+    int8_t value = base64Value(c);
+    if (value < 0)
+      throw std::runtime_error(source + ": bad base64 in PEM");
+    bits = bits << 6 | value;
+    if (++count == 4) {
+      bytes.push_back((BYTE)(bits >> 16));
+      bytes.push_back((BYTE)(bits >> 8));
+      bytes.push_back((BYTE)bits);
+      bits = 0;
+      count = 0;
+    }
+  }
+  if (count == 2) {
+    bytes.push_back((BYTE)(bits >> 4));
+  } else if (count == 3) {
+    bytes.push_back((BYTE)(bits >> 10));
+    bytes.push_back((BYTE)(bits >> 2));
+  } else if (count != 0) {
+    throw std::runtime_error(source + ": truncated base64 in PEM");
+  }
+  return bytes;
+}
+
+// Every certificate of a DER or PEM file
+std::vector<std::vector<BYTE>>
+readCertificateFile(const std::filesystem::path &path) {
+  std::ifstream in(path, std::ios::binary);
+  std::string text((std::istreambuf_iterator<char>(in)),
+                   std::istreambuf_iterator<char>());
+  if (!in.good() && !in.eof())
+    throw std::runtime_error(path.string() + ": cannot read");
+
+  if (!text.empty() && (BYTE)text[0] == TAG_SEQUENCE)
+    return {std::vector<BYTE>(text.begin(), text.end())};
+
+  std::vector<std::vector<BYTE>> certificates;
+  std::string_view rest = text;
+  for (size_t begin; (begin = rest.find(PEM_BEGIN)) != rest.npos;) {
+    rest.remove_prefix(begin + sizeof(PEM_BEGIN) - 1);
+    size_t end = rest.find(PEM_END);
+    if (end == rest.npos)
+      throw std::runtime_error(path.string() + ": unterminated PEM");
+    certificates.push_back(decodeBase64(rest.substr(0, end), path.string()));
+    rest.remove_prefix(end + sizeof(PEM_END) - 1);
+  }
+  if (certificates.empty())
+    throw std::runtime_error(path.string() + ": no certificate found");
+  return certificates;
+}
+
+std::unique_ptr<TrustAnchor> makeAnchor(std::vector<BYTE> der,
+                                        std::string source) {
+  auto anchor = std::make_unique<TrustAnchor>();
+  anchor->source = std::move(source);
+  anchor->der = std::move(der);
+  anchor->view = CertificateView(anchor->der);
+  const CertificateView &view = anchor->view;
+  if (!view.valid())
+    throw std::runtime_error(anchor->source + ": not a DER certificate");
+
+  std::optional<int64_t> from = derTimeToUnix(view.notBefore());
+  std::optional<int64_t> until = derTimeToUnix(view.notAfter());
+  if (!from || !until)
+    throw std::runtime_error(anchor->source + ": bad validity dates");
+  anchor->validFrom = *from;
+  anchor->validUntil = *until;
+
+  if (std::ranges::equal(view.publicKeyAlgorithm(), OID_RSA_ENCRYPTION)) {
+    try {
+      anchor->key.emplace(view.publicKey());
+    } catch (const std::invalid_argument &e) {
+      throw std::runtime_error(anchor->source + ": " + e.what());
+    }
+  }
+  return anchor;
+}
+
+} // namespace
+
+const char *chainStatusName(ChainStatus status) {
+  switch (status) {
+  case ChainStatus::Valid:
+    return "valid";
+  case ChainStatus::Malformed:
+    return "malformed";
+  case ChainStatus::UnknownIssuer:
+    return "unknown issuer";
+  case ChainStatus::BadSignature:
+    return "bad signature";
+  case ChainStatus::UnsupportedAlgorithm:
+    return "unsupported algorithm";
+  case ChainStatus::NotYetValid:
+    return "not yet valid";
+  case ChainStatus::Expired:
+    return "expired";
+  default:
+    return "unknown";
+  }
+}
+
+ChainValidator::ChainValidator(const std::filesystem::path &directory) {
+  std::vector<std::filesystem::path> files;
+  for (const auto &entry : std::filesystem::directory_iterator(directory)) {
+    std::string extension = entry.path().extension().string();
+    std::ranges::transform(extension, extension.begin(), [](char c) {
+      return (char)std::tolower((unsigned char)c);
+    });
+    if (entry.is_regular_file() &&
+        (extension == ".crt" || extension == ".cer" || extension == ".pem" ||
+         extension == ".der"))
+      files.push_back(entry.path());
+  }
+  std::ranges::sort(files);
+
+  std::vector<std::unique_ptr<TrustAnchor>> candidates;
+  for (const auto &file : files)
+    for (auto &der : readCertificateFile(file))
+      candidates.push_back(
+          makeAnchor(std::move(der), file.filename().string()));
+  link(std::move(candidates));
+}
+
+ChainValidator::ChainValidator(std::vector<std::vector<BYTE>> certificates) {
+  std::vector<std::unique_ptr<TrustAnchor>> candidates;
+  for (size_t i = 0; i < certificates.size(); i++)
+    candidates.push_back(makeAnchor(std::move(certificates[i]),
+                                    "certificate " + std::to_string(i + 1)));
+  link(std::move(candidates));
+}
+
+void ChainValidator::link(
+    std::vector<std::unique_ptr<TrustAnchor>> candidates) {
+  auto keep = [this](std::unique_ptr<TrustAnchor> &anchor) {
+    m_bySubject.emplace(asKey(anchor->view.subject()), anchor.get());
+    m_anchors.push_back(std::move(anchor));
+  };
+
+  for (auto &candidate : candidates) {
+    const CertificateView &view = candidate->view;
+    std::optional<int> pathLength = caPathLength(view);
+    if (pathLength && std::ranges::equal(view.subject(), view.issuer()) &&
+        checkSignature(view, *candidate) == ChainStatus::Valid) {
+      candidate->pathAllowance = *pathLength;
+      keep(candidate);
+    }
+  }
+  if (m_anchors.empty())
+    throw std::runtime_error("No self-signed root among the trust anchors");
+
+  // Intermediates, in as many passes as it takes to link those whose
+  // issuer is another intermediate. Of several CAs that could have signed
+  // one, e.g. a root and its renewal, the one valid longest is taken.
+  for (bool linked = true; linked;) {
+    linked = false;
+    for (auto &candidate : candidates) {
+      if (!candidate)
+        continue;
+      const CertificateView &view = candidate->view;
+      std::optional<int> pathLength = caPathLength(view);
+      if (!pathLength)
+        continue;
+
+      const TrustAnchor *best = nullptr;
+      auto [first, last] = m_bySubject.equal_range(asKey(view.issuer()));
+      for (auto it = first; it != last; ++it) {
+        const TrustAnchor *issuer = it->second;
+        if (issuer->pathAllowance < 1 ||
+            (best && issuer->validUntil <= best->validUntil) ||
+            checkSignature(view, *issuer) != ChainStatus::Valid)
+          continue;
+        best = issuer;
+      }
+      if (!best)
+        continue;
+
+      candidate->issuer = best;
+      candidate->validFrom = std::max(candidate->validFrom, best->validFrom);
+      candidate->validUntil =
+          std::min(candidate->validUntil, best->validUntil);
+      candidate->pathAllowance =
+          std::min(*pathLength, best->pathAllowance - 1);
+      keep(candidate);
+      linked = true;
+    }
+  }
+}
+
+ChainResult ChainValidator::validate(std::span<const BYTE> certificate) const {
+  return validate(certificate, (int64_t)std::time(nullptr));
+}
+
+ChainResult ChainValidator::validate(std::span<const BYTE> certificate,
+                                     int64_t now) const {
+  CertificateView view(certificate);
+  if (!view.valid())
+    return {ChainStatus::Malformed};
+
+  Sha256Digest digest = sha256(view.der());
+  {
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    auto it = m_cache.find(digest);
+    if (it != m_cache.end() && now >= it->second.validFrom &&
+        now <= it->second.validUntil)
+      return {ChainStatus::Valid, it->second.issuer, true};
+  }
+
+  std::optional<int64_t> notBefore = derTimeToUnix(view.notBefore());
+  std::optional<int64_t> notAfter = derTimeToUnix(view.notAfter());
+  if (!notBefore || !notAfter)
+    return {ChainStatus::Malformed};
+
+  // Issuers valid now are tried first; one that signed the certificate but
+  // is not valid now only decides which error is reported
+  auto [first, last] = m_bySubject.equal_range(asKey(view.issuer()));
+  if (first == last)
+    return {ChainStatus::UnknownIssuer};
+  ChainResult failure{ChainStatus::BadSignature};
+  for (bool current : {true, false}) {
+    for (auto it = first; it != last; ++it) {
+      const TrustAnchor *issuer = it->second;
+      int64_t from = std::max(*notBefore, issuer->validFrom);
+      int64_t until = std::min(*notAfter, issuer->validUntil);
+      bool inPeriod = now >= from && now <= until;
+      if (inPeriod != current)
+        continue;
+
+      ChainStatus signature = checkSignature(view, *issuer);
+      if (signature != ChainStatus::Valid) {
+        if (failure.status == ChainStatus::BadSignature)
+          failure = {signature, issuer};
+        continue;
+      }
+      if (!inPeriod)
+        return {now < from ? ChainStatus::NotYetValid : ChainStatus::Expired,
+                issuer};
+
+      std::lock_guard<std::mutex> lock(m_cacheMutex);
+      auto [entry, added] =
+          m_cache.insert_or_assign(digest, CachedPath{issuer, from, until});
+      if (added) {
+        if (m_cacheOrder.size() < CACHE_LIMIT) {
+          m_cacheOrder.push_back(digest);
+        } else {
+          m_cache.erase(m_cacheOrder[m_cacheNext]);
+          m_cacheOrder[m_cacheNext] = digest;
+          m_cacheNext = (m_cacheNext + 1) % CACHE_LIMIT;
+        }
+      }
+      return {ChainStatus::Valid, issuer};
+    }
+  }
+  return failure;
+}
+
+size_t ChainValidator::cachedCount() const {
+  std::lock_guard<std::mutex> lock(m_cacheMutex);
+  return m_cache.size();
+}
+
+void ChainValidator::clearCache() {
+  std::lock_guard<std::mutex> lock(m_cacheMutex);
+  m_cache.clear();
+  m_cacheOrder.clear();
+  m_cacheNext = 0;
+}
+
+size_t ChainValidator::DigestHash::operator()(
+    const Sha256Digest &digest) const {
+  size_t hash;
+  std::memcpy(&hash, digest.data(), sizeof(hash));
+  return hash;
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "transport/Pcsc.hpp"
+#include "x509/CertificateView.hpp"
+#include "x509/Digest.hpp"
+#include "x509/RsaPublicKey.hpp"
+
+enum class ChainStatus {
+  Valid,
+  Malformed,            // not a DER certificate with readable dates
+  UnknownIssuer,        // no trusted CA is named as the issuer
+  BadSignature,         // a CA is named, but none signed it
+  UnsupportedAlgorithm, // not RSA with SHA-1 or SHA-256
+  NotYetValid,
+  Expired,
+};
+
+const char *chainStatusName(ChainStatus status);
+
+/** A CA certificate from the anchor directory, parsed once at load. */
+struct TrustAnchor {
+  std::string source; // file name, or "certificate N" when given in memory
+  std::vector<BYTE> der;
+  CertificateView view; // over `der`
+  std::optional<RsaPublicKey> key;
+  const TrustAnchor *issuer = nullptr; // nullptr for a root
+  // Seconds since the epoch when this anchor and every CA above it are all
+  // valid, the intersection of their validity periods
+  int64_t validFrom = 0, validUntil = 0;
+  // How many more intermediate CAs may follow this one in a path
+  int pathAllowance = 0;
+};
+
+/** The outcome of ChainValidator::validate. */
+struct ChainResult {
+  ChainStatus status = ChainStatus::Malformed;
+  /** The anchor that signed the certificate; follow `issuer` to the root. */
+  const TrustAnchor *issuer = nullptr;
+  /** True if this came from the result cache without checking signatures. */
+  bool cached = false;
+};
+
+/**
+ * Validates card certificates against the roots and intermediates of the
+ * national PKI, e.g. the files in assets/iran_root_certificates.
+ *
+ * The anchors are read, parsed and linked when the validator is made: a
+ * self-signed certificate whose signature holds is a root, and any other
+ * is kept only if it is a CA (basicConstraints cA, within its issuer's
+ * pathLenConstraint) signed by an anchor already kept. A CA that issues
+ * card certificates but is missing from the directory can be dropped in
+ * next to the others.
+ *
+ * validate() then needs one signature check against the issuing anchor,
+ * plus the validity of the certificate and the anchors above it at `now`.
+ * Valid results are cached by the SHA-256 of the certificate along with
+ * the period the path is valid for, so a card seen again costs a hash and
+ * a lookup. Failures are not cached. Revocation is not checked.
+ *
+ * validate() may be called from several threads at once.
+ */
+class ChainValidator {
+public:
+  /**
+   * Loads the .crt, .cer, .pem and .der files of `directory`, each DER or
+   * PEM with one or more certificates. Throws std::runtime_error if a file
+   * cannot be read or decoded, or if no root is found.
+   */
+  explicit ChainValidator(const std::filesystem::path &directory);
+
+  /** Same, from DER certificates already in memory. */
+  explicit ChainValidator(std::vector<std::vector<BYTE>> certificates);
+
+  ChainValidator(const ChainValidator &) = delete;
+  ChainValidator &operator=(const ChainValidator &) = delete;
+
+  /** Validates `certificate` at the current time, or at `now`. */
+  ChainResult validate(std::span<const BYTE> certificate) const;
+  ChainResult validate(std::span<const BYTE> certificate, int64_t now) const;
+
+  /** The anchors that were kept, roots first. */
+  const std::vector<std::unique_ptr<TrustAnchor>> &anchors() const {
+    return m_anchors;
+  }
+
+  size_t cachedCount() const;
+  void clearCache();
+
+  /** At most this many results are cached; the oldest makes room. */
+  static constexpr size_t CACHE_LIMIT = 4096;
+
+private:
+  struct CachedPath {
+    const TrustAnchor *issuer;
+    int64_t validFrom, validUntil;
+  };
+  struct DigestHash {
+    size_t operator()(const Sha256Digest &digest) const;
+  };
+
+  void link(std::vector<std::unique_ptr<TrustAnchor>> candidates);
+
+  std::vector<std::unique_ptr<TrustAnchor>> m_anchors;
+  // Keyed by the subject Name's DER bytes, which point into the anchors
+  std::unordered_multimap<std::string_view, const TrustAnchor *> m_bySubject;
+
+  mutable std::mutex m_cacheMutex;
+  mutable std::unordered_map<Sha256Digest, CachedPath, DigestHash> m_cache;
+  mutable std::vector<Sha256Digest> m_cacheOrder; // ring, oldest at m_cacheNext
+  mutable size_t m_cacheNext = 0;
+};
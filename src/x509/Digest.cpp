@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "Digest.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+
+namespace {
+
+uint32_t loadBig32(const BYTE *p) {
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 |
+         p[3];
+}
+
+void storeBig32(BYTE *p, uint32_t value) {
+  p[0] = (BYTE)(value >> 24);
+  p[1] = (BYTE)(value >> 16);
+  p[2] = (BYTE)(value >> 8);
+  p[3] = (BYTE)value;
+}
+
+// Both hashes pad the message the same way: 0x80, zeros, then the bit
+// length as a 64-bit big-endian number, to a multiple of 64 bytes. Full
+// blocks are compressed straight from the input.
+template <typename Compress>
+void processMessage(std::span<const BYTE> data, Compress compress) {
+  size_t full = data.size() / 64 * 64;
+  for (size_t i = 0; i < full; i += 64)
+    compress(data.data() + i);
+
+  BYTE tail[128] = {};
+  size_t rest = data.size() - full;
+  std::copy(data.begin() + full, data.end(), tail);
+  tail[rest] = 0x80;
+  size_t tailLength = rest < 56 ? 64 : 128;
+  uint64_t bits = (uint64_t)data.size() * 8;
+  storeBig32(tail + tailLength - 8, (uint32_t)(bits >> 32));
+  storeBig32(tail + tailLength - 4, (uint32_t)bits);
+  for (size_t i = 0; i < tailLength; i += 64)
+    compress(tail + i);
+}
+
+constexpr uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+} // namespace
+
+Sha1Digest sha1(std::span<const BYTE> data) {
+  uint32_t state[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+                   0xC3D2E1F0};
+  processMessage(data, [&state](const BYTE *block) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++)
+      w[i] = loadBig32(block + 4 * i);
+    for (int i = 16; i < 80; i++)
+      w[i] = std::rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4];
+    for (int i = 0; i < 80; i++) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      uint32_t t = std::rotl(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = std::rotl(b, 30);
+      b = a;
+      a = t;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+  });
+
+  Sha1Digest digest;
+  for (int i = 0; i < 5; i++)
+    storeBig32(digest.data() + 4 * i, state[i]);
+  return digest;
+}
+
+Sha256Digest sha256(std::span<const BYTE> data) {
+  uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                   0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  processMessage(data, [&state](const BYTE *block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+      w[i] = loadBig32(block + 4 * i);
+    for (int i = 16; i < 64; i++) {
+      uint32_t s0 = std::rotr(w[i - 15], 7) ^ std::rotr(w[i - 15], 18) ^
+                    (w[i - 15] >> 3);
+      uint32_t s1 = std::rotr(w[i - 2], 17) ^ std::rotr(w[i - 2], 19) ^
+                    (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+      uint32_t s1 = std::rotr(e, 6) ^ std::rotr(e, 11) ^ std::rotr(e, 25);
+      uint32_t choose = (e & f) ^ (~e & g);
+      uint32_t t1 = h + s1 + choose + SHA256_K[i] + w[i];
+      uint32_t s0 = std::rotr(a, 2) ^ std::rotr(a, 13) ^ std::rotr(a, 22);
+      uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+      uint32_t t2 = s0 + majority;
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  });
+
+  Sha256Digest digest;
+  for (int i = 0; i < 8; i++)
+    storeBig32(digest.data() + 4 * i, state[i]);
+  return digest;
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <array>
+#include <span>
+
+#include "transport/Pcsc.hpp"
+
+using Sha1Digest = std::array<BYTE, 20>;
+using Sha256Digest = std::array<BYTE, 32>;
+
+/**
+ * One-shot SHA-1 and SHA-256 (FIPS 180-4) of a buffer. SHA-1 is only here
+ * to check signatures of the older IRAN Root CA chain, never to identify
+ * data.
+ */
+Sha1Digest sha1(std::span<const BYTE> data);
+Sha256Digest sha256(std::span<const BYTE> data);
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "RsaPublicKey.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "transport/BerTlv.hpp"
+
+namespace {
+
+constexpr uint32_t TAG_INTEGER = 0x02;
+constexpr uint32_t TAG_SEQUENCE = 0x30;
+
+// The magnitude of a non-negative DER INTEGER, without its sign byte
+std::span<const BYTE> unsignedInteger(const Tlv &tlv) {
+  std::span<const BYTE> value = tlv.value;
+  if (tlv.tag != TAG_INTEGER || value.empty() || (value[0] & 0x80))
+    throw std::invalid_argument("RSA key: bad INTEGER");
+  while (!value.empty() && value[0] == 0)
+    value = value.subspan(1);
+  return value;
+}
+
+void toLimbs(std::span<const BYTE> bigEndian, uint32_t *limbs,
+             size_t count) {
+  std::fill(limbs, limbs + count, 0);
+  for (size_t i = 0; i < bigEndian.size(); i++) {
+    size_t bit = (bigEndian.size() - 1 - i) * 8;
+    limbs[bit / 32] |= (uint32_t)bigEndian[i] << (bit % 32);
+  }
+}
+
+// a >= b, both `count` limbs
+bool notLess(const uint32_t *a, const uint32_t *b, size_t count) {
+  for (size_t i = count; i-- > 0;)
+    if (a[i] != b[i])
+      return a[i] > b[i];
+  return true;
+}
+
+// a -= b, returning the borrow
+uint32_t subtract(uint32_t *a, const uint32_t *b, size_t count) {
+  uint64_t borrow = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint64_t difference = (uint64_t)a[i] - b[i] - borrow;
+    a[i] = (uint32_t)difference;
+    borrow = difference >> 63;
+  }
+  return (uint32_t)borrow;
+}
+
+} // namespace
+
+RsaPublicKey::RsaPublicKey(std::span<const BYTE> der) {
+  Tlv key, modulus, exponent;
+  if (parseTlv(der, 0, key) != TlvStatus::Ok || key.tag != TAG_SEQUENCE ||
+      parseTlv(key.value, 0, modulus) != TlvStatus::Ok ||
+      parseTlv(key.value, modulus.end(), exponent) != TlvStatus::Ok ||
+      exponent.end() != key.value.size())
+    throw std::invalid_argument("RSA key: not an RSAPublicKey");
+
+  std::span<const BYTE> n = unsignedInteger(modulus);
+  std::span<const BYTE> e = unsignedInteger(exponent);
+  if (n.size() < 64 || (n.back() & 1) == 0 || e.empty())
+    throw std::invalid_argument("RSA key: unusable modulus or exponent");
+
+  m_size = n.size();
+  size_t count = (m_size + 3) / 4;
+  m_modulus.resize(count);
+  toLimbs(n, m_modulus.data(), count);
+  m_exponent.assign(e.begin(), e.end());
+
+  // Newton's iteration doubles the correct low bits of the inverse each
+  // step: 1 (any odd number is its own inverse mod 2), 2, 4, 8, 16, 32
+  uint32_t inverse = 1;
+  for (int i = 0; i < 5; i++)
+    inverse *= 2 - m_modulus[0] * inverse;
+  m_inverse = 0 - inverse;
+
+  // R^2 mod n by doubling 1 mod n, 2 * 32 * count times
+  Limbs value(count + 1, 0);
+  value[0] = 1;
+  for (size_t i = 0; i < 64 * count; i++) {
+    uint32_t carry = 0;
+    for (size_t j = 0; j < count; j++) {
+      uint32_t next = value[j] >> 31;
+      value[j] = value[j] << 1 | carry;
+      carry = next;
+    }
+    if (carry || notLess(value.data(), m_modulus.data(), count))
+      subtract(value.data(), m_modulus.data(), count);
+  }
+  value.resize(count);
+  m_rSquared = std::move(value);
+}
+
+// Montgomery product a * b / R mod n, coarsely integrated (CIOS). `out`
+// may alias `a` or `b`; `scratch` holds limbs + 2 words.
+void RsaPublicKey::multiply(const uint32_t *a, const uint32_t *b,
+                            uint32_t *out, uint32_t *scratch) const {
+  size_t count = m_modulus.size();
+  const uint32_t *n = m_modulus.data();
+  uint32_t *t = scratch;
+  std::fill(t, t + count + 2, 0);
+  for (size_t i = 0; i < count; i++) {
+    uint64_t carry = 0;
+    for (size_t j = 0; j < count; j++) {
+      uint64_t sum = (uint64_t)a[j] * b[i] + t[j] + carry;
+      t[j] = (uint32_t)sum;
+      carry = sum >> 32;
+    }
+    uint64_t sum = (uint64_t)t[count] + carry;
+    t[count] = (uint32_t)sum;
+    t[count + 1] = (uint32_t)(sum >> 32);
+
+    uint32_t m = t[0] * m_inverse;
+    carry = ((uint64_t)m * n[0] + t[0]) >> 32;
+    for (size_t j = 1; j < count; j++) {
+      uint64_t sum = (uint64_t)m * n[j] + t[j] + carry;
+      t[j - 1] = (uint32_t)sum;
+      carry = sum >> 32;
+    }
+    sum = (uint64_t)t[count] + carry;
+    t[count - 1] = (uint32_t)sum;
+    t[count] = t[count + 1] + (uint32_t)(sum >> 32);
+  }
+  if (t[count] || notLess(t, n, count))
+    subtract(t, n, count);
+  std::copy(t, t + count, out);
+}
+
+bool RsaPublicKey::verifyPkcs1(std::span<const BYTE> signature,
+                               std::span<const BYTE> digestInfo) const {
+  // EM = 00 01 FF..FF 00 || DigestInfo, with at least eight FF bytes
+  if (signature.size() != m_size || digestInfo.size() + 11 > m_size)
+    return false;
+
+  size_t count = m_modulus.size();
+  Limbs base(count), result(count), scratch(count + 2);
+  toLimbs(signature, base.data(), count);
+  if (notLess(base.data(), m_modulus.data(), count))
+    return false;
+
+  // Left to right over the exponent, in the Montgomery domain
+  multiply(base.data(), m_rSquared.data(), base.data(), scratch.data());
+  result = base;
+  bool leading = true;
+  for (BYTE byte : m_exponent) {
+    for (int bit = 7; bit >= 0; bit--) {
+      if (leading) {
+        leading = ((byte >> bit) & 1) == 0;
+        continue;
+      }
+      multiply(result.data(), result.data(), result.data(), scratch.data());
+      if ((byte >> bit) & 1)
+        multiply(result.data(), base.data(), result.data(), scratch.data());
+    }
+  }
+  Limbs one(count, 0);
+  one[0] = 1;
+  multiply(result.data(), one.data(), result.data(), scratch.data());
+
+  std::vector<BYTE> message(m_size);
+  for (size_t i = 0; i < m_size; i++) {
+    size_t bit = (m_size - 1 - i) * 8;
+    message[i] = (BYTE)(result[bit / 32] >> (bit % 32));
+  }
+  size_t padEnd = m_size - digestInfo.size() - 1;
+  if (message[0] != 0x00 || message[1] != 0x01 || message[padEnd] != 0x00)
+    return false;
+  if (!std::all_of(message.begin() + 2, message.begin() + padEnd,
+                   [](BYTE b) { return b == 0xFF; }))
+    return false;
+  return std::equal(digestInfo.begin(), digestInfo.end(),
+                    message.begin() + padEnd + 1);
+}
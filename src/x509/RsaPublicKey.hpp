@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2025 Iranians.vote
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "transport/Pcsc.hpp"
+
+/**
+ * An RSA public key, ready to check signatures. The modulus is kept as
+ * 32-bit limbs with its Montgomery constants, which are worked out once
+ * when the key is made, so each check is just the public exponentiation.
+ */
+class RsaPublicKey {
+public:
+  /**
+   * Reads an RSAPublicKey SEQUENCE { modulus, publicExponent }, the
+   * subjectPublicKey of an rsaEncryption certificate. Throws
+   * std::invalid_argument if it is malformed, or the modulus is even or
+   * shorter than 512 bits.
+   */
+  explicit RsaPublicKey(std::span<const BYTE> der);
+
+  /** Size of the modulus, and of every signature, in bytes. */
+  size_t size() const { return m_size; }
+
+  /**
+   * True if `signature` is an RSASSA-PKCS1-v1_5 signature (RFC 8017) whose
+   * encoded message carries exactly `digestInfo`.
+   */
+  bool verifyPkcs1(std::span<const BYTE> signature,
+                   std::span<const BYTE> digestInfo) const;
+
+private:
+  using Limbs = std::vector<uint32_t>; // little-endian
+
+  void multiply(const uint32_t *a, const uint32_t *b, uint32_t *out,
+                uint32_t *scratch) const;
+
+  size_t m_size = 0;
+  Limbs m_modulus;
+  uint32_t m_inverse = 0;       // -modulus^-1 mod 2^32
+  Limbs m_rSquared;             // 2^(64 * limbs) mod modulus
+  std::vector<BYTE> m_exponent; // big-endian, no leading zeros
+};